@@ -58,6 +58,8 @@
 
 
 + (void) clearDuplicationStores;
+// Waits, within a fixed budget, for the background workers (e.g. pending store writes) to finish.
++ (void) drainBackgroundWork;
 + (NSString*) getLastSessionsAttributes;
 + (NSString*) getLastSessionsEvents;
 - (void) clearLastSessionsAnalytics;
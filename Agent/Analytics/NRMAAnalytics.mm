@@ -12,6 +12,7 @@
 #import "NRMAHarvestController.h"
 #import "NRMABool.h"
 #import <Utilities/LibLogger.hpp>
+#import <Utilities/ShutdownCoordinator.hpp>
 #import "NRConstants.h"
 #import "NewRelicInternalUtils.h"
 #import "NRMAFlags.h"
@@ -57,7 +58,17 @@ static PersistentStore<std::string,BaseValue>* __attributeStore;
 {
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-    __attributeStore = new PersistentStore<std::string,BaseValue>{AnalyticsController::getAttributeDupStoreName(), [NewRelicInternalUtils getStorePath].UTF8String, &NewRelic::Value::createValue};
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.format = StoreOptions::Format::Binary;
+    options.durability = StoreOptions::Durability::AtomicReplace;
+    options.legacyFilename = AnalyticsController::getAttributeDupStoreLegacyName();
+    // only read back by fetchDuplicatedAttributes(), which waits for the load
+    options.loading = StoreOptions::Loading::Background;
+    // mirrors every attribute write; flush bursts of them together
+    options.flushIdle = std::chrono::milliseconds(50);
+    options.flushRecords = 512;
+    __attributeStore = new PersistentStore<std::string,BaseValue>{AnalyticsController::getAttributeDupStoreName(), [NewRelicInternalUtils getStorePath].UTF8String, &NewRelic::Value::createValue, options};
     });
 
     return (*__attributeStore);
@@ -68,12 +79,24 @@ static PersistentStore<std::string,AnalyticEvent>* __eventStore;
 {
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
+        // every addEvent() and eviction touches this store; append instead of rewriting the buffer each time
+        StoreOptions options;
+        options.writeMode = StoreOptions::WriteMode::Journal;
+        options.format = StoreOptions::Format::Binary;
+        // read back after a crash by fetchDuplicatedEvents(); must never be half written
+        options.durability = StoreOptions::Durability::AtomicReplace;
+        options.legacyFilename = AnalyticsController::getEventDupStoreLegacyName();
+        // backstop for a harvest that never drains it; the event buffer itself stays far below this
+        options.maxBytes = 8 * 1024 * 1024;
+        // the launching thread doesn't wait on it; swap() / load() wait for the file to be read
+        options.loading = StoreOptions::Loading::Background;
         __eventStore = new PersistentStore<std::string,AnalyticEvent>{AnalyticsController::getEventDupStoreName(),
                                                                      [NewRelicInternalUtils getStorePath].UTF8String,
                                                                      &NewRelic::EventManager::newEvent,
                                                                      [](std::string const& key, std::shared_ptr<AnalyticEvent> event){
-                                                                        return key == EventManager::createKey(event) ;
-                                                                     }};
+                                                                        return EventManager::adoptKey(key, event);
+                                                                     },
+                                                                     options};
     });
     return (*__eventStore);
 }   
@@ -1059,9 +1082,9 @@ static PersistentStore<std::string,AnalyticEvent>* __eventStore;
         return [_eventManager getEventJSONStringWithError:&error clearEvents:true];
     } else {
         try {
-            auto events = _analyticsController->getEventsJSON(true);
             std::stringstream stream;
-            stream <<std::setprecision(13)<< *events;
+            stream <<std::setprecision(13);
+            _analyticsController->writeEventsJSON(stream, true);
             return [NSString stringWithUTF8String:stream.str().c_str()];
         } catch (std::exception& e) {
             NRLOG_AGENT_VERBOSE(@"Failed to generate event json: %s",e.what());
@@ -1153,6 +1176,18 @@ static PersistentStore<std::string,AnalyticEvent>* __eventStore;
     }
 }
 
++ (void) drainBackgroundWork
+{
+    try {
+        auto drain = NewRelic::ShutdownCoordinator::shared().drain();
+        NRLOG_AGENT_VERBOSE(@"Drained %u of %u background workers in %lld us.", drain.drained, drain.participants, (long long)drain.elapsed.count());
+    } catch (std::exception& e) {
+        NRLOG_AGENT_VERBOSE(@"Failed to drain background workers: %s",e.what());
+    } catch(...) {
+        NRLOG_AGENT_VERBOSE(@"Failed to drain background workers.");
+    }
+}
+
 
 - (void) clearLastSessionsAnalytics {
     if([NRMAFlags shouldEnableNewEventSystem]){
@@ -1023,6 +1023,8 @@ static UIBackgroundTaskIdentifier background_task;
                 if (harvester) {
                     [harvester execute];
                 }
+                // get pending store writes, the harvest's removals included, to disk before the app is suspended
+                [NRMAAnalytics drainBackgroundWork];
 #ifndef DISABLE_NRMA_EXCEPTION_WRAPPER
             } @catch (NSException *exception) {
                 [NRMAExceptionHandler logException:exception
@@ -1101,6 +1103,8 @@ static UIBackgroundTaskIdentifier background_task;
                     if (harvester) {
                         [harvester execute];
                     }
+                    // get pending store writes, the harvest's removals included, to disk before the app is suspended
+                    [NRMAAnalytics drainBackgroundWork];
 
 #if !TARGET_OS_TV && !TARGET_OS_WATCH
                     [self sessionReplayEndSession];
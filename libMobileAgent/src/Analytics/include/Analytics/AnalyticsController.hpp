@@ -33,6 +33,9 @@ namespace NewRelic {
         static const char *ATTRIBUTE_STORE_DB_FILENAME;
         static const char *ATTRIBUTE_DUP_STORE_DB_FILENAME;
         static const char *EVENT_DUP_STORE_DB_FILENAME;
+        static const char *ATTRIBUTE_STORE_DB_LEGACY_FILENAME;
+        static const char *ATTRIBUTE_DUP_STORE_DB_LEGACY_FILENAME;
+        static const char *EVENT_DUP_STORE_DB_LEGACY_FILENAME;
         const std::vector <std::string> _reserved_eventTypes{
                 __kNRMA_RET_mobile,
                 __kNRMA_RET_mobileCrash,
@@ -87,6 +90,10 @@ namespace NewRelic {
 
         static unsigned long long int getCurrentTime_ms(); //throws std::logic_error
 
+        //the events to harvest; when clearing, the buffer is swapped out and the dup store emptied under the
+        //events lock, and serialization happens after it is released
+        std::vector <std::shared_ptr<AnalyticEvent>> takeHarvest(bool clearEvents);
+
     public:
 
         virtual ~AnalyticsController() = default;
@@ -97,6 +104,12 @@ namespace NewRelic {
 
         static const char *getEventDupStoreName();
 
+        //the text store files the stores above were kept in before they were binary;
+        //they're read once, then removed (see StoreOptions::legacyFilename)
+        static const char *getAttributeDupStoreLegacyName();
+
+        static const char *getEventDupStoreLegacyName();
+
         const AttributeValidator &getAttributeValidator() const;
 
         bool addSessionEndAttribute();
@@ -131,6 +144,7 @@ namespace NewRelic {
         unsigned int getEventsRecordedCount() const;
 
         unsigned int getEventsEvictedCount() const;
+        std::map<std::string, EventTypeCounts> getEventTypeCounts() const;
 
         bool addRequestEvent(const NewRelic::NetworkRequestData& requestData,
                              const NewRelic::NetworkResponseData& responseData,
@@ -165,6 +179,9 @@ namespace NewRelic {
 
         std::shared_ptr <NRJSON::JsonArray> getEventsJSON(bool clearEvents);
 
+        //the text of getEventsJSON(), streamed to os
+        void writeEventsJSON(std::ostream& os, bool clearEvents);
+
         std::shared_ptr <NRJSON::JsonObject> getSessionAttributeJSON() const;
 
         const std::map <std::string, std::shared_ptr<AttributeBase>> getSessionAttributes() const;
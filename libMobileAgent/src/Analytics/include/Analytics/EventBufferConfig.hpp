@@ -2,12 +2,32 @@
 
 #ifndef __EventBufferConfig_H_
 #define __EventBufferConfig_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
 namespace NewRelic {
+ enum class EventRetention {
+     Sampled,   // competes for room in a full buffer through the reservoir
+     NeverEvict // kept until harvest once buffered; takes the place of a sampled event when the buffer is full
+ };
+
+ struct EventTypePolicy {
+     unsigned int quota = 0; // most events of the type buffered at once; 0 leaves only the overall buffer size
+     EventRetention retention = EventRetention::Sampled;
+ };
+
  class EventBufferConfig {
  private:
      unsigned int _max_buffer_time_sec = kMaxEventBufferTimeSecDefault;
      unsigned int _max_buffer_size     = kMaxEventBufferSizeDefault;
 
+     mutable std::mutex _policiesMutex;
+     std::map<std::string, EventTypePolicy> _policies;
+     std::atomic<unsigned int> _policiesVersion{1}; // bumped by every policy change
+
      static EventBufferConfig* __instance;
 
      EventBufferConfig() = default;
@@ -21,6 +41,12 @@ namespace NewRelic {
      unsigned int get_max_buffer_time_sec() const;
 
      unsigned int get_max_buffer_size() const;
+
+     // keyed by AnalyticEvent::getEventType(); types without a policy get the default one
+     void setEventTypePolicy(const std::string& eventType, EventTypePolicy policy);
+     void clearEventTypePolicies();
+     EventTypePolicy getEventTypePolicy(const std::string& eventType) const;
+     unsigned int getEventTypePoliciesVersion() const;
  };
 }
 
@@ -0,0 +1,53 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_EVENTJSONWRITER_HPP
+#define LIBMOBILEAGENT_EVENTJSONWRITER_HPP
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NewRelic {
+    class AnalyticEvent;
+    class BaseValue;
+
+    /*
+     * Streams events to a caller's std::ostream as a JSON array without building
+     * NRJSON objects first. The bytes are the same as streaming EventManager::toJSON():
+     * keys in std::map order, the NRJSON spacing and escaping, doubles at 15 digits.
+     *
+     * An event reports its own fields through AnalyticEvent::addJSONFields(); they are
+     * merged with its attributes as they are written, so nothing is copied per event.
+     */
+    class EventJSONWriter {
+    public:
+        explicit EventJSONWriter(std::ostream& os);
+
+        void write(const std::vector<std::shared_ptr<AnalyticEvent>>& events);
+        void write(const AnalyticEvent& event);
+
+        // attributesOverride: an attribute of the same name is written instead of the field
+        void addField(const char* name, const std::string& value, bool attributesOverride);
+        void addField(const char* name, double value, bool attributesOverride);
+
+    private:
+        struct Field {
+            const char* name;
+            const std::string* string; // nullptr for a number
+            double number;
+            bool attributesOverride;
+        };
+
+        void writeKey(const char* name);
+        void writeField(const Field& field);
+        void writeAttribute(const std::string& name, const BaseValue& value);
+        void writeString(const char* s);
+        void writeNumber(double value);
+
+        std::ostream& _os;
+        std::vector<Field> _fields; // the current event's; reused from event to event
+        bool _firstKey = true;
+    };
+}
+#endif //LIBMOBILEAGENT_EVENTJSONWRITER_HPP
@@ -1,7 +1,12 @@
 //  Copyright © 2023 New Relic. All rights reserved.
 
+#include <array>
+#include <atomic>
+#include <map>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <Analytics/NetworkErrorEvent.hpp>
 #include <Analytics/BreadcrumbEvent.hpp>
 #include <Analytics/RequestEvent.hpp>
@@ -24,6 +29,11 @@ namespace NewRelic {
         Session
     };
 
+    struct EventTypeCounts {
+        unsigned int recorded = 0;
+        unsigned int evicted = 0; // this type's events that lost their place, or were turned away
+    };
+
     struct EventAddResult {
         bool added = false;
         bool overflowed = false;
@@ -34,18 +44,81 @@ namespace NewRelic {
     class EventManager {
     friend class AnalyticsController;
     private :
-        mutable std::recursive_mutex _eventsMutex;
+        mutable std::shared_timed_mutex _eventsMutex; //shared by toJSON(), exclusive for changes to _events
         std::vector<std::shared_ptr<AnalyticEvent>> _events;
         PersistentStore<std::string,AnalyticEvent>&  _eventDuplicationStore;
 
+        // addEvent() stages events in a slot of the recording thread's own (threads past
+        // STAGING_SLOTS share) while the buffer has room, so recording threads don't serialize on
+        // _eventsMutex. Staged events are merged into _events at harvest, once the buffer fills,
+        // and whenever a slot holds STAGING_BATCH_SIZE events.
+        // Per event type: counters, the type's share of _buffered, and its EventTypePolicy as of
+        // policyVersion. Entries live as long as the manager, so pointers to them stay valid.
+        struct TypeState {
+            std::atomic<unsigned int> recorded{0};
+            std::atomic<unsigned int> evicted{0};
+            std::atomic<std::size_t> buffered{0};
+            std::atomic<uint64_t> attempted{0}; //since the last harvest; the type's own reservoir once at its quota
+            std::atomic<unsigned int> quota{0};
+            std::atomic<bool> neverEvict{false};
+            std::atomic<unsigned int> policyVersion{0};
+            std::vector<uint32_t> slots; //indices in _events of the type's events (guarded by _eventsMutex)
+        };
+        mutable std::shared_timed_mutex _typesMutex; //taken after _eventsMutex when both are held
+        std::unordered_map<std::string, std::unique_ptr<TypeState>> _types;
+
+        // an event with what addEvent() worked out about it, so merging and eviction don't look it up again
+        struct Admitted {
+            std::shared_ptr<AnalyticEvent> event;
+            TypeState* type;
+            bool neverEvict;
+        };
+
+        struct alignas(64) StagingSlot {
+            mutable std::mutex mutex;
+            std::vector<Admitted> events;
+        };
+        static const std::size_t STAGING_SLOTS = 16;
+        static const std::size_t STAGING_BATCH_SIZE = 32;
+        std::array<StagingSlot, STAGING_SLOTS> _staging;
+        // events in _events or staged, plus those addEvent() has made room for and not staged yet
+        std::atomic<std::size_t> _buffered{0};
+
+        // For each entry of _events: its type and where it sits in the type's slots and in _evictable.
+        // Kept in step with _events (guarded by _eventsMutex).
+        static const uint32_t NOT_EVICTABLE = UINT32_MAX;
+        struct SlotInfo {
+            TypeState* type;
+            uint32_t typePosition;
+            uint32_t evictablePosition; //NOT_EVICTABLE for a never-evict event
+        };
+        std::vector<SlotInfo> _slots;
+        std::vector<uint32_t> _evictable; //indices in _events of events that may be evicted (guarded by _eventsMutex)
+
+        TypeState& typeState(const std::string& eventType);
+        bool reserve(TypeState& type, std::size_t maxBufferSize, bool& wasEmpty); //claims a place in the buffer and the type's quota
+        std::size_t findVictim(TypeState& type, bool neverEvict); //caller holds _eventsMutex
+        void place(std::size_t index, TypeState& type, bool neverEvict); //caller holds _eventsMutex
+        void unplace(std::size_t index); //caller holds _eventsMutex
+        void released(); //caller holds _eventsMutex; the merged events are about to be harvested or discarded
+
+        void stage(Admitted admitted);
+        void mergeStaged(); //caller holds _eventsMutex
+        void discardMerged(); //caller holds _eventsMutex; events staged since the last merge stay
+        //caller holds _eventsMutex; as discardMerged(), handing the events back instead of destroying them;
+        //their duplication store records are left to the caller
+        std::vector<std::shared_ptr<AnalyticEvent>> detachMerged();
+        //merged and staged events as of now, leaving both in place; what toJSON() and writeJSON() write
+        std::vector<std::shared_ptr<AnalyticEvent>> snapshotEvents() const;
+
         //helper function for deserialization.
         static std::stringstream readStreamToDelimiter(std::istream& is, char delimiter);
         //_oldest_event_timestamp_ms is used in didReachMaxQueueTime().
         // 0 is a special case that results in "false" for didReachMaxQueueTime();
-        unsigned long long _oldest_event_timestamp_ms = 0; //special case!
-        int _total_attempted_inserts = 0;
-        unsigned int _events_recorded = 0;
-        unsigned int _events_evicted = 0;
+        std::atomic<unsigned long long> _oldest_event_timestamp_ms{0}; //special case!
+        std::atomic<uint64_t> _total_attempted_inserts{0};
+        std::atomic<unsigned int> _events_recorded{0};
+        std::atomic<unsigned int> _events_evicted{0};
 
     public:
         EventManager(PersistentStore<std::string,AnalyticEvent>& store);
@@ -55,6 +128,7 @@ namespace NewRelic {
         EventAddResult addEvent(std::shared_ptr<AnalyticEvent> event);
         unsigned int getEventsRecordedCount() const { return _events_recorded; }
         unsigned int getEventsEvictedCount() const { return _events_evicted; }
+        std::map<std::string, EventTypeCounts> getEventTypeCounts() const;
 
 
         //deprecated, replaced with newCustomEvent
@@ -104,11 +178,20 @@ namespace NewRelic {
 
         std::shared_ptr<NRJSON::JsonArray> toJSON() const;
         static std::shared_ptr<NRJSON::JsonArray> toJSON(std::vector<std::shared_ptr<AnalyticEvent>> events);
+        //same text as streaming toJSON(), written in one pass without building the JSON objects
+        void writeJSON(std::ostream& os) const;
+        static void writeJSON(std::ostream& os, const std::vector<std::shared_ptr<AnalyticEvent>>& events);
 
-        static std::string createKey(std::shared_ptr<AnalyticEvent> event);
+        static const std::size_t KEY_LENGTH = 24;
+        static std::string createKey(std::shared_ptr<AnalyticEvent> event); //dup-store key: the event's id and a fingerprint of it, in hex
+        static std::vector<std::string> keysOf(const std::vector<std::shared_ptr<AnalyticEvent>>& events); //createKey() of each, for a batch removal from the dup store
+        static bool isValidKey(std::string const& key, std::shared_ptr<AnalyticEvent> event); //dup-store validator
+        static bool adoptKey(std::string const& key, std::shared_ptr<AnalyticEvent> event); //dup-store validator: isValidKey(), then restores the event's id from its key
 
         //_events buffer controls
-        virtual int getRemovalIndex(); //returns a number between 0 and _total_attempted_inserts. used when MaxBufferSize is reached.
+        virtual uint64_t getRemovalIndex(); //returns a number between 0 and _total_attempted_inserts inclusive. used when MaxBufferSize is reached.
+        static uint64_t uniformRandom(uint64_t bound); //uniform in [0, bound) from a per-thread generator; 0 for a bound of 0
+        static void seedRandom(uint64_t seed); //reseeds the calling thread's generator, so a run can be repeated
         void setMaxBufferTime(unsigned int seconds); //sets max buffer time
         void setMaxBufferSize(unsigned int size); //sets max buffer size
         bool didReachMaxQueueTime(unsigned long long currentTimestamp_ms); //checks if oldest event timestamp exceededs max queue time
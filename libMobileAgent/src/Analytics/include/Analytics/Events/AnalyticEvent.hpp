@@ -3,19 +3,28 @@
 #ifndef __AnalyticEvent_H_
 #define __AnalyticEvent_H_
 
+#include <cstdint>
 #include <string>
 #include <map>
 #include <Utilities/BaseValue.hpp>
 #include <Analytics/Attribute.hpp>
 #include <Analytics/AttributeValidator.hpp>
+#include <Analytics/EventBufferConfig.hpp>
 #include <JSON/json.hh>
 
 namespace NewRelic {
+    template<typename T>
+    class StoreCodec;
+    class EventJSONWriter;
+
     class AnalyticEvent {
         friend class EventManager;
         friend class EventDeserializer;
+        friend class StoreCodec<AnalyticEvent>;
+        friend class EventJSONWriter;
     private:
         const std::shared_ptr<std::string> _eventType;
+        uint64_t _id; // process-unique, assigned at creation; copies keep it
         unsigned long long _timestamp_epoch_millis;
         double _session_elapsed_time_sec;
         AttributeValidator& _attributeValidator;
@@ -28,11 +37,15 @@ namespace NewRelic {
                       double session_elapsed_time_sec,
                       AttributeValidator& attributeValidator);
 
+        static uint64_t nextId();
 
     public:
         static const char _delimiter = '\t';
         virtual ~AnalyticEvent();
         virtual const std::string& getEventType() const;
+        uint64_t getId() const;
+        //the event's own retention class; its type's EventTypePolicy can raise it to NeverEvict
+        virtual EventRetention getRetention() const;
         virtual void put(std::ostream& os) const = 0;
         unsigned long long getAgeInMillis();
 
@@ -54,6 +67,8 @@ namespace NewRelic {
                           unsigned int value);
 
         virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject()const;
+        //the fields generateJSONObject() sets besides the attributes, for EventJSONWriter
+        virtual void addJSONFields(EventJSONWriter& writer) const;
 
         friend std::ostream& operator<<( std::ostream& os,const AnalyticEvent& event);
 
@@ -24,6 +24,7 @@ namespace NewRelic {
         virtual const std::string&  getCategory() const = 0;
         virtual bool equal(const AnalyticEvent& event) const;
         virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject()const;
+        virtual void addJSONFields(EventJSONWriter& writer) const;
     };
 
 }
@@ -20,6 +20,7 @@ namespace NewRelic {
         virtual bool equal(const AnalyticEvent& event) const;
         NamedAnalyticEvent(const NamedAnalyticEvent& event);
         virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject()const;
+        virtual void addJSONFields(EventJSONWriter& writer) const;
         virtual void put(std::ostream& os) const;
     };
 }
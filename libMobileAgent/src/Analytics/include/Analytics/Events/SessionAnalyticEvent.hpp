@@ -21,6 +21,7 @@ namespace NewRelic{
         virtual ~SessionAnalyticEvent();
 
         virtual const std::string& getCategory() const;
+        virtual EventRetention getRetention() const;
         static const std::string& __category;
         virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject()const;
 
@@ -26,6 +26,7 @@ namespace NewRelic {
         
         virtual void put(std::ostream& os) const;
         virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject() const;
+        virtual void addJSONFields(EventJSONWriter& writer) const;
 
     };
 }
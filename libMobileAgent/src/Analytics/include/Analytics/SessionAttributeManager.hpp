@@ -9,13 +9,15 @@
 #include <Analytics/PersistentStore.hpp>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <JSON/json.hh>
 
 namespace NewRelic {
     class SessionAttributeManager {
         friend class AnalyticsController;
     private:
-        mutable std::recursive_mutex _attributesLock;
+        mutable std::shared_timed_mutex _attributesLock;
         std::map<std::string, std::shared_ptr<AttributeBase>> _sessionAttributes;
 
         mutable std::mutex _privateAttributesLock;
@@ -64,6 +66,17 @@ namespace NewRelic {
          */
         bool addAttribute(std::shared_ptr<AttributeBase> attribute, bool persistent);
 
+        // addAttribute() for a caller already holding _attributesLock exclusively
+        bool addAttributeLocked(std::shared_ptr<AttributeBase> attribute);
+        bool addAttributeLocked(std::shared_ptr<AttributeBase> attribute, bool persistent);
+
+        template<typename V>
+        std::shared_ptr<AttributeBase> createNumberAttribute(const char* name, V value) const;
+
+        // persistent is null for the overloads that keep the stored persistence
+        template<typename V>
+        bool incrementAttribute(const char *name, V value, const bool* persistent);
+
 
 
     public:
@@ -21,33 +21,147 @@ namespace NewRelic {
     protected:
         typedef std::map<K, std::shared_ptr<T>> MAP_T;
         typedef std::shared_ptr<T> VALUE_T;
+        typedef std::shared_ptr<const MAP_T> SNAPSHOT_T;
 
         mutable std::mutex m;
-        std::map <K, VALUE_T> map;
+        // The cache is map with the writes in _pending applied. A write made while a snapshot still
+        // shares map goes to _pending instead of copying the whole map; the pending writes are folded
+        // into map by the first write after the snapshots are gone, or by the next snapshot.
+        std::shared_ptr<MAP_T> map = std::make_shared<MAP_T>();
+
+        // callers of the helpers below hold m
+
+        VALUE_T find(const K& key) const {
+            auto pending = _pending.find(key);
+            if (pending != _pending.end()) {
+                return pending->second.value;
+            }
+            auto it = map->find(key);
+            return it != map->end() ? it->second : nullptr;
+        }
+
+        bool contains(const K& key) const {
+            auto pending = _pending.find(key);
+            if (pending != _pending.end()) {
+                return !pending->second.removed;
+            }
+            return map->count(key) > 0;
+        }
+
+        std::size_t entries() const {
+            return _entries;
+        }
+
+        void put(const K& key,
+                 VALUE_T value) {
+            if (!contains(key)) {
+                _entries++;
+            }
+            if (map.use_count() > 1) {
+                _pending[key] = PendingWrite{std::move(value), false};
+                return;
+            }
+            fold();
+            (*map)[key] = std::move(value);
+        }
+
+        // false if the key wasn't cached
+        bool erase(const K& key) {
+            if (!contains(key)) {
+                return false;
+            }
+            _entries--;
+            if (map.use_count() > 1) {
+                _pending[key] = PendingWrite{nullptr, true};
+                return true;
+            }
+            fold();
+            map->erase(key);
+            return true;
+        }
+
+        void reset() {
+            map = std::make_shared<MAP_T>();
+            _pending.clear();
+            _entries = 0;
+        }
+
+        // The whole cache. Copies map only if pending writes have to go into it while a snapshot
+        // still shares it; the copy is then paid by the reader, never by a writer.
+        const MAP_T& current() {
+            fold();
+            return *map;
+        }
+
+        SNAPSHOT_T frozen() {
+            fold();
+            return map;
+        }
+
+        // Hands the cache over and starts an empty one; the map is only copied if a snapshot of it is still alive.
+        MAP_T take() {
+            fold();
+            std::shared_ptr<MAP_T> taken = map;
+            reset();
+            if (taken.use_count() > 1) {
+                return *taken;
+            }
+            return std::move(*taken);
+        }
 
     public:
         virtual void clear() {
             std::lock_guard<std::mutex> lk(m);
-            map.clear();
+            reset();
         }
 
         virtual void store(K key, std::shared_ptr<T> obj) {
             std::lock_guard<std::mutex> lk(m);
-            map[key] = obj;
+            put(key, obj);
         }
 
         virtual void remove(K key) {
             std::lock_guard<std::mutex> lk(m);
-            map.erase(key);
+            erase(key);
         }
 
         virtual std::map <K, std::shared_ptr<T>> load() {
             std::lock_guard<std::mutex> lk(m);
-            return map;
+            return current();
         }
 
+        // Immutable view of the cache as it is now. Later writes leave it untouched, and while it is
+        // alive they cost no more than they would without it.
+        virtual SNAPSHOT_T snapshot() {
+            std::lock_guard<std::mutex> lk(m);
+            return frozen();
+        }
 
+    private:
+        // a write waiting to go into map; a removal has no value
+        struct PendingWrite {
+            VALUE_T value;
+            bool removed;
+        };
+        std::map<K, PendingWrite> _pending;
+        std::size_t _entries = 0;
 
+        void fold() {
+            if (_pending.empty()) {
+                return;
+            }
+            if (map.use_count() > 1) {
+                map = std::make_shared<MAP_T>(*map);
+            }
+            for (auto& pending : _pending) {
+                if (pending.second.removed) {
+                    map->erase(pending.first);
+                } else {
+                    (*map)[pending.first] = std::move(pending.second.value);
+                }
+            }
+            _pending.clear();
+        }
     };
 
 } // namespace NewRelic
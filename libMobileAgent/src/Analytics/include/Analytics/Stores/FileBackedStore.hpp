@@ -1,40 +1,140 @@
 //  Copyright © 2023 New Relic. All rights reserved.
 
-#include <unistd.h>
+#include <sys/stat.h>
 #include <Analytics/CacheBackedStore.hpp>
+#include <Analytics/StoreOptions.hpp>
+#include <Analytics/RecordFormat.hpp>
+#include <Analytics/StoreCodec.hpp>
+#include <Analytics/StoreFile.hpp>
+#include <Analytics/StoreFormat.hpp>
 #include <Utilities/libLogger.hpp>
+#include <Utilities/MappedFile.hpp>
+#include <Utilities/ShutdownCoordinator.hpp>
 #include <Utilities/WorkQueue.hpp>
 #include <Analytics/AnalyticEvent.hpp>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <future>
+#include <set>
 #include <sstream>
+#include <vector>
 
 
 #ifndef LIBMOBILEAGENT_FILEBACKEDSTORE_HPP
 #define LIBMOBILEAGENT_FILEBACKEDSTORE_HPP
 namespace NewRelic {
-template<typename K, typename T>
-class FileBackedStore : public CacheBackedStore<K, T> {
+/*
+ * Codec turns values into binary record bytes and back (see StoreCodec); text files always
+ * go through operator<< and the factory.
+ */
+template<typename K, typename T, typename Codec = StoreCodec<T>>
+class FileBackedStore : public CacheBackedStore<K, T>, private ShutdownCoordinator::Participant {
 
 private:
-    const char* BACKUP_SUFFIX = ".bak";
+    typedef typename CacheBackedStore<K, T>::MAP_T MAP_T;
+    typedef typename CacheBackedStore<K, T>::SNAPSHOT_T SNAPSHOT_T;
+    typedef std::chrono::time_point<std::chrono::system_clock> TIME_T;
+    typedef std::multimap<TIME_T, K> AGE_INDEX_T;
+
+    // a journal record with a null value is a tombstone
+    struct JournalRecord {
+        K key;
+        std::shared_ptr<T> value;
+    };
+
+    static const char JOURNAL_PUT = RecordFormat::PUT;
+    static const char JOURNAL_REMOVE = RecordFormat::REMOVE;
+
     mutable std::mutex _fileMutex;
-    std::ofstream _fO;
     std::string _fullPath;
+    // (guarded by _fileMutex)
+    StoreFile _file;
+    // StoreOptions::legacyFilename in the store's directory, empty if there is none
+    std::string _legacyPath;
+    // the cache was read from the legacy file and isn't under the store's own name yet
+    // (guarded by _fileMutex)
+    bool _migrating = false;
 
     std::shared_ptr<T> (* _factory)(std::istream&) = &FileBackedStore::read;
+    Codec _codec;
 
     bool (* _validator)(K const& k,
                         std::shared_ptr<T> t);
 
     std::chrono::time_point<std::chrono::system_clock> lastWriteTime;
-    bool dirtyFlag = false;
+    std::atomic<bool> dirtyFlag{false};
+    // set while a flush is pending; store()/remove() in the meantime ride along with it
+    std::atomic<bool> _flushScheduled{false};
+    // set while the pending flush is queued; between checks of its triggers it waits on a pool timer instead
+    std::atomic<bool> _flushQueued{false};
+    // callers that want the pending flush to go out now (synchronize(), a shutdown drain, swap());
+    // each one withdraws only its own request
+    std::atomic<unsigned int> _flushRequests{0};
+    // deadline of the flush timer armed last, and whether the store is closing and takes no more timers
+    // (guarded by _flushTimerMutex, which is never held for I/O)
+    std::chrono::steady_clock::time_point _flushTimerAt = std::chrono::steady_clock::time_point::max();
+    bool _flushTimerClosed = false;
+    std::mutex _flushTimerMutex;
+    // store()/remove() calls since the last flush started, when the latest came and when the pending
+    // flush was scheduled (steady_clock ticks)
+    std::atomic<std::size_t> _pendingRecords{0};
+    std::atomic<std::chrono::steady_clock::rep> _lastWriteCall{0};
+    std::atomic<std::chrono::steady_clock::rep> _flushScheduledAt{0};
+    // bytes a record took in the file on the last flush; turns pending records into pending bytes
+    std::atomic<std::size_t> _bytesPerRecord{64};
+
+    StoreOptions _options;
+    // journal records not yet appended to the file (guarded by CacheBackedStore::m)
+    std::vector<JournalRecord> _journal;
+    // true once the file on disk is a journal we can append to (guarded by _fileMutex)
+    bool _journalReady = false;
+    // number of records in the on-disk journal, live or stale (guarded by _fileMutex)
+    std::size_t _journalRecords = 0;
+    bool _compactionQueued = false;
+    // removeAll() left less in the store than tombstones would take; the next flush rewrites the
+    // journal instead of appending (guarded by CacheBackedStore::m)
+    bool _rewriteQueued = false;
+
+    // when each key was last stored, oldest first; only kept when a capacity limit is set
+    // (guarded by CacheBackedStore::m)
+    AGE_INDEX_T _byAge;
+    std::map<K, typename AGE_INDEX_T::iterator> _ageOf;
+    std::atomic<uint64_t> _evictedForEntries{0};
+    std::atomic<uint64_t> _evictedForBytes{0};
+    std::atomic<uint64_t> _evictedForAge{0};
+
+    // set once the file has been read; in Background mode that happens on the work queue
+    std::promise<void> _loadedPromise;
+    std::shared_future<void> _loaded = _loadedPromise.get_future().share();
+    // true while a background load is running; keys stored or removed meanwhile are newer than
+    // anything in the file, so the load skips them (guarded by CacheBackedStore::m)
+    bool _loading = false;
+    std::set<K> _writtenDuringLoad;
+    // clear() was called during the background load; the rest of the file is ignored
+    bool _loadCleared = false;
+    // the file exists but couldn't be read; it isn't written until a retry reads it, and until
+    // then the store tracks writes as during a background load (guarded by _fileMutex)
+    bool _unread = false;
+
+    static const std::size_t LOAD_BATCH_SIZE = 512;
+
     WorkQueue workQueue;
 
 public:
+    static const char* journalHeader() {
+        return StoreFormat::JOURNAL_HEADER;
+    }
+
     static const inline std::chrono::time_point<std::chrono::system_clock>::duration writeThrottle() {
         return std::chrono::milliseconds(25);
     }
 
+    // compaction yields to flushes, but not for longer than this
+    static const inline std::chrono::milliseconds compactionStartWithin() {
+        return std::chrono::milliseconds(2000);
+    }
+
     FileBackedStore() : FileBackedStore("temp") {}
 
     FileBackedStore(const char* filename) : FileBackedStore(filename, "") {}
@@ -46,150 +146,324 @@ public:
     FileBackedStore(const char* filename,
                     const char* sharedPath,
                     std::shared_ptr<T>(* factory)(std::istream&))
-            : FileBackedStore(filename, sharedPath, factory, [](K const& k,
-                                                                std::shared_ptr<T> t) { return true; }) {}
+            : FileBackedStore(filename, sharedPath, factory, StoreOptions()) {}
 
     FileBackedStore(const char* filename,
                     const char* sharedPath,
                     std::shared_ptr<T>(* factory)(std::istream&),
                     bool(* validator)(K const&,
                                       std::shared_ptr<T>))
+            : FileBackedStore(filename, sharedPath, factory, validator, StoreOptions()) {}
+
+    FileBackedStore(const char* filename,
+                    const char* sharedPath,
+                    std::shared_ptr<T>(* factory)(std::istream&),
+                    const StoreOptions& options)
+            : FileBackedStore(filename, sharedPath, factory, [](K const&, std::shared_ptr<T>) { return true; }, options) {}
+
+    FileBackedStore(const char* filename,
+                    const char* sharedPath,
+                    std::shared_ptr<T>(* factory)(std::istream&),
+                    bool(* validator)(K const&,
+                                      std::shared_ptr<T>),
+                    const StoreOptions& options)
             : CacheBackedStore<K, T>(),
-              _fO{},
               _fullPath(getFullPath(sharedPath, filename)),
+              _file(_fullPath,
+                    options.durability == StoreOptions::Durability::AtomicReplace,
+                    [this](int fd, const char* data, std::size_t length) { writeBytes(fd, data, length); }),
+              _legacyPath(options.legacyFilename.empty() ? "" : getFullPath(sharedPath, options.legacyFilename)),
               _factory(factory),
+              _codec(factory),
               _validator(validator),
               lastWriteTime(),
-              workQueue() {
-        loadFromFile();
-        clearBackup();
+              _options(options),
+              // a strand on the shared pool rather than a thread per store; writes to the file stay in order
+              workQueue(WorkQueue::DEFAULT_CAPACITY, WorkQueue::OverflowPolicy::Spill, &IOThreadPool::shared()) {
+        ShutdownCoordinator::shared().enroll(this);
+        if (_options.loading == StoreOptions::Loading::Background) {
+            _loading = true;
+            // queued ahead of any flush, which therefore only runs once the file is read
+            workQueue.enqueue([this] {
+                std::lock_guard<std::mutex> lk(_fileMutex);
+                openStore(true);
+            }, WorkQueue::Priority::Control);
+            return;
+        }
+        std::lock_guard<std::mutex> lk(_fileMutex);
+        openStore(false);
     };
 
+    // true once the file has been read, false if it is still loading after timeout_ms.
+    // On a thread of the shared pool the load may need that very thread, so the caller runs the
+    // store's queue instead of waiting for it (see WorkQueue::synchronize()).
+    bool awaitLoaded(unsigned int timeout_ms) {
+        if (!IOThreadPool::shared().runsCurrentThread()) {
+            return _loaded.wait_for(std::chrono::milliseconds(timeout_ms)) == std::future_status::ready;
+        }
+        if (!isLoaded()) {
+            workQueue.synchronize(timeout_ms);
+        }
+        return isLoaded();
+    }
+
+    void awaitLoaded() {
+        if (IOThreadPool::shared().runsCurrentThread() && !isLoaded()) {
+            workQueue.synchronize();
+        }
+        _loaded.wait();
+    }
+
+    // true if the file exists but couldn't be read (see MappedFile::readable()); it is left alone until
+    // a later flush or load() can read it
+    bool isUnread() {
+        std::lock_guard<std::mutex> lk(_fileMutex);
+        return _unread;
+    }
+
     void synchronize() {
+        requestFlush();
         workQueue.synchronize();
+        releaseFlush();
     }
 
     bool synchronize(unsigned int timeout_ms) {
-        return workQueue.synchronize(timeout_ms);
+        requestFlush();
+        bool completed = workQueue.synchronize(timeout_ms);
+        releaseFlush();
+        return completed;
     }
 
 
     virtual ~FileBackedStore() {
-        // Use non-blocking terminate with 500ms timeout to avoid blocking main thread
-        // If timeout occurs, thread will be detached and finish asynchronously
+        ShutdownCoordinator::shared().withdraw(this);
+        {
+            std::lock_guard<std::mutex> lk(_flushTimerMutex);
+            _flushTimerClosed = true;
+        }
+        IOThreadPool::shared().cancelTimers(this);
+        // Queued work is dropped (its writes are still in the cache and go out with the flush below).
+        // An item already running is not cut short: workQueue is the last member, so its destructor
+        // waits for that item before anything the item uses is destroyed.
         bool completed = workQueue.terminate(500);
         if (!completed) {
-            LLOG_VERBOSE("WorkQueue terminate timed out in FileBackedStore destructor - thread detached");
+            LLOG_VERBOSE("WorkQueue terminate timed out in FileBackedStore destructor - waiting for the running item");
         }
 
         std::lock_guard<std::mutex> lk(_fileMutex);
-        if (dirtyFlag) {
-            flush();
+        try {
+            if (!awaitLoaded(0)) {
+                // never got to read the file; writing the partial cache over it would lose the rest
+                LLOG_VERBOSE("\"%s\" closed before it finished loading, pending writes are dropped.", _fullPath.c_str());
+            } else if (dirtyFlag) {
+                flush();
+            }
+        } catch (std::exception& e) {
+            LLOG_VERBOSE("Failed to flush \"%s\" on close: %s", _fullPath.c_str(), e.what());
+        } catch (...) {
+            LLOG_VERBOSE("Failed to flush \"%s\" on close.", _fullPath.c_str());
         }
-        if (_fO.is_open())
-            _fO.close();
+        _file.close();
     }
 
     virtual void clear() {
-        CacheBackedStore<K, T>::clear();
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            if (_loading) {
+                // the truncate below is queued behind the load, which stops adding to the cache
+                _loadCleared = true;
+                _writtenDuringLoad.clear();
+            }
+            CacheBackedStore<K, T>::reset();
+            _journal.clear();
+            _byAge.clear();
+            _ageOf.clear();
+        }
         workQueue.enqueue([this] {
             try {
                 std::lock_guard<std::mutex> lk(_fileMutex);
-                _fO.close();
-                _fO.open(_fullPath, std::ios::trunc);
-                _fO.rdbuf()->pubsetbuf(0, 0);
+                _journalReady = false;
+                _journalRecords = 0;
+                _file.truncate();
+                finishMigration();
+                if (_unread) {
+                    // nothing left to read
+                    _unread = false;
+                    endLoad();
+                }
             } catch (std::exception& e) {
                 LLOG_VERBOSE("failed to clear file: %s\nreason: %s", _fullPath.c_str(), e.what());
             } catch (...) {
                 LLOG_VERBOSE("Failed to clear file: %s", _fullPath.c_str());
             }
-        });
+        }, WorkQueue::Priority::Control); // ahead of pending flushes, which write what is left after the clear
     }
 
     virtual void store(K key,
                        std::shared_ptr<T> obj) {
-        CacheBackedStore<K, T>::store(key, obj);
-        dirtyFlag = true;
-        workQueue.enqueue([this] {
-            try {
-                std::lock_guard<std::mutex> lk(_fileMutex);
-                // Check throttle, but don't block the worker thread with sleep
-                // This allows synchronize() and terminate() to complete faster
-                auto now = std::chrono::system_clock::now();
-                if (now - lastWriteTime >= writeThrottle()) {
-                    flush();
-                }
-                // If throttled, the dirty flag remains set and will be flushed
-                // on next store() call or in destructor
-            } catch (std::exception& e) {
-                LLOG_VERBOSE("Failed to store item: %s", e.what());
-            } catch (...) {
-                LLOG_VERBOSE("Failed to store item.");
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            CacheBackedStore<K, T>::put(key, obj);
+            if (isJournaled()) {
+                _journal.push_back(JournalRecord{key, obj});
             }
-        });
+            if (_loading) {
+                _writtenDuringLoad.insert(key);
+            }
+            if (hasLimits()) {
+                const TIME_T now = std::chrono::system_clock::now();
+                touch(key, now);
+                enforceLimits(now);
+            }
+        }
+        dirtyFlag = true;
+        notePendingWrite();
+        scheduleFlush();
     }
 
     virtual void remove(K key) {
-        CacheBackedStore<K, T>::remove(key);
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            // while loading, the key may still be on its way in from the file
+            if ((CacheBackedStore<K, T>::erase(key) || _loading) && isJournaled()) {
+                _journal.push_back(JournalRecord{key, nullptr});
+            }
+            if (_loading) {
+                _writtenDuringLoad.insert(key);
+            }
+            forget(key);
+        }
         dirtyFlag = true;
-        workQueue.enqueue([this] {
-            try {
-                std::lock_guard<std::mutex> lk(_fileMutex);
-                flush();
-            } catch (std::exception& e) {
-                LLOG_VERBOSE("Failed to remove item: %s", e.what());
-            } catch (...) {
-                LLOG_VERBOSE("Failed to remove item.");
+        notePendingWrite();
+        scheduleFlush();
+    }
+
+    // One remove() per key, written as one batch: a journal appends their tombstones, or is
+    // rewritten from what is left when that takes fewer records (e.g. most of the store went).
+    virtual void removeAll(const std::vector<K>& keys) {
+        if (keys.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            std::size_t removed = 0;
+            for (const auto& key : keys) {
+                removed += CacheBackedStore<K, T>::erase(key);
+                if (_loading) {
+                    _writtenDuringLoad.insert(key);
+                }
+                forget(key);
             }
-        });
+            if (isJournaled() && (removed > 0 || _loading)) {
+                if (_rewriteQueued || keys.size() >= CacheBackedStore<K, T>::entries()) {
+                    // the rewrite writes the cache as it is then, these removals included
+                    _rewriteQueued = true;
+                    _journal.clear();
+                } else {
+                    for (const auto& key : keys) {
+                        _journal.push_back(JournalRecord{key, nullptr});
+                    }
+                }
+            }
+        }
+        dirtyFlag = true;
+        notePendingWrite();
+        scheduleFlush();
     }
 
     virtual std::map<K, std::shared_ptr<T>> load() {
+        awaitLoaded();
         std::lock_guard<std::mutex> lk(_fileMutex);
-        CacheBackedStore<K, T>::clear();
-        loadFromFile();
-        return CacheBackedStore<K, T>::map;
+        // don't let the reload drop writes that haven't reached the file yet
+        if (dirtyFlag) {
+            flush();
+        }
+        if (_unread) {
+            // the cache only holds what was stored since; keep that and add what can be read now
+            retryLoad();
+        } else {
+            CacheBackedStore<K, T>::clear();
+            loadFromFile();
+        }
+        std::lock_guard<std::mutex> cacheLock(CacheBackedStore<K, T>::m);
+        return CacheBackedStore<K, T>::current();
     }
 
     virtual void flush() {
-        writeToFile();
+        if (_unread && !retryLoad()) {
+            // writing now would replace the file with only what was stored since
+            LLOG_VERBOSE("\"%s\" couldn't be read, its pending writes are kept for the next flush.", _fullPath.c_str());
+            return;
+        }
+        if (isJournaled()) {
+            appendToJournal();
+        } else {
+            writeToFile();
+        }
     }
 
+    // nullptr when the key isn't cached (or, during a background load, not read in yet)
     virtual std::shared_ptr<T> get(K key) {
-        auto map = CacheBackedStore<K, T>::map;
-        return map[key];
+        std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+        return CacheBackedStore<K, T>::find(key);
     }
 
     virtual const char* getFullStorePath() const {
         return _fullPath.c_str();
     }
 
-    const std::map<K, std::shared_ptr<T>> swap() {
+    std::map<K, std::shared_ptr<T>> swap() {
+        awaitLoaded();
+        // the file becomes the backup of what is handed over, so the writes still waiting for a
+        // flush go into it first; only that flush is waited for, not the rest of the queue
+        requestFlush();
+        WorkCompletion flushed = workQueue.enqueueTracked([this] {
+            std::lock_guard<std::mutex> lk(_fileMutex);
+            if (dirtyFlag) {
+                flush();
+            }
+        }, WorkQueue::Priority::Control);
+        if (flushed.wait() == WorkCompletion::Status::Pending) {
+            // called on the pool, where wait() doesn't block; the queue is run right here instead
+            workQueue.synchronize();
+        }
+        releaseFlush();
+
         std::lock_guard<std::mutex> flk(_fileMutex);
         std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
-        if (_fO.is_open()) {
-            _fO.flush();
-            _fO.close();
-        }
+        _journal.clear();
+        _journalReady = false;
+        _journalRecords = 0;
+        _byAge.clear();
+        _ageOf.clear();
 
-        std::string backupStorePath = std::string(getFullStorePath()) + BACKUP_SUFFIX;
-        auto result = rename(getFullStorePath(), backupStorePath.c_str());
-        if (result == 0) {
-            _fO.open(_fullPath, std::ios::trunc);
-            _fO.rdbuf()->pubsetbuf(0, 0);
-        } else {
-            LLOG_VERBOSE("failed to create backup store: %s", backupStorePath.c_str());
+        if (_unread) {
+            // what is handed over doesn't include the file, which is left to be read later
+            LLOG_VERBOSE("\"%s\" couldn't be read, it is kept rather than backed up.", _fullPath.c_str());
+        } else if (!_file.moveToBackup()) {
+            LLOG_VERBOSE("failed to create backup store: %s%s", _fullPath.c_str(), StoreFile::BACKUP_SUFFIX);
         }
 
-        // save cache data as return result, but clear the internal cache
-        auto map = getCache();
-        CacheBackedStore<K, T>::map.clear();
+        // hand the cache over as the result and start a new one
+        return CacheBackedStore<K, T>::take();
+    }
 
-        return map;
+    // immutable snapshot of the cache, see CacheBackedStore::snapshot()
+    virtual SNAPSHOT_T getCache() {
+        return CacheBackedStore<K, T>::snapshot();
     }
 
-    virtual std::map<K, std::shared_ptr<T>> getCache() {
-        return CacheBackedStore<K, T>::map;
+    // depth and latency of the queue that writes the file
+    WorkQueue::Statistics getQueueStatistics() const {
+        return workQueue.getStatistics();
+    }
+
+    EvictionCounts getEvictionCounts() const {
+        EvictionCounts counts;
+        counts.entries = _evictedForEntries;
+        counts.bytes = _evictedForBytes;
+        counts.age = _evictedForAge;
+        return counts;
     }
 
 protected:
@@ -199,63 +473,852 @@ protected:
         return t;
     }
 
+    // Group commit: every store()/remove() between two flushes shares one pending flush, which
+    // runs once one of the flush triggers is due (see flushDueAt()) and writes everything accumulated.
+    void scheduleFlush() {
+        if (_flushScheduled.exchange(true)) {
+            return;
+        }
+        _flushScheduledAt = std::chrono::steady_clock::now().time_since_epoch().count();
+        enqueueFlush();
+    }
+
+    // queues the pending flush, unless it is queued already or there is none
+    void wakeFlush() {
+        if (_flushScheduled) {
+            enqueueFlush();
+        }
+    }
+
+    void enqueueFlush() {
+        if (_flushQueued.exchange(true)) {
+            return;
+        }
+        workQueue.enqueue([this] {
+            runFlush();
+        });
+    }
+
+    // Writes the pending flush if it is due. If not, it goes back on a pool timer rather than keeping
+    // a pool thread waiting; wakeFlush() brings it back early.
+    void runFlush() {
+        // cleared before the triggers are read: a wake from here on queues the flush again
+        _flushQueued = false;
+        try {
+            if (!_flushScheduled) {
+                return;
+            }
+            const auto due = flushDueAt();
+            if (due > std::chrono::steady_clock::now()) {
+                armFlushTimer(due);
+                return;
+            }
+            std::lock_guard<std::mutex> lk(_fileMutex);
+            // writes from here on schedule the next flush; everything before is picked up by this one
+            _flushScheduled = false;
+            _pendingRecords = 0;
+            if (dirtyFlag) {
+                flush();
+            }
+        } catch (std::exception& e) {
+            _flushScheduled = false;
+            LLOG_VERBOSE("Failed to flush store: %s", e.what());
+        } catch (...) {
+            _flushScheduled = false;
+            LLOG_VERBOSE("Failed to flush store.");
+        }
+    }
+
+    void armFlushTimer(std::chrono::steady_clock::time_point due) {
+        std::lock_guard<std::mutex> lk(_flushTimerMutex);
+        // a timer due sooner comes back through runFlush(), which arms the next one
+        if (_flushTimerClosed || _flushTimerAt <= due) {
+            return;
+        }
+        _flushTimerAt = due;
+        IOThreadPool::shared().scheduleAt(this, due, [this, due] {
+            {
+                std::lock_guard<std::mutex> lk(_flushTimerMutex);
+                if (_flushTimerAt == due) {
+                    _flushTimerAt = std::chrono::steady_clock::time_point::max();
+                }
+            }
+            wakeFlush();
+        });
+    }
+
+    bool hasFlushTriggers() const {
+        return _options.flushRecords > 0 || _options.flushBytes > 0 || _options.flushIdle.count() > 0;
+    }
+
+    bool flushThresholdReached(std::size_t pending) const {
+        return (_options.flushRecords > 0 && pending >= _options.flushRecords)
+               || (_options.flushBytes > 0 && pending * _bytesPerRecord >= _options.flushBytes);
+    }
+
+    // store()/remove() side of the flush triggers: queues the pending flush the moment a size threshold is crossed
+    void notePendingWrite() {
+        const std::size_t pending = ++_pendingRecords;
+        if (!hasFlushTriggers()) {
+            return;
+        }
+        if (_options.flushIdle.count() > 0) {
+            _lastWriteCall = std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+        if (flushThresholdReached(pending) && !flushThresholdReached(pending - 1)) {
+            wakeFlush();
+        }
+    }
+
+    // When the pending flush is due: now once synchronize() asks for it or a size threshold is reached,
+    // otherwise once writes have paused for flushIdle or flushMaxDelay has passed since it was scheduled.
+    // Without triggers, once writeThrottle() has passed since the last write to the file.
+    std::chrono::steady_clock::time_point flushDueAt() {
+        typedef std::chrono::steady_clock CLOCK;
+        const auto now = CLOCK::now();
+        if (_flushRequests > 0) {
+            return now;
+        }
+        if (!hasFlushTriggers()) {
+            std::lock_guard<std::mutex> lk(_fileMutex);
+            return now + std::chrono::duration_cast<CLOCK::duration>(writeThrottle() - (std::chrono::system_clock::now() - lastWriteTime));
+        }
+        if (flushThresholdReached(_pendingRecords)) {
+            return now;
+        }
+        auto due = CLOCK::time_point{CLOCK::duration(_flushScheduledAt.load())} + _options.flushMaxDelay;
+        if (_options.flushIdle.count() > 0) {
+            const CLOCK::time_point lastWrite{CLOCK::duration(_lastWriteCall.load())};
+            due = std::min(due, lastWrite + _options.flushIdle);
+        }
+        return due;
+    }
+
+    // keeps the pending bytes estimate in line with what records actually take in the file
+    void noteRecordSize(std::size_t bytes,
+                        std::size_t records) {
+        if (records > 0) {
+            _bytesPerRecord = std::max<std::size_t>(bytes / records, 1);
+        }
+    }
+
+    // while any request is outstanding the pending flush is due at once; every requestFlush() is
+    // paired with one releaseFlush()
+    void requestFlush() {
+        _flushRequests.fetch_add(1);
+        wakeFlush();
+    }
+
+    void releaseFlush() {
+        _flushRequests.fetch_sub(1);
+    }
+
+    // ShutdownCoordinator::Participant: a queued flush goes out now instead of waiting for its triggers,
+    // and keeps doing so until awaitDrained() is over
+    void beginDrain() override {
+        requestFlush();
+    }
+
+    bool awaitDrained(ShutdownCoordinator::CLOCK::time_point deadline) override {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ShutdownCoordinator::CLOCK::now());
+        bool drained = synchronize((unsigned int)std::max<long long>(remaining.count(), 0));
+        releaseFlush();
+        return drained;
+    }
+
+    bool isJournaled() const {
+        return _options.writeMode == StoreOptions::WriteMode::Journal;
+    }
+
+    bool isBinary() const {
+        return _options.format == StoreOptions::Format::Binary;
+    }
+
+    bool hasLimits() const {
+        return _options.maxEntries > 0 || _options.maxBytes > 0 || _options.maxAge.count() > 0;
+    }
+
+    // callers hold CacheBackedStore::m
+    void touch(const K& key,
+               TIME_T time) {
+        auto it = _ageOf.find(key);
+        if (it != _ageOf.end()) {
+            _byAge.erase(it->second);
+            it->second = _byAge.emplace(time, key);
+        } else {
+            _ageOf.emplace(key, _byAge.emplace(time, key));
+        }
+    }
+
+    // callers hold CacheBackedStore::m
+    void forget(const K& key) {
+        auto it = _ageOf.find(key);
+        if (it != _ageOf.end()) {
+            _byAge.erase(it->second);
+            _ageOf.erase(it);
+        }
+    }
+
+    // Evicts the oldest entries while the store is over maxEntries or holds entries past maxAge.
+    // Returns how many were evicted. callers hold CacheBackedStore::m
+    std::size_t enforceLimits(TIME_T now) {
+        std::size_t evicted = 0;
+        while (_options.maxEntries > 0 && CacheBackedStore<K, T>::entries() > _options.maxEntries && !_byAge.empty()) {
+            evictOldest();
+            _evictedForEntries++;
+            evicted++;
+        }
+        while (_options.maxAge.count() > 0 && !_byAge.empty() && now - _byAge.begin()->first > _options.maxAge) {
+            evictOldest();
+            _evictedForAge++;
+            evicted++;
+        }
+        return evicted;
+    }
+
+    // callers hold CacheBackedStore::m
+    void evictOldest() {
+        const K key = _byAge.begin()->second;
+        forget(key);
+        if (CacheBackedStore<K, T>::erase(key) && isJournaled()) {
+            _journal.push_back(JournalRecord{key, nullptr});
+        }
+    }
+
+    TIME_T modificationTime() const {
+        struct stat info;
+        if (::stat((_migrating ? _legacyPath : _fullPath).c_str(), &info) == 0) {
+            return std::chrono::system_clock::from_time_t(info.st_mtime);
+        }
+        return std::chrono::system_clock::now();
+    }
+
+    // the value is encoded straight into out, between the record's key and its checksum
+    void appendBinaryRecord(std::string& out,
+                            char type,
+                            const K& key,
+                            const std::shared_ptr<T>& value) const {
+        const std::size_t start = beginBinaryRecord(out, type, key);
+        if (value != nullptr) {
+            _codec.encode(*value, out);
+        }
+        RecordFormat::endRecord(out, start);
+    }
+
+    // a string key goes into the record as is, any other as its operator<< text
+    static std::size_t beginBinaryRecord(std::string& out,
+                                         char type,
+                                         const std::string& key) {
+        return RecordFormat::beginRecord(out, type, key.data(), key.size());
+    }
+
+    template<typename Key>
+    static std::size_t beginBinaryRecord(std::string& out,
+                                         char type,
+                                         const Key& key) {
+        std::ostringstream os;
+        os << key;
+        const std::string k = os.str();
+        return RecordFormat::beginRecord(out, type, k.data(), k.size());
+    }
+
+    bool isLoaded() const {
+        return _loaded.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
+    }
+
+    // First read of the file, from the constructor or (background) the work queue.
+    // callers hold _fileMutex
+    void openStore(bool background) {
+        try {
+            if (background) {
+                loadInBatches();
+            } else {
+                loadFromFile();
+            }
+            _file.removeBackup();
+            _file.removeTemp();
+        } catch (std::exception& e) {
+            LLOG_VERBOSE("Failed to load \"%s\": %s", _fullPath.c_str(), e.what());
+        } catch (...) {
+            LLOG_VERBOSE("Failed to load \"%s\".", _fullPath.c_str());
+        }
+        if (background && !_unread) {
+            endLoad();
+        }
+        _loadedPromise.set_value();
+        if (dirtyFlag) {
+            // the file is in an older layout (or was written to while loading); rewrite it now
+            scheduleFlush();
+        }
+    }
+
+    // Where parsed records go. A blocking load applies them straight to the cache, its caller
+    // holding CacheBackedStore::m throughout; a background load collects them and takes the lock
+    // once per batch, so readers see the store fill in and writers aren't held up by the file.
+    class LoadSink {
+    public:
+        LoadSink(FileBackedStore& store,
+                 bool batched)
+                : _store(store),
+                  _batched(batched) {}
+
+        // a null value removes the key
+        void apply(K&& key,
+                   std::shared_ptr<T> value) {
+            if (!_batched) {
+                applyToCache(std::move(key), std::move(value));
+                return;
+            }
+            _batch.emplace_back(std::move(key), std::move(value));
+            if (_batch.size() >= LOAD_BATCH_SIZE) {
+                publish();
+            }
+        }
+
+        void publish() {
+            if (_batch.empty()) {
+                return;
+            }
+            std::lock_guard<std::mutex> lk(_store.CacheBackedStore<K, T>::m);
+            if (_store._loadCleared) {
+                _batch.clear();
+                return;
+            }
+            for (auto& record : _batch) {
+                if (_store._writtenDuringLoad.count(record.first) == 0) {
+                    applyToCache(std::move(record.first), std::move(record.second));
+                }
+            }
+            _batch.clear();
+        }
+
+        // forgets everything this load applied (an unreadable legacy file loads nothing)
+        void discard() {
+            _batch.clear();
+            if (!_batched) {
+                _store.CacheBackedStore<K, T>::reset();
+                return;
+            }
+            std::lock_guard<std::mutex> lk(_store.CacheBackedStore<K, T>::m);
+            if (_store._loadCleared) {
+                _applied.clear();
+                return;
+            }
+            for (const auto& key : _applied) {
+                if (_store._writtenDuringLoad.count(key) == 0) {
+                    _store.CacheBackedStore<K, T>::erase(key);
+                }
+            }
+            _applied.clear();
+        }
+
+    private:
+        // callers hold CacheBackedStore::m
+        void applyToCache(K&& key,
+                          std::shared_ptr<T> value) {
+            if (_batched) {
+                _applied.push_back(key);
+            }
+            if (value == nullptr) {
+                _store.CacheBackedStore<K, T>::erase(key);
+            } else {
+                _store.CacheBackedStore<K, T>::put(key, std::move(value));
+            }
+        }
+
+        FileBackedStore& _store;
+        const bool _batched;
+        std::vector<std::pair<K, std::shared_ptr<T>>> _batch;
+        std::vector<K> _applied;
+    };
+
+    // callers hold _fileMutex
     void loadFromFile() {
-        std::ifstream _fI;
-        std::string key;
-        std::string value;
+        std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+        _byAge.clear();
+        _ageOf.clear();
+        LoadSink sink{*this, false};
+        if (!readFile(sink)) {
+            // from here on the cache is filled in like during a background load, see retryLoad()
+            _loading = true;
+            return;
+        }
+        indexLoaded();
+    }
 
+    // callers hold _fileMutex
+    void loadInBatches() {
+        LoadSink sink{*this, true};
+        if (!readFile(sink)) {
+            return;
+        }
+        sink.publish();
         std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
-        _fI.open(_fullPath);
-        const std::streamoff offset = std::streamoff(0);
-        _fI.seekg(offset, std::ios_base::beg);
+        indexLoaded();
+    }
+
+    // Reads the file that couldn't be read before; what was stored or removed since takes precedence.
+    // False if it still can't be read.
+    // callers hold _fileMutex
+    bool retryLoad() {
+        loadInBatches();
+        if (_unread) {
+            return false;
+        }
+        endLoad();
+        return true;
+    }
+
+    // the cache has everything from the file; writes no longer need to be told apart from it
+    void endLoad() {
+        std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+        _loading = false;
+        _loadCleared = false;
+        _writtenDuringLoad.clear();
+    }
+
+    // False, with nothing read, if the file exists but couldn't be read (see MappedFile::readable()).
+    // callers hold _fileMutex
+    bool readFile(LoadSink& sink) {
+        _journalReady = false;
+        _journalRecords = 0;
+
+        // records are parsed straight out of the mapping; only values go through the factory's istream
+        MappedFile file(sourcePath().c_str());
+        _unread = !file.readable();
+        if (_unread) {
+            LLOG_VERBOSE("\"%s\" couldn't be read, it won't be written until it can be.", _fullPath.c_str());
+            return false;
+        }
+        _file.setSize(_migrating ? 0 : file.size());
+        parseFile(file.data(), file.size(), sink);
+        if (_migrating) {
+            // nothing is under the store's own name yet, so the first write is a full one
+            _journalReady = false;
+            dirtyFlag = true;
+        }
+        return true;
+    }
+
+    // The store's own file, or the legacy one while only that exists.
+    // callers hold _fileMutex
+    const std::string& sourcePath() {
+        if (_legacyPath.empty()) {
+            return _fullPath;
+        }
+        struct stat info;
+        if (::stat(_fullPath.c_str(), &info) == 0) {
+            // left behind by a migration that wrote the new file but didn't get to remove the old one
+            removeLegacyFiles();
+            return _fullPath;
+        }
+        if (::stat(_legacyPath.c_str(), &info) != 0) {
+            return _fullPath;
+        }
+        _migrating = true;
+        return _legacyPath;
+    }
 
+    // The store's own file now holds everything read from the legacy one.
+    // callers hold _fileMutex
+    void finishMigration() {
+        if (!_migrating) {
+            return;
+        }
+        _migrating = false;
+        removeLegacyFiles();
+    }
+
+    void removeLegacyFiles() {
+        std::remove(_legacyPath.c_str());
+        std::remove((_legacyPath + StoreFile::BACKUP_SUFFIX).c_str());
+    }
+
+    // Dates the entries just read for the capacity limits, and applies them.
+    // callers hold CacheBackedStore::m
+    void indexLoaded() {
+        if (!hasLimits()) {
+            return;
+        }
+        // an entry is at least as old as the file it was read from
+        const TIME_T written = modificationTime();
+        const MAP_T& cache = CacheBackedStore<K, T>::current();
+        for (auto it = cache.cbegin(); it != cache.cend(); it++) {
+            if (_ageOf.count(it->first) == 0) {
+                touch(it->first, written);
+            }
+        }
+        if (enforceLimits(std::chrono::system_clock::now()) > 0) {
+            dirtyFlag = true;
+        }
+    }
+
+    // Only ever sets dirtyFlag: a background load may run after store() already did.
+    // callers hold _fileMutex
+    void parseFile(const char* data,
+                   std::size_t length,
+                   LoadSink& sink) {
+        MemoryStreamBuf valueBuffer;
+        std::istream valueStream(&valueBuffer);
+
+        const uint8_t version = RecordFormat::headerVersion(data, length);
+        if (version != 0) {
+            // version 1 files hold operator<< text values; they're read as such and rewritten
+            const bool current = version == RecordFormat::VERSION;
+            const bool complete = loadBinary(data, length, current, sink, valueBuffer, valueStream);
+            // binary journals and binary snapshots share a layout, only a text store has to rewrite it
+            _journalReady = isBinary() && isJournaled() && complete && current;
+            if (!isBinary() || !complete || !current) {
+                dirtyFlag = true;
+            }
+            return;
+        }
+
+        const std::size_t offset = StoreFormat::journalStart(data, length);
+        if (offset > 0) {
+            replayJournal(data, length, offset, sink, valueBuffer, valueStream);
+            // a store switched to binary or back to rewrite mode still needs one full write
+            if (isBinary() || !isJournaled()) {
+                _journalReady = false;
+            }
+            if (!_journalReady) {
+                dirtyFlag = true;
+            }
+            return;
+        }
+
+        // legacy key / value lines; anything but a plain text store is migrated on open
+        if (length > 0 && (isBinary() || isJournaled())) {
+            dirtyFlag = true;
+        }
         try {
-            while (std::getline(_fI, key)) {
-                std::getline(_fI, value);
-                K k{key};
-                std::stringstream is{value};
+            StoreFormat::readPairs(data, length, [&](const char* key,
+                                                     std::size_t keyLength,
+                                                     const char* value,
+                                                     std::size_t valueLength) {
+                K k{std::string(key, keyLength)};
+                std::shared_ptr<T> t = decode(valueBuffer, valueStream, value, valueLength);
+                if (_validator(k, t)) {
+                    sink.apply(std::move(k), t);
+                }
+            });
+        } catch (...) {
+            sink.discard();
+        }
+    }
+
+    std::shared_ptr<T> decode(MemoryStreamBuf& buffer,
+                              std::istream& is,
+                              const char* data,
+                              std::size_t length) {
+        buffer.reset(data, length);
+        is.clear();
+        return _factory(is);
+    }
 
-                std::shared_ptr<T> t = _factory(is);
+    // Applies the records of a binary file in order. A record that fails its checksum or
+    // can't be decoded is dropped on its own; returns false if anything had to be dropped.
+    // callers hold _fileMutex
+    bool loadBinary(const char* data,
+                    std::size_t length,
+                    bool codecValues,
+                    LoadSink& sink,
+                    MemoryStreamBuf& valueBuffer,
+                    std::istream& valueStream) {
+        std::size_t dropped = 0;
+        auto result = RecordFormat::parse(data, length,
+                                          [&](char type,
+                                              const char* key,
+                                              std::size_t keyLength,
+                                              const char* value,
+                                              std::size_t valueLength) {
+            _journalRecords++;
+            try {
+                K k{std::string(key, keyLength)};
+                if (type == RecordFormat::REMOVE) {
+                    sink.apply(std::move(k), nullptr);
+                    return;
+                }
+                std::shared_ptr<T> t = codecValues ? _codec.decode(value, valueLength)
+                                                   : decode(valueBuffer, valueStream, value, valueLength);
                 if (_validator(k, t)) {
-                    CacheBackedStore<K, T>::map[k] = t;
+                    sink.apply(std::move(k), t);
                 }
+            } catch (...) {
+                dropped++;
             }
-        } catch (...) {
-            const std::streamoff offset = std::streamoff(0);
-            _fI.seekg(offset, std::ios_base::beg);
-            CacheBackedStore<K, T>::map.clear();
+        }, &dropped);
+
+        if (dropped > 0 || result != RecordFormat::ParseResult::Complete) {
+            LLOG_VERBOSE("Dropped %zu damaged record(s) from \"%s\".", dropped, _fullPath.c_str());
+            return false;
         }
-        _fI.close();
-        dirtyFlag = false;
+        return true;
     }
 
-    void writeToFile() {
-        std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
-        auto map = CacheBackedStore<K, T>::map;
+    // Replays text put/remove records in order, starting after the header line; see StoreFormat::readJournal().
+    void replayJournal(const char* data,
+                       std::size_t length,
+                       std::size_t offset,
+                       LoadSink& sink,
+                       MemoryStreamBuf& valueBuffer,
+                       std::istream& valueStream) {
+        const bool complete = StoreFormat::readJournal(data, length, offset, [&](char type,
+                                                                                 const char* key,
+                                                                                 std::size_t keyLength,
+                                                                                 const char* value,
+                                                                                 std::size_t valueLength) {
+            K k{std::string(key, keyLength)};
+            if (type == JOURNAL_REMOVE) {
+                sink.apply(std::move(k), nullptr);
+            } else {
+                std::shared_ptr<T> t = decode(valueBuffer, valueStream, value, valueLength);
+                if (_validator(k, t)) {
+                    sink.apply(std::move(k), t);
+                }
+            }
+            _journalRecords++;
+        });
+        if (complete) {
+            _journalReady = true;
+        } else {
+            LLOG_VERBOSE("Journal \"%s\" ends in a damaged record, it will be compacted.", _fullPath.c_str());
+        }
+    }
 
-        if (dirtyFlag) {
-            if (!_fO.is_open()) {
-                _fO.open(_fullPath);
-                _fO.rdbuf()->pubsetbuf(0, 0);
+    // callers hold _fileMutex
+    void appendToJournal() {
+        bool rewrite;
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            rewrite = _rewriteQueued;
+        }
+        if (!_journalReady || rewrite) {
+            compactJournal();
+            return;
+        }
+
+        std::vector<JournalRecord> records;
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            records.swap(_journal);
+            // cleared with the cache locked so a concurrent store() can't have its dirty mark erased
+            dirtyFlag = false;
+        }
+        if (records.empty()) {
+            return;
+        }
+
+        std::string bytes;
+        if (isBinary()) {
+            for (const auto& record : records) {
+                appendBinaryRecord(bytes,
+                                   record.value == nullptr ? JOURNAL_REMOVE : JOURNAL_PUT,
+                                   record.key,
+                                   record.value);
             }
+        } else {
+            std::ostringstream buffer;
+            for (const auto& record : records) {
+                if (record.value == nullptr) {
+                    buffer << JOURNAL_REMOVE << record.key << '\n';
+                } else {
+                    buffer << JOURNAL_PUT << record.key << '\n' << *(record.value) << '\n';
+                }
+            }
+            bytes = buffer.str();
+        }
+
+        if (_options.maxBytes > 0 && _file.size() + bytes.size() > _options.maxBytes) {
+            // compaction drops the stale records first, and evicts if that alone doesn't fit
+            compactJournal();
+            return;
+        }
+
+        try {
+            _file.append(bytes);
+        } catch (...) {
+            // the tail may be torn; rewrite the whole journal on the next flush
+            _journalReady = false;
+            dirtyFlag = true;
+            throw;
+        }
+
+        _journalRecords += records.size();
+        noteRecordSize(bytes.size(), records.size());
+        lastWriteTime = std::chrono::system_clock::now();
+
+        if (shouldCompact() && !_compactionQueued) {
+            _compactionQueued = true;
+            workQueue.enqueue([this] {
+                try {
+                    std::lock_guard<std::mutex> lk(_fileMutex);
+                    _compactionQueued = false;
+                    if (!_unread && shouldCompact()) {
+                        compactJournal();
+                    }
+                } catch (std::exception& e) {
+                    LLOG_VERBOSE("Failed to compact journal: %s", e.what());
+                } catch (...) {
+                    LLOG_VERBOSE("Failed to compact journal.");
+                }
+            }, WorkQueue::Priority::Background, compactionStartWithin());
+        }
+    }
+
+    bool shouldCompact() {
+        std::size_t live;
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            live = CacheBackedStore<K, T>::entries();
+        }
+        if (_journalRecords < _options.compactionMinRecords || _journalRecords <= live) {
+            return false;
+        }
+        return (double)(_journalRecords - live) / (double)_journalRecords >= _options.compactionThreshold;
+    }
 
-            _fO.seekp(0);
+    // Rewrites the journal as one put record per live entry.
+    // callers hold _fileMutex
+    void compactJournal() {
+        SNAPSHOT_T map;
+        {
+            // the snapshot covers everything pending, so those records are dropped with it
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            map = CacheBackedStore<K, T>::frozen();
+            _journal.clear();
+            _rewriteQueued = false;
+            dirtyFlag = false;
+        }
+
+        std::vector<std::size_t> sizes;
+        std::string bytes = encodeImage(*map, sizes);
+        // leave room for appends, or a journal at its limit would be compacted on every flush
+        const std::size_t records = map->size() - fitToBudget(*map, bytes, sizes, _options.maxBytes - _options.maxBytes / 8);
+
+        try {
+            replaceFile(bytes);
+        } catch (...) {
+            _journalReady = false;
+            dirtyFlag = true;
+            throw;
+        }
+
+        _journalRecords = records;
+        _journalReady = true;
+        lastWriteTime = std::chrono::system_clock::now();
+    }
+
+    // The whole file for map in the store's format: its header, if any, then one put per entry.
+    // sizes receives the length of each entry's record, in map order.
+    std::string encodeImage(const MAP_T& map,
+                            std::vector<std::size_t>& sizes) const {
+        sizes.reserve(map.size());
+        if (isBinary()) {
+            std::string bytes;
+            RecordFormat::appendHeader(bytes);
             for (auto it = map.cbegin(); it != map.cend(); it++) {
-                _fO << it->first << std::endl << std::flush;
-                _fO << *(it->second) << std::endl << std::flush;
+                const std::size_t start = bytes.size();
+                appendBinaryRecord(bytes, JOURNAL_PUT, it->first, it->second);
+                sizes.push_back(bytes.size() - start);
+            }
+            return bytes;
+        }
+
+        std::ostringstream buffer;
+        if (isJournaled()) {
+            buffer << journalHeader() << '\n';
+        }
+        std::streamoff start = buffer.tellp();
+        for (auto it = map.cbegin(); it != map.cend(); it++) {
+            if (isJournaled()) {
+                buffer << JOURNAL_PUT;
+            }
+            buffer << it->first << '\n' << *(it->second) << '\n';
+            const std::streamoff end = buffer.tellp();
+            sizes.push_back((std::size_t)(end - start));
+            start = end;
+        }
+        return buffer.str();
+    }
+
+    // Once bytes (encoded from map by encodeImage) is over maxBytes, drops the oldest entries'
+    // records until it fits in budget, and evicts them from the cache unless they were stored
+    // again since map was taken. Returns how many were dropped. callers hold _fileMutex
+    std::size_t fitToBudget(const MAP_T& map,
+                            std::string& bytes,
+                            const std::vector<std::size_t>& sizes,
+                            std::size_t budget) {
+        if (_options.maxBytes == 0 || bytes.size() <= _options.maxBytes) {
+            return 0;
+        }
+
+        std::vector<typename MAP_T::const_iterator> entries;
+        entries.reserve(map.size());
+        for (auto it = map.cbegin(); it != map.cend(); it++) {
+            entries.push_back(it);
+        }
+
+        std::vector<bool> dropped;
+        std::size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            // entries removed since the snapshot have no age and go first
+            std::vector<std::pair<TIME_T, std::size_t>> byAge;
+            byAge.reserve(entries.size());
+            for (std::size_t i = 0; i < entries.size(); i++) {
+                auto age = _ageOf.find(entries[i]->first);
+                byAge.emplace_back(age != _ageOf.end() ? age->second->first : TIME_T::min(), i);
+            }
+            std::sort(byAge.begin(), byAge.end());
+            std::vector<std::size_t> oldestFirst;
+            oldestFirst.reserve(byAge.size());
+            for (const auto& entry : byAge) {
+                oldestFirst.push_back(entry.second);
             }
-            _fO.flush();
 
-            // Update the file meta with real size, to exclude lingering data
-            auto rc = truncate(getFullStorePath(), _fO.tellp());
-            if (-1 == rc) {
-                LLOG_VERBOSE("File truncation failed on \"%s\". Errno: %d", getFullStorePath(), errno);
+            count = StoreFormat::chooseDropped(bytes.size(), sizes, oldestFirst, budget, dropped);
+            for (std::size_t i = 0; i < entries.size(); i++) {
+                const K& key = entries[i]->first;
+                if (dropped[i] && CacheBackedStore<K, T>::contains(key) && CacheBackedStore<K, T>::find(key) == entries[i]->second) {
+                    forget(key);
+                    CacheBackedStore<K, T>::erase(key);
+                }
             }
+        }
+        _evictedForBytes += count;
+        StoreFormat::removeRecords(bytes, sizes, dropped);
+
+        LLOG_VERBOSE("Evicted %zu entries from \"%s\" to stay within %zu bytes.", count, _fullPath.c_str(), budget);
+        return count;
+    }
 
+    // callers hold _fileMutex
+    void writeToFile() {
+        SNAPSHOT_T map;
+        {
+            // serialize from a snapshot so store() isn't blocked for the whole write
+            std::lock_guard<std::mutex> lk(CacheBackedStore<K, T>::m);
+            if (!dirtyFlag) {
+                return;
+            }
+            map = CacheBackedStore<K, T>::frozen();
             dirtyFlag = false;
-            lastWriteTime = std::chrono::system_clock::now();
         }
 
+        std::vector<std::size_t> sizes;
+        std::string bytes = encodeImage(*map, sizes);
+        fitToBudget(*map, bytes, sizes, _options.maxBytes);
+
+        try {
+            replaceFile(bytes);
+        } catch (...) {
+            dirtyFlag = true;
+            throw;
+        }
+
+        noteRecordSize(bytes.size(), map->size());
+        lastWriteTime = std::chrono::system_clock::now();
     }
 
 protected:
@@ -269,9 +1332,19 @@ protected:
         }
     }
 
-    void clearBackup() {
-        std::string backupStorePath = std::string(getFullStorePath()) + BACKUP_SUFFIX;
-        std::remove(backupStorePath.c_str());
+    // The one place store bytes reach a descriptor; tests override it to cut writes short.
+    virtual void writeBytes(int fd,
+                            const char* data,
+                            std::size_t length) {
+        _file.writeAll(fd, data, length);
+    }
+
+private:
+    // Overwrites the file with bytes (see StoreFile::replace()); a pending migration is then done.
+    // callers hold _fileMutex
+    void replaceFile(const std::string& bytes) {
+        _file.replace(bytes);
+        finishMigration();
     }
 };
 } // namespace NewRelic
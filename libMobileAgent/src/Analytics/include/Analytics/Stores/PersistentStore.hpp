@@ -8,16 +8,22 @@
 #include <future>
 #include <map>
 #include <chrono>
+#include <vector>
 #include <Analytics/FileBackedStore.hpp>
+#include <Analytics/StoreOptions.hpp>
 
 
 #ifndef LIBMOBILEAGENT_PERSISTENTSTORE_HPP
 #define LIBMOBILEAGENT_PERSISTENTSTORE_HPP
 namespace NewRelic {
-    template<typename K, typename T>
+    template<typename K, typename T, typename Codec = StoreCodec<T>>
     class PersistentStore {
     private:
-        FileBackedStore<K, T> *_wrapper;
+        FileBackedStore<K, T, Codec> *_wrapper = nullptr;
+
+    protected:
+        // for subclasses that keep their own backing stores (see ShardedPersistentStore)
+        PersistentStore() {}
 
     public:
         PersistentStore(std::shared_ptr<T>(*factory)(std::istream &))
@@ -25,16 +31,23 @@ namespace NewRelic {
         }
 
         PersistentStore(const char *filename, const char *sharedPath, std::shared_ptr<T>(*factory)(std::istream &)) {
-            _wrapper = new FileBackedStore<K, T>(filename, sharedPath, factory);
+            _wrapper = new FileBackedStore<K, T, Codec>(filename, sharedPath, factory);
         }
 
         PersistentStore(const char *filename, const char *sharedPath, std::shared_ptr<T>(*factory)(std::istream &), bool(*dataValidator)(K const& k, std::shared_ptr<T> t)) {
-            _wrapper = new FileBackedStore<K, T>(filename, sharedPath, factory, dataValidator);
+            _wrapper = new FileBackedStore<K, T, Codec>(filename, sharedPath, factory, dataValidator);
+        }
+
+        PersistentStore(const char *filename, const char *sharedPath, std::shared_ptr<T>(*factory)(std::istream &), const StoreOptions& options) {
+            _wrapper = new FileBackedStore<K, T, Codec>(filename, sharedPath, factory, options);
+        }
+
+        PersistentStore(const char *filename, const char *sharedPath, std::shared_ptr<T>(*factory)(std::istream &), bool(*dataValidator)(K const& k, std::shared_ptr<T> t), const StoreOptions& options) {
+            _wrapper = new FileBackedStore<K, T, Codec>(filename, sharedPath, factory, dataValidator, options);
         }
 
         PersistentStore(const char *filename, const char *sharedPath) {
-            _wrapper = new FileBackedStore<K, T>(filename, sharedPath);
-            _wrapper->load();
+            _wrapper = new FileBackedStore<K, T, Codec>(filename, sharedPath);
         }
 
         virtual ~PersistentStore() {
@@ -53,6 +66,11 @@ namespace NewRelic {
             _wrapper->remove(key);
         }
 
+        // removes every one of keys in one write rather than one per key
+        virtual void removeAll(const std::vector<K>& keys) {
+            _wrapper->removeAll(keys);
+        }
+
         virtual std::map<K, std::shared_ptr<T>> load() {
             return _wrapper->load();
         }
@@ -65,7 +83,7 @@ namespace NewRelic {
             return _wrapper->get(key);
         }
 
-        const char *getFullStorePath() const {
+        virtual const char *getFullStorePath() const {
             return _wrapper->getFullStorePath();
         }
 
@@ -73,17 +91,33 @@ namespace NewRelic {
             return _wrapper->swap();
         }
 
-        virtual std::map<K, std::shared_ptr<T>> getCache() {
+        // immutable snapshot of the cached values; cheap to take and safe to keep while the store changes
+        virtual std::shared_ptr<const std::map<K, std::shared_ptr<T>>> getCache() {
             return _wrapper->getCache();
         }
 
+        // true once the backing file has been read (immediately, unless StoreOptions::Loading::Background)
+        virtual bool awaitLoaded(unsigned int timeout_ms) {
+            return _wrapper->awaitLoaded(timeout_ms);
+        }
+
+        // entries dropped for each of the StoreOptions capacity limits
+        virtual EvictionCounts getEvictionCounts() const {
+            return _wrapper->getEvictionCounts();
+        }
+
+        // depth and latency of the background writes
+        virtual WorkQueue::Statistics getQueueStatistics() const {
+            return _wrapper->getQueueStatistics();
+        }
+
         //used to wait for persistent store writes to finish (used for testing)
-        void synchronize() {
+        virtual void synchronize() {
             _wrapper->synchronize();
         }
 
         //used to wait for persistent store writes to finish with timeout (returns true if completed, false if timed out)
-        bool synchronize(unsigned int timeout_ms) {
+        virtual bool synchronize(unsigned int timeout_ms) {
             return _wrapper->synchronize(timeout_ms);
         }
     };
@@ -0,0 +1,124 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <Utilities/Util.hpp>
+
+#ifndef LIBMOBILEAGENT_RECORDFORMAT_HPP
+#define LIBMOBILEAGENT_RECORDFORMAT_HPP
+namespace NewRelic {
+    /**
+     * Versioned binary layout for store files.
+     *
+     *  file   := magic "NRSB" | version (u8) | 3 reserved bytes | record*
+     *  record := type (u8) | key length (u32) | value length (u32) | key | value | crc32 (u32)
+     *
+     * Integers are little-endian, the checksum covers everything in the record before it.
+     * Version 1 values are the text operator<< form; version 2 values are written by the store's codec.
+     * A record whose checksum fails is skipped on its own; parsing only stops where the
+     * framing itself is unreadable (e.g. a record torn by a crash at the end of the file).
+     */
+    class RecordFormat {
+    public:
+        static const uint8_t VERSION = 2;
+        static const uint8_t TEXT_VALUES_VERSION = 1;
+        static const std::size_t HEADER_SIZE = 8;
+        static const std::size_t RECORD_OVERHEAD = 1 + 4 + 4 + 4;
+
+        static const char PUT = '+';
+        static const char REMOVE = '-';
+
+        enum class ParseResult {
+            Complete,   // every byte belonged to a well-framed record
+            Truncated   // parsing stopped at an unreadable record
+        };
+
+        // version of the file starting at data, or 0 if it isn't one of ours
+        static uint8_t headerVersion(const char* data, std::size_t length) {
+            if (length < HEADER_SIZE || std::memcmp(data, "NRSB", 4) != 0) {
+                return 0;
+            }
+            const uint8_t version = (uint8_t)data[4];
+            return version >= TEXT_VALUES_VERSION && version <= VERSION ? version : 0;
+        }
+
+        static bool hasHeader(const char* data, std::size_t length) {
+            return headerVersion(data, length) != 0;
+        }
+
+        static void appendHeader(std::string& out) {
+            out.append("NRSB", 4);
+            out.push_back((char)VERSION);
+            out.append(3, '\0');
+        }
+
+        static void appendRecord(std::string& out,
+                                 char type,
+                                 const char* key,
+                                 std::size_t keyLength,
+                                 const char* value,
+                                 std::size_t valueLength) {
+            const std::size_t start = beginRecord(out, type, key, keyLength);
+            out.append(value, valueLength);
+            endRecord(out, start);
+        }
+
+        /*
+         * Writes a record's type and key; the caller then appends the value straight onto out
+         * and passes the returned offset to endRecord(), which fills in the length and checksum.
+         */
+        static std::size_t beginRecord(std::string& out,
+                                       char type,
+                                       const char* key,
+                                       std::size_t keyLength) {
+            const std::size_t start = out.size();
+            out.push_back(type);
+            Util::Bytes::appendUInt32(out, (uint32_t)keyLength);
+            Util::Bytes::appendUInt32(out, 0);
+            out.append(key, keyLength);
+            return start;
+        }
+
+        static void endRecord(std::string& out,
+                              std::size_t start) {
+            const std::size_t keyLength = Util::Bytes::readUInt32(out.data() + start + 1);
+            const uint32_t valueLength = (uint32_t)(out.size() - start - 9 - keyLength);
+            Util::Bytes::writeUInt32(&out[start + 5], valueLength);
+            Util::Bytes::appendUInt32(out, Util::Checksum::crc32(out.data() + start, out.size() - start));
+        }
+
+        /*
+         * Calls onRecord(type, key, keyLength, value, valueLength) for each intact record after the header.
+         * corrupted, when given, counts records skipped for a bad checksum.
+         */
+        static ParseResult parse(const char* data,
+                                 std::size_t length,
+                                 const std::function<void(char, const char*, std::size_t, const char*, std::size_t)>& onRecord,
+                                 std::size_t* corrupted = nullptr) {
+            std::size_t offset = HEADER_SIZE;
+            while (offset < length) {
+                if (length - offset < RECORD_OVERHEAD) {
+                    return ParseResult::Truncated;
+                }
+                const char* record = data + offset;
+                const char type = record[0];
+                const uint32_t keyLength = Util::Bytes::readUInt32(record + 1);
+                const uint32_t valueLength = Util::Bytes::readUInt32(record + 5);
+                const std::size_t bodyLength = 9 + (std::size_t)keyLength + (std::size_t)valueLength;
+                if ((type != PUT && type != REMOVE) || length - offset - 4 < bodyLength) {
+                    return ParseResult::Truncated;
+                }
+                if (Util::Checksum::crc32(record, bodyLength) == Util::Bytes::readUInt32(record + bodyLength)) {
+                    onRecord(type, record + 9, keyLength, record + 9 + keyLength, valueLength);
+                } else if (corrupted != nullptr) {
+                    (*corrupted)++;
+                }
+                offset += bodyLength + 4;
+            }
+            return ParseResult::Complete;
+        }
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_RECORDFORMAT_HPP
@@ -0,0 +1,263 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <Analytics/PersistentStore.hpp>
+#include <Utilities/Util.hpp>
+
+#ifndef LIBMOBILEAGENT_SHARDEDPERSISTENTSTORE_HPP
+#define LIBMOBILEAGENT_SHARDEDPERSISTENTSTORE_HPP
+namespace NewRelic {
+    /**
+     * A PersistentStore split into hash-partitioned shards (see shardIndex()), each a FileBackedStore with its own
+     * cache lock, flush task and file ("<filename>.<n>"). Writers to different keys mostly land on
+     * different shards, so they stop queueing on one cache mutex, and a flush only snapshots
+     * (and copies on write) its own shard.
+     *
+     * Reads that span the store (load(), swap(), getCache()) merge the shards and are O(n).
+     * StoreOptions capacity limits are split evenly across the shards.
+     * An unsharded file left at "<filename>" (or at StoreOptions::legacyFilename) is moved into the
+     * shards on open.
+     */
+    template<typename K, typename T, typename Codec = StoreCodec<T>>
+    class ShardedPersistentStore : public PersistentStore<K, T, Codec> {
+    private:
+        typedef std::map<K, std::shared_ptr<T>> MAP_T;
+        typedef FileBackedStore<K, T, Codec> SHARD_T;
+
+        std::string _fullPath;
+        std::vector<std::unique_ptr<SHARD_T>> _shards;
+
+    public:
+        static const unsigned int DEFAULT_SHARD_COUNT = 8;
+
+        ShardedPersistentStore(const char* filename,
+                               const char* sharedPath,
+                               std::shared_ptr<T>(* factory)(std::istream&),
+                               unsigned int shardCount = DEFAULT_SHARD_COUNT)
+                : ShardedPersistentStore(filename, sharedPath, factory, StoreOptions(), shardCount) {}
+
+        ShardedPersistentStore(const char* filename,
+                               const char* sharedPath,
+                               std::shared_ptr<T>(* factory)(std::istream&),
+                               const StoreOptions& options,
+                               unsigned int shardCount = DEFAULT_SHARD_COUNT)
+                : ShardedPersistentStore(filename, sharedPath, factory, [](K const&, std::shared_ptr<T>) { return true; }, options, shardCount) {}
+
+        ShardedPersistentStore(const char* filename,
+                               const char* sharedPath,
+                               std::shared_ptr<T>(* factory)(std::istream&),
+                               bool(* dataValidator)(K const& k, std::shared_ptr<T> t),
+                               const StoreOptions& options,
+                               unsigned int shardCount = DEFAULT_SHARD_COUNT)
+                : PersistentStore<K, T, Codec>(),
+                  _fullPath(pathOf(filename, sharedPath)) {
+            if (shardCount == 0) {
+                shardCount = 1;
+            }
+            StoreOptions shardOptions = options;
+            shardOptions.maxEntries = divideLimit(options.maxEntries, shardCount);
+            shardOptions.maxBytes = divideLimit(options.maxBytes, shardCount);
+            // one legacy file for the whole store, it's moved in below
+            shardOptions.legacyFilename.clear();
+
+            _shards.reserve(shardCount);
+            for (unsigned int i = 0; i < shardCount; i++) {
+                const std::string shardName = std::string(filename) + "." + std::to_string(i);
+                _shards.emplace_back(new SHARD_T(shardName.c_str(), sharedPath, factory, dataValidator, shardOptions));
+            }
+
+            struct stat info;
+            if (::stat(_fullPath.c_str(), &info) == 0) {
+                migrateUnsharded(filename, sharedPath, factory, dataValidator);
+            }
+            if (!options.legacyFilename.empty() && ::stat(pathOf(options.legacyFilename.c_str(), sharedPath).c_str(), &info) == 0) {
+                migrateUnsharded(options.legacyFilename.c_str(), sharedPath, factory, dataValidator);
+            }
+        }
+
+        virtual ~ShardedPersistentStore() {}
+
+        virtual void clear() {
+            for (auto& shard : _shards) {
+                shard->clear();
+            }
+        }
+
+        virtual void store(K key, std::shared_ptr<T> obj) {
+            shardFor(key).store(key, obj);
+        }
+
+        virtual void remove(K key) {
+            shardFor(key).remove(key);
+        }
+
+        virtual void removeAll(const std::vector<K>& keys) {
+            std::vector<std::vector<K>> byShard(_shards.size());
+            for (const auto& key : keys) {
+                byShard[shardIndex(key)].push_back(key);
+            }
+            for (std::size_t i = 0; i < _shards.size(); i++) {
+                _shards[i]->removeAll(byShard[i]);
+            }
+        }
+
+        virtual std::map<K, std::shared_ptr<T>> load() {
+            MAP_T merged;
+            for (auto& shard : _shards) {
+                MAP_T part = shard->load();
+                merged.insert(part.begin(), part.end());
+            }
+            return merged;
+        }
+
+        virtual void flush() {
+            for (auto& shard : _shards) {
+                shard->flush();
+            }
+        }
+
+        virtual std::shared_ptr<T> get(K key) {
+            return shardFor(key).get(key);
+        }
+
+        virtual const char* getFullStorePath() const {
+            return _fullPath.c_str();
+        }
+
+        virtual std::map<K, std::shared_ptr<T>> swap() {
+            MAP_T merged;
+            for (auto& shard : _shards) {
+                MAP_T part = shard->swap();
+                merged.insert(part.begin(), part.end());
+            }
+            return merged;
+        }
+
+        virtual std::shared_ptr<const std::map<K, std::shared_ptr<T>>> getCache() {
+            auto merged = std::make_shared<MAP_T>();
+            for (auto& shard : _shards) {
+                auto part = shard->getCache();
+                merged->insert(part->begin(), part->end());
+            }
+            return merged;
+        }
+
+        virtual EvictionCounts getEvictionCounts() const {
+            EvictionCounts total;
+            for (const auto& shard : _shards) {
+                EvictionCounts counts = shard->getEvictionCounts();
+                total.entries += counts.entries;
+                total.bytes += counts.bytes;
+                total.age += counts.age;
+            }
+            return total;
+        }
+
+        // summed over the shards; maxDepth is the deepest any one shard's queue got
+        virtual WorkQueue::Statistics getQueueStatistics() const {
+            WorkQueue::Statistics total;
+            for (const auto& shard : _shards) {
+                total.merge(shard->getQueueStatistics());
+            }
+            return total;
+        }
+
+        virtual void synchronize() {
+            for (auto& shard : _shards) {
+                shard->synchronize();
+            }
+        }
+
+        // timeout_ms covers all the shards together
+        virtual bool synchronize(unsigned int timeout_ms) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            for (auto& shard : _shards) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (!shard->synchronize(remaining.count() > 0 ? (unsigned int)remaining.count() : 0)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // timeout_ms covers all the shards together
+        virtual bool awaitLoaded(unsigned int timeout_ms) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            for (auto& shard : _shards) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (!shard->awaitLoaded(remaining.count() > 0 ? (unsigned int)remaining.count() : 0)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        unsigned int getShardCount() const {
+            return (unsigned int)_shards.size();
+        }
+
+    private:
+        // Which shard holds key is persisted in the files, so it mustn't change between builds the
+        // way std::hash may: the CRC-32 of the key (or of its operator<< text) decides.
+        std::size_t shardIndex(const K& key) const {
+            return keyHash(key) % _shards.size();
+        }
+
+        static uint32_t keyHash(const std::string& key) {
+            return Util::Checksum::crc32(key.data(), key.size());
+        }
+
+        template<typename Key>
+        static uint32_t keyHash(const Key& key) {
+            std::ostringstream os;
+            os << key;
+            return keyHash(os.str());
+        }
+
+        SHARD_T& shardFor(const K& key) {
+            return *_shards[shardIndex(key)];
+        }
+
+        static std::size_t divideLimit(std::size_t limit,
+                                       unsigned int shardCount) {
+            return limit == 0 ? 0 : (limit + shardCount - 1) / shardCount;
+        }
+
+        // Moves the entries of a store previously kept in one file into the shards, then deletes it.
+        void migrateUnsharded(const char* filename,
+                              const char* sharedPath,
+                              std::shared_ptr<T>(* factory)(std::istream&),
+                              bool(* dataValidator)(K const& k, std::shared_ptr<T> t)) {
+            const std::string path = pathOf(filename, sharedPath);
+            {
+                SHARD_T unsharded{filename, sharedPath, factory, dataValidator};
+                unsharded.awaitLoaded();
+                if (unsharded.isUnread()) {
+                    // nothing was moved; the next open tries again
+                    LLOG_VERBOSE("Couldn't read \"%s\", it is left to be sharded later.", path.c_str());
+                    return;
+                }
+                auto entries = unsharded.getCache();
+                for (auto it = entries->cbegin(); it != entries->cend(); it++) {
+                    store(it->first, it->second);
+                }
+                synchronize();
+            }
+            if (std::remove(path.c_str()) != 0) {
+                LLOG_VERBOSE("Failed to remove \"%s\" after sharding it.", path.c_str());
+            }
+        }
+
+        static std::string pathOf(const char* filename,
+                                  const char* sharedPath) {
+            return std::string(sharedPath).length() > 0 ? std::string(sharedPath) + "/" + filename : std::string(filename);
+        }
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_SHARDEDPERSISTENTSTORE_HPP
@@ -0,0 +1,73 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <Utilities/BaseValue.hpp>
+#include <Utilities/MappedFile.hpp>
+
+#ifndef LIBMOBILEAGENT_STORECODEC_HPP
+#define LIBMOBILEAGENT_STORECODEC_HPP
+namespace NewRelic {
+    class AnalyticEvent;
+
+    /**
+     * Turns store values into the bytes of a binary record and back (see RecordFormat).
+     *
+     * A codec is built from the store's istream factory and provides
+     *   void encode(const T& value, std::string& out) const;          // append value's bytes to out
+     *   std::shared_ptr<T> decode(const char* data, std::size_t length) const; // throws on bad input
+     *
+     * This default goes through operator<< and the factory. Types on the hot path specialize it
+     * with a direct encoding; text files keep using operator<< / the factory regardless.
+     */
+    template<typename T>
+    class StoreCodec {
+    public:
+        typedef std::shared_ptr<T> (* Factory)(std::istream&);
+
+        explicit StoreCodec(Factory factory) : _factory(factory) {}
+
+        void encode(const T& value, std::string& out) const {
+            std::ostringstream os;
+            os << value;
+            out.append(os.str());
+        }
+
+        std::shared_ptr<T> decode(const char* data, std::size_t length) const {
+            MemoryStreamBuf buffer(data, length);
+            std::istream is(&buffer);
+            return _factory(is);
+        }
+
+    private:
+        Factory _factory;
+    };
+
+    // Value::encode / Value::decode: numbers keep their exact bits, strings are copied as is.
+    template<>
+    class StoreCodec<BaseValue> {
+    public:
+        typedef std::shared_ptr<BaseValue> (* Factory)(std::istream&);
+
+        explicit StoreCodec(Factory) {}
+
+        void encode(const BaseValue& value, std::string& out) const;
+
+        std::shared_ptr<BaseValue> decode(const char* data, std::size_t length) const;
+    };
+
+    // The event's put() header, then timestamp, elapsed time and attributes in binary.
+    template<>
+    class StoreCodec<AnalyticEvent> {
+    public:
+        typedef std::shared_ptr<AnalyticEvent> (* Factory)(std::istream&);
+
+        explicit StoreCodec(Factory) {}
+
+        void encode(const AnalyticEvent& event, std::string& out) const;
+
+        std::shared_ptr<AnalyticEvent> decode(const char* data, std::size_t length) const;
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_STORECODEC_HPP
@@ -0,0 +1,83 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#ifndef LIBMOBILEAGENT_STOREFILE_HPP
+#define LIBMOBILEAGENT_STOREFILE_HPP
+namespace NewRelic {
+    /**
+     * The file behind a FileBackedStore: whole-file replaces, appends, and the backup swap() leaves.
+     *
+     * In place, the file is overwritten / appended to through one unbuffered stream. Atomic, a
+     * replace is written and synced to "<path>.tmp" and renamed over the file, so a crash leaves
+     * either the old or the new file, never a mix; appends are synced before they return.
+     * Not thread safe; the store calls it with its file mutex held.
+     */
+    class StoreFile {
+    public:
+        // writes all of data to fd or throws; the store passes its own so tests can cut writes short
+        typedef std::function<void(int fd, const char* data, std::size_t length)> Writer;
+
+        static const char* const BACKUP_SUFFIX;
+        static const char* const TEMP_SUFFIX;
+
+        StoreFile(std::string path,
+                  bool atomic,
+                  Writer writer);
+
+        const std::string& path() const {
+            return _path;
+        }
+
+        // size of the file as last loaded or written
+        std::size_t size() const {
+            return _size;
+        }
+
+        void setSize(std::size_t size) {
+            _size = size;
+        }
+
+        // throws std::runtime_error / std::system_error
+        void replace(const std::string& bytes);
+
+        // throws std::runtime_error / std::system_error
+        void append(const std::string& bytes);
+
+        // empties the file (creating it if need be)
+        void truncate();
+
+        // Moves the file to "<path>.bak" and starts an empty one; false if the rename failed.
+        bool moveToBackup();
+
+        void removeBackup();
+
+        // left behind by a replace that never got to its rename
+        void removeTemp();
+
+        void close();
+
+        // the default Writer: loops over short writes and EINTR
+        void writeAll(int fd,
+                      const char* data,
+                      std::size_t length) const;
+
+    private:
+        static void syncData(int fd);
+
+        // makes a rename durable
+        void syncDirectory() const;
+
+        void openStream(std::ios::openmode mode);
+
+        std::string _path;
+        bool _atomic;
+        Writer _writer;
+        std::ofstream _out;
+        std::size_t _size = 0;
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_STOREFILE_HPP
@@ -0,0 +1,64 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef LIBMOBILEAGENT_STOREFORMAT_HPP
+#define LIBMOBILEAGENT_STOREFORMAT_HPP
+namespace NewRelic {
+    /**
+     * The parts of a store file's layout that don't depend on what the store holds: the framing of
+     * the text formats, and trimming an encoded file to a byte budget. The binary layout is RecordFormat.
+     *
+     *  legacy text   := { key '\n' value '\n' }*
+     *  text journal  := JOURNAL_HEADER '\n' { PUT key '\n' value '\n' | REMOVE key '\n' }*
+     *
+     * Keys and values are the operator<< text of the store's types; decoding them is the caller's.
+     */
+    class StoreFormat {
+    public:
+        static const char* const JOURNAL_HEADER;
+
+        // Offset of the first record if data starts with the JOURNAL_HEADER line, otherwise 0.
+        static std::size_t journalStart(const char* data,
+                                        std::size_t length);
+
+        /*
+         * Calls onRecord(type, key, keyLength, value, valueLength) for each text journal record from
+         * offset (see journalStart()) in order; a remove has an empty value. A record that fails to
+         * parse (e.g. torn by a crash mid-append), or that onRecord throws for, ends the replay:
+         * everything before it is a consistent earlier state. Returns false if it ended that way.
+         */
+        static bool readJournal(const char* data,
+                                std::size_t length,
+                                std::size_t offset,
+                                const std::function<void(char, const char*, std::size_t, const char*, std::size_t)>& onRecord);
+
+        // Calls onPair(key, keyLength, value, valueLength) for each legacy key / value line pair; a key
+        // on the last line gets an empty value.
+        static void readPairs(const char* data,
+                              std::size_t length,
+                              const std::function<void(const char*, std::size_t, const char*, std::size_t)>& onPair);
+
+        /*
+         * For a file of size bytes whose records take sizes[i] bytes each: marks records in dropped,
+         * in the order of oldestFirst, until what is left fits in budget. Returns how many it marked.
+         */
+        static std::size_t chooseDropped(std::size_t size,
+                                         const std::vector<std::size_t>& sizes,
+                                         const std::vector<std::size_t>& oldestFirst,
+                                         std::size_t budget,
+                                         std::vector<bool>& dropped);
+
+        // Cuts the dropped records out of bytes, whose last sizes[0] + ... bytes are the records in order.
+        static void removeRecords(std::string& bytes,
+                                  const std::vector<std::size_t>& sizes,
+                                  const std::vector<bool>& dropped);
+
+    private:
+        StoreFormat() {}
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_STOREFORMAT_HPP
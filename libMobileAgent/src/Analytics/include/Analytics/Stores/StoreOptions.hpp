@@ -0,0 +1,80 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifndef LIBMOBILEAGENT_STOREOPTIONS_HPP
+#define LIBMOBILEAGENT_STOREOPTIONS_HPP
+namespace NewRelic {
+    /**
+     * Per-store tuning for FileBackedStore / PersistentStore.
+     * The defaults reproduce the original behavior (rewrite the whole file on every flush).
+     */
+    struct StoreOptions {
+        enum class WriteMode {
+            Rewrite, // serialize the entire cache over the file on each flush
+            Journal  // append put/remove records, compact once enough of them are stale
+        };
+
+        enum class Durability {
+            InPlace,      // overwrite / append to the live file
+            AtomicReplace // full writes go to a synced temp file renamed over the live one,
+                          // appends are synced once per flush
+        };
+
+        enum class Loading {
+            Blocking,  // the constructor reads the whole file before returning
+            Background // the file is read on the store's queue; the cache fills in batches meanwhile
+                       // and awaitLoaded() reports when it's done
+        };
+
+        enum class Format {
+            Text,  // newline separated key / operator<< value pairs
+            Binary // length prefixed, checksummed records (see RecordFormat)
+        };
+
+        WriteMode writeMode = WriteMode::Rewrite;
+        // files written in the other format are still read, and rewritten in this one on open
+        Format format = Format::Text;
+        Durability durability = Durability::InPlace;
+        // The file, in the store's directory, an older release kept this store in. While the
+        // store's own file doesn't exist, that one is read instead; once its contents are written
+        // under the store's name it's removed.
+        std::string legacyFilename;
+        Loading loading = Loading::Blocking;
+
+        // Journal mode: compact when stale (overwritten or removed) records make up
+        // at least this fraction of the file...
+        double compactionThreshold = 0.5;
+        // ...and the file holds at least this many records.
+        unsigned int compactionMinRecords = 64;
+
+        // Capacity limits, 0 meaning unbounded. Past a limit the oldest entries (by last store(),
+        // or by the file's modification time for entries loaded from disk) are evicted.
+        // maxEntries and maxAge are enforced on store(), maxBytes whenever the file is written:
+        // the file never grows past it.
+        std::size_t maxEntries = 0;
+        std::size_t maxBytes = 0;
+        std::chrono::milliseconds maxAge{0};
+
+        // Flush triggers, 0 meaning unused. A queued flush writes once flushRecords store()/remove()
+        // calls or about flushBytes of records are pending, or once no write has come for flushIdle,
+        // and at the latest flushMaxDelay after it was queued. A burst of writes then costs one
+        // write to disk. With none of the first three set, a flush follows the previous one by
+        // FileBackedStore::writeThrottle().
+        std::size_t flushRecords = 0;
+        std::size_t flushBytes = 0;
+        std::chrono::milliseconds flushIdle{0};
+        std::chrono::milliseconds flushMaxDelay{1000};
+    };
+
+    // Entries a store has evicted for each limit since it was opened.
+    struct EvictionCounts {
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+        uint64_t age = 0;
+    };
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_STOREOPTIONS_HPP
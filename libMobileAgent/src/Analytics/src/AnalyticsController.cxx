@@ -10,9 +10,24 @@ namespace NewRelic {
     static const unsigned int MAX_NAME_LEN = 256;
     static const unsigned int MAX_VALUE_SIZE_BYTES = 4096;
 
-    const char *AnalyticsController::ATTRIBUTE_STORE_DB_FILENAME = "persistentAttributeStore.txt";
-    const char *AnalyticsController::ATTRIBUTE_DUP_STORE_DB_FILENAME = "attributeDupStore.txt";
-    const char *AnalyticsController::EVENT_DUP_STORE_DB_FILENAME = "eventsDupStore.txt";
+    // binary stores get names of their own, so a release that only reads text never opens one
+    const char *AnalyticsController::ATTRIBUTE_STORE_DB_FILENAME = "persistentAttributeStore.bin";
+    const char *AnalyticsController::ATTRIBUTE_DUP_STORE_DB_FILENAME = "attributeDupStore.bin";
+    const char *AnalyticsController::EVENT_DUP_STORE_DB_FILENAME = "eventsDupStore.bin";
+    const char *AnalyticsController::ATTRIBUTE_STORE_DB_LEGACY_FILENAME = "persistentAttributeStore.txt";
+    const char *AnalyticsController::ATTRIBUTE_DUP_STORE_DB_LEGACY_FILENAME = "attributeDupStore.txt";
+    const char *AnalyticsController::EVENT_DUP_STORE_DB_LEGACY_FILENAME = "eventsDupStore.txt";
+
+    // the attribute store's text file from an older release is converted on first open, then removed
+    static StoreOptions binaryStoreOptions(const char *legacyFilename) {
+        StoreOptions options;
+        options.format = StoreOptions::Format::Binary;
+        options.legacyFilename = legacyFilename;
+        // incrementSessionAttribute() in a loop is one write once the loop stops, not one per throttle window
+        options.flushIdle = std::chrono::milliseconds(50);
+        options.flushRecords = 512;
+        return options;
+    }
 
 
     //only allow alphanumeric, _ (covered in \w), colon, and spaces.
@@ -51,6 +66,10 @@ namespace NewRelic {
         return _eventManager.getEventsEvictedCount();
     }
 
+    std::map<std::string, EventTypeCounts> AnalyticsController::getEventTypeCounts() const {
+        return _eventManager.getEventTypeCounts();
+    }
+
     unsigned long long int AnalyticsController::getCurrentTime_ms() { //throws std::logic_error
         long long epoch_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::system_clock().now().time_since_epoch()).count();
@@ -156,7 +175,8 @@ namespace NewRelic {
                     }),
             _attributeDuplicationStore(attributeDupStore),
             _attributeStore(ATTRIBUTE_STORE_DB_FILENAME, sharedPath,
-                            (std::shared_ptr<BaseValue>(*)(std::istream & )) & Value::createValue),
+                            (std::shared_ptr<BaseValue>(*)(std::istream & )) & Value::createValue,
+                            binaryStoreOptions(ATTRIBUTE_STORE_DB_LEGACY_FILENAME)),
             _eventsDuplicationStore(eventDupStore),
             _eventManager(_eventsDuplicationStore),
             _sessionAttributeManager(_attributeStore,
@@ -943,23 +963,34 @@ namespace NewRelic {
     }
 
 
+    std::vector <std::shared_ptr<AnalyticEvent>> AnalyticsController::takeHarvest(bool clearEvents) {
+        std::vector <std::shared_ptr<AnalyticEvent>> harvested;
+        {
+            std::unique_lock <std::shared_timed_mutex> eventLock(_eventManager._eventsMutex);
+            //events staged after the merge belong to the next harvest
+            _eventManager.mergeStaged();
+            if (!clearEvents) {
+                return _eventManager._events;
+            }
+            harvested = _eventManager.detachMerged();
+        }
+        //only the harvested events' records go, in one write; events staged since the merge keep theirs.
+        //keys are unique to an event, so this needn't hold recording off.
+        _eventsDuplicationStore.removeAll(EventManager::keysOf(harvested));
+        return harvested;
+    }
+
     std::shared_ptr <NRJSON::JsonArray> AnalyticsController::getEventsJSON(bool clearEvents) {
-        std::unique_lock <std::recursive_mutex> eventLock(_eventManager._eventsMutex, std::defer_lock);
-        eventLock.lock();
-        auto json = _eventManager.toJSON();
+        return EventManager::toJSON(takeHarvest(clearEvents));
+    }
 
-        if (clearEvents) {
-            _eventManager.empty();
-            _eventsDuplicationStore.clear();
-        }
-        return json;
+    void AnalyticsController::writeEventsJSON(std::ostream& os, bool clearEvents) {
+        EventManager::writeJSON(os, takeHarvest(clearEvents));
     }
 
     std::shared_ptr <NRJSON::JsonObject> AnalyticsController::getSessionAttributeJSON() const {
-        std::unique_lock <std::recursive_mutex> attributeLock(_sessionAttributeManager._attributesLock,
-                                                              std::defer_lock);
-        attributeLock.lock();
-
+        //generateJSONObject() snapshots the attributes under a shared lock and builds the JSON outside it;
+        //the snapshot's attributes are replaced, never changed, by later writes
         std::shared_ptr <NRJSON::JsonObject> json;
         try {
             json = _sessionAttributeManager.generateJSONObject();
@@ -1040,4 +1071,12 @@ namespace NewRelic {
         return EVENT_DUP_STORE_DB_FILENAME;
     }
 
+    const char *AnalyticsController::getAttributeDupStoreLegacyName() {
+        return ATTRIBUTE_DUP_STORE_DB_LEGACY_FILENAME;
+    }
+
+    const char *AnalyticsController::getEventDupStoreLegacyName() {
+        return EVENT_DUP_STORE_DB_LEGACY_FILENAME;
+    }
+
 }
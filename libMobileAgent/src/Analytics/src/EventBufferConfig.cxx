@@ -28,4 +28,26 @@ unsigned int EventBufferConfig::get_max_buffer_time_sec() const {
 unsigned int EventBufferConfig::get_max_buffer_size() const {
     return _max_buffer_size;
 }
+
+void EventBufferConfig::setEventTypePolicy(const std::string& eventType, EventTypePolicy policy) {
+    std::lock_guard<std::mutex> lock(_policiesMutex);
+    _policies[eventType] = policy;
+    _policiesVersion++;
+}
+
+void EventBufferConfig::clearEventTypePolicies() {
+    std::lock_guard<std::mutex> lock(_policiesMutex);
+    _policies.clear();
+    _policiesVersion++;
+}
+
+EventTypePolicy EventBufferConfig::getEventTypePolicy(const std::string& eventType) const {
+    std::lock_guard<std::mutex> lock(_policiesMutex);
+    auto it = _policies.find(eventType);
+    return it != _policies.end() ? it->second : EventTypePolicy();
+}
+
+unsigned int EventBufferConfig::getEventTypePoliciesVersion() const {
+    return _policiesVersion;
+}
 }
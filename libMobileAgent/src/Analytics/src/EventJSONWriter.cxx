@@ -0,0 +1,138 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Analytics/EventJSONWriter.hpp"
+#include <Analytics/AnalyticEvent.hpp>
+#include <Utilities/Number.hpp>
+#include <Utilities/String.hpp>
+#include <Utilities/Boolean.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace NewRelic {
+    EventJSONWriter::EventJSONWriter(std::ostream& os) : _os(os) {}
+
+    void EventJSONWriter::write(const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+        _os << "[\n";
+        for (auto it = events.cbegin(); it != events.cend(); it++) {
+            if (it != events.cbegin()) {
+                _os << ",\n";
+            }
+            write(**it);
+        }
+        if (!events.empty()) {
+            _os << '\n';
+        }
+        _os << "]";
+    }
+
+    void EventJSONWriter::write(const AnalyticEvent& event) {
+        _fields.clear();
+        event.addJSONFields(*this);
+        // fields come in small numbers; the attributes are already a sorted map
+        std::sort(_fields.begin(), _fields.end(), [](const Field& lhs, const Field& rhs) {
+            return std::strcmp(lhs.name, rhs.name) < 0;
+        });
+
+        _os << "{\n";
+        _firstKey = true;
+        auto field = _fields.cbegin();
+        auto attribute = event._attributes.cbegin();
+        while (field != _fields.cend() || attribute != event._attributes.cend()) {
+            int order = field == _fields.cend() ? 1
+                      : attribute == event._attributes.cend() ? -1
+                      : std::strcmp(field->name, attribute->first.c_str());
+            if (order == 0) {
+                // the same key twice: the DOM kept whichever was set last
+                if (field->attributesOverride) {
+                    field++;
+                    order = 1;
+                } else {
+                    attribute++;
+                    order = -1;
+                }
+            }
+            if (order < 0) {
+                writeField(*field++);
+            } else {
+                writeAttribute(attribute->first, *attribute->second->getValue());
+                attribute++;
+            }
+        }
+        if (!_firstKey) {
+            _os << '\n';
+        }
+        _os << "}";
+    }
+
+    void EventJSONWriter::writeKey(const char* name) {
+        _os << (_firstKey ? "" : ",\n") << '"';
+        writeString(name);
+        _os << "\": ";
+        _firstKey = false;
+    }
+
+    void EventJSONWriter::writeField(const Field& field) {
+        writeKey(field.name);
+        if (field.string != nullptr) {
+            _os << '"';
+            writeString(field.string->c_str());
+            _os << '"';
+        } else {
+            writeNumber(field.number);
+        }
+    }
+
+    // as AnalyticEvent::generateJSONObject() converts attribute values
+    void EventJSONWriter::writeAttribute(const std::string& name, const BaseValue& value) {
+        switch (value.getCategory()) {
+            case BaseValue::Category::STRING:
+                writeKey(name.c_str());
+                _os << '"';
+                writeString(static_cast<const String&>(value).getValue().c_str());
+                _os << '"';
+                break;
+            case BaseValue::Category::NUMBER:
+                writeKey(name.c_str());
+                switch (static_cast<const Number&>(value).getTag()) {
+                    case Number::Tag::U_LONG: // json only handles long longs.
+                    case Number::Tag::LONG:
+                        _os << static_cast<const Number&>(value).longLongValue();
+                        break;
+                    case Number::Tag::DOUBLE:
+                        writeNumber(static_cast<const Number&>(value).doubleValue());
+                        break;
+                }
+                break;
+            case BaseValue::Category::BOOLEAN:
+                writeKey(name.c_str());
+                _os << (static_cast<const Boolean&>(value).getValue() ? "true" : "false");
+                break;
+        }
+    }
+
+    void EventJSONWriter::addField(const char* name, const std::string& value, bool attributesOverride) {
+        _fields.push_back(Field{name, &value, 0, attributesOverride});
+    }
+
+    void EventJSONWriter::addField(const char* name, double value, bool attributesOverride) {
+        _fields.push_back(Field{name, nullptr, value, attributesOverride});
+    }
+
+    // backslashes and quotes, as JsonObject::escapeJsonControlCharacters() escapes them
+    void EventJSONWriter::writeString(const char* s) {
+        const char* run = s;
+        for (; *s != '\0'; s++) {
+            if (*s == '\\' || *s == '"') {
+                _os.write(run, s - run);
+                _os << '\\' << *s;
+                run = s + 1;
+            }
+        }
+        _os.write(run, s - run);
+    }
+
+    void EventJSONWriter::writeNumber(double value) {
+        _os << std::setprecision(15) << (long double)value;
+    }
+}
@@ -5,11 +5,16 @@
 #include <iostream>
 #include "Analytics/EventManager.hpp"
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <thread>
 #include "NetworkErrorEvent.hpp"
 #include "RequestEvent.hpp"
 #include "Utilities/Util.hpp"
 #include "Analytics/EventDeserializer.hpp"
 #include "Analytics/EventBufferConfig.hpp"
+#include "Analytics/EventJSONWriter.hpp"
 
 static const int kBufferTimeSecondsLeeway = 60; // 60 seconds
 
@@ -43,65 +48,338 @@ void EventManager::setMaxBufferSize(unsigned int size) {
 
 void EventManager::empty() {
 
-    std::unique_lock<std::recursive_mutex> lock1(this->_eventsMutex, std::defer_lock);
-    lock1.lock();
+    std::unique_lock<std::shared_timed_mutex> lock1(this->_eventsMutex);
+    mergeStaged();
+    discardMerged();
+}
+
+void EventManager::discardMerged() {
+    _buffered -= _events.size();
+    released();
+    //only the discarded events' records, in one write: events staged since the merge keep theirs
+    _eventDuplicationStore.removeAll(keysOf(_events));
     _events.clear();
-    _eventDuplicationStore.clear();
     //we're empty so let's reset the total number of attempted inserts.
     _total_attempted_inserts = 0;
 }
 
+std::vector<std::string> EventManager::keysOf(const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+    std::vector<std::string> keys;
+    keys.reserve(events.size());
+    for (auto& event : events) {
+        keys.push_back(EventManager::createKey(event));
+    }
+    return keys;
+}
+
+std::vector<std::shared_ptr<AnalyticEvent>> EventManager::detachMerged() {
+    //recording carries on into an empty buffer of the same capacity, so it doesn't regrow it under the lock
+    std::vector<std::shared_ptr<AnalyticEvent>> detached;
+    detached.reserve(_events.capacity());
+    released();
+    _events.swap(detached);
+    _buffered -= detached.size();
+    _total_attempted_inserts = 0;
+    return detached;
+}
+
+void EventManager::mergeStaged() {
+    for (auto& slot : _staging) {
+        std::lock_guard<std::mutex> slotLock(slot.mutex);
+        for (auto& admitted : slot.events) {
+            _events.push_back(std::move(admitted.event));
+            place(_events.size() - 1, *admitted.type, admitted.neverEvict);
+        }
+        slot.events.clear();
+    }
+}
+
+void EventManager::stage(Admitted admitted) {
+    static std::atomic<std::size_t> nextSlot{0};
+    static thread_local const std::size_t slotIndex = nextSlot++ % STAGING_SLOTS;
+    StagingSlot& slot = _staging[slotIndex];
+    //recorded before it is staged, so no merge (or the harvest removing its record) can see it first;
+    //a crash before the next merge still finds the event in the duplication store
+    _eventDuplicationStore.store(EventManager::createKey(admitted.event), admitted.event);
+    bool batchFull;
+    {
+        std::lock_guard<std::mutex> slotLock(slot.mutex);
+        slot.events.push_back(std::move(admitted));
+        batchFull = slot.events.size() >= STAGING_BATCH_SIZE;
+    }
+    if (batchFull) {
+        //if someone holds the buffer (usually a harvest) they merge it; don't wait for them
+        std::unique_lock<std::shared_timed_mutex> lock1(this->_eventsMutex, std::try_to_lock);
+        if (lock1.owns_lock()) {
+            mergeStaged();
+        }
+    }
+}
+
 void EventManager::resetTimestamp() {
     _oldest_event_timestamp_ms = 0;
 }
 
-    std::string EventManager::createKey(std::shared_ptr<AnalyticEvent> event) {
-        std::stringstream ss;
-        ss << *event;
-        std::string s{ss.str()};
+//what an event can't change after creation: its type, timestamp and elapsed time. The elapsed time
+//goes in as the 15 digits a text store keeps of it (see operator<<), so a reloaded event matches too
+static uint32_t eventFingerprint(const AnalyticEvent& event,
+                                 unsigned long long timestamp_epoch_millis,
+                                 double session_elapsed_time_sec) {
+    std::string bytes{event.getEventType()};
+    Util::Bytes::appendUInt64(bytes, timestamp_epoch_millis);
+    char elapsed[32];
+    int length = std::snprintf(elapsed, sizeof(elapsed), "%.15g", session_elapsed_time_sec);
+    bytes.append(elapsed, length > 0 ? std::min((std::size_t)length, sizeof(elapsed) - 1) : 0);
+    return Util::Checksum::crc32(bytes.data(), bytes.size());
+}
+
+//the event's id (16 hex digits) then its fingerprint (8); nothing is serialized
+std::string EventManager::createKey(std::shared_ptr<AnalyticEvent> event) {
+    static const char digits[] = "0123456789abcdef";
+    std::string key(KEY_LENGTH, '0');
+    uint64_t id = event->getId();
+    uint32_t fingerprint = eventFingerprint(*event, event->_timestamp_epoch_millis, event->_session_elapsed_time_sec);
+    for (std::size_t i = 16; i-- > 0; id >>= 4) {
+        key[i] = digits[id & 0xF];
+    }
+    for (std::size_t i = KEY_LENGTH; i-- > 16; fingerprint >>= 4) {
+        key[i] = digits[fingerprint & 0xF];
+    }
+    return key;
+}
+
+static bool isIdKey(std::string const& key) {
+    return key.size() == EventManager::KEY_LENGTH &&
+           std::all_of(key.begin(), key.end(), [](char c) { return std::isdigit((unsigned char)c) || (c >= 'a' && c <= 'f'); });
+}
+
+/*
+ * A reloaded event is checked against the fingerprint half of its key, which catches a value that
+ * decoded into some other event. Stores written before events had ids are keyed by the
+ * whitespace-stripped serialization, which is still compared in full.
+ */
+bool EventManager::isValidKey(std::string const& key, std::shared_ptr<AnalyticEvent> event) {
+    if (event == nullptr) {
+        return false;
+    }
+    if (isIdKey(key)) {
+        return std::stoul(key.substr(16), nullptr, 16) == eventFingerprint(*event, event->_timestamp_epoch_millis, event->_session_elapsed_time_sec);
+    }
+    std::stringstream ss;
+    ss << *event;
+    std::string s{ss.str()};
+
+    for(auto it = std::remove_if(s.begin(),s.end(),&isspace); it != s.end() ; s.erase(it));
+    return key == s;
+}
+
+//ids aren't serialized with the event; the key it was stored under has it, so createKey() finds that record again
+bool EventManager::adoptKey(std::string const& key, std::shared_ptr<AnalyticEvent> event) {
+    if (!isValidKey(key, event)) {
+        return false;
+    }
+    if (isIdKey(key)) {
+        event->_id = std::stoull(key.substr(0, 16), nullptr, 16);
+    }
+    return true;
+}
+
+EventManager::TypeState& EventManager::typeState(const std::string& eventType) {
+    TypeState* state = nullptr;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(_typesMutex);
+        auto it = _types.find(eventType);
+        if (it != _types.end()) {
+            state = it->second.get();
+        }
+    }
+    if (state == nullptr) {
+        std::unique_lock<std::shared_timed_mutex> lock(_typesMutex);
+        auto& entry = _types[eventType];
+        if (entry == nullptr) {
+            entry.reset(new TypeState());
+        }
+        state = entry.get();
+    }
+
+    const unsigned int version = EventBufferConfig::getInstance().getEventTypePoliciesVersion();
+    if (state->policyVersion != version) {
+        auto policy = EventBufferConfig::getInstance().getEventTypePolicy(eventType);
+        state->quota = policy.quota;
+        state->neverEvict = policy.retention == EventRetention::NeverEvict;
+        state->policyVersion = version;
+    }
+    return *state;
+}
+
+bool EventManager::reserve(TypeState& type, std::size_t maxBufferSize, bool& wasEmpty) {
+    const unsigned int quota = type.quota;
+    std::size_t typed = type.buffered.load();
+    do {
+        if (quota != 0 && typed >= quota) {
+            return false;
+        }
+    } while (!type.buffered.compare_exchange_weak(typed, typed + 1));
+
+    std::size_t buffered = _buffered.load();
+    do {
+        if (buffered >= maxBufferSize) {
+            type.buffered--;
+            return false;
+        }
+    } while (!_buffered.compare_exchange_weak(buffered, buffered + 1));
+    wasEmpty = buffered == 0;
+    return true;
+}
+
+/*
+ * The index in _events of the event a newcomer replaces, or _events.size() to turn the newcomer away:
+ *  - a type at its quota only competes with itself, through a reservoir over the type's own offers
+ *  - a never-evict event takes the place of a sampled one picked at random
+ *  - anything else goes through the reservoir over every offer, and loses to a never-evict event
+ */
+std::size_t EventManager::findVictim(TypeState& type, bool neverEvict) {
+    const std::size_t none = _events.size();
+    const unsigned int quota = type.quota;
+
+    if (quota != 0 && type.buffered >= quota) {
+        const uint64_t attempted = type.attempted;
+        if (neverEvict || attempted == 0) {
+            return none;
+        }
+        uint64_t nth = uniformRandom(attempted);
+        return nth < type.slots.size() ? type.slots[nth] : none;
+    }
+
+    if (neverEvict) {
+        return _evictable.empty() ? none : _evictable[uniformRandom(_evictable.size())];
+    }
+
+    //reservoir sampling (Algorithm R): the new event takes a random slot with probability
+    //max buffer size / attempted inserts, so every event offered is equally likely to be kept.
+    auto index = getRemovalIndex();
+    if (index < _events.size() && _slots[index].evictablePosition != NOT_EVICTABLE) {
+        return index;
+    }
+    // else: the random removal index landed outside the queue's current bounds --
+    // drop the incoming event instead of silently losing it (matches the Android
+    // agent's handling of the equivalent case).
+    return none;
+}
 
-        for(auto it = std::remove_if(s.begin(),s.end(),&isspace); it != s.end() ; s.erase(it));
-        return s;
+void EventManager::place(std::size_t index, TypeState& type, bool neverEvict) {
+    if (index == _slots.size()) {
+        _slots.emplace_back();
     }
+    SlotInfo& slot = _slots[index];
+    slot.type = &type;
+    slot.typePosition = (uint32_t)type.slots.size();
+    type.slots.push_back((uint32_t)index);
+    if (neverEvict) {
+        slot.evictablePosition = NOT_EVICTABLE;
+    } else {
+        slot.evictablePosition = (uint32_t)_evictable.size();
+        _evictable.push_back((uint32_t)index);
+    }
+}
+
+//takes the slot out of its type's list and _evictable; the last entry of each fills the gap
+void EventManager::unplace(std::size_t index) {
+    const SlotInfo slot = _slots[index];
+    auto& typeSlots = slot.type->slots;
+    typeSlots[slot.typePosition] = typeSlots.back();
+    _slots[typeSlots.back()].typePosition = slot.typePosition;
+    typeSlots.pop_back();
+    if (slot.evictablePosition != NOT_EVICTABLE) {
+        _evictable[slot.evictablePosition] = _evictable.back();
+        _slots[_evictable.back()].evictablePosition = slot.evictablePosition;
+        _evictable.pop_back();
+    }
+}
+
+void EventManager::released() {
+    for (auto& slot : _slots) {
+        slot.type->buffered--;
+    }
+    _slots.clear();
+    _evictable.clear();
+    std::shared_lock<std::shared_timed_mutex> lock(_typesMutex);
+    for (auto& type : _types) {
+        type.second->slots.clear();
+        //places claimed but not staged yet stay counted, so attempted never drops below buffered
+        type.second->attempted = type.second->buffered.load();
+    }
+}
+
+std::map<std::string, EventTypeCounts> EventManager::getEventTypeCounts() const {
+    std::map<std::string, EventTypeCounts> counts;
+    std::shared_lock<std::shared_timed_mutex> lock(_typesMutex);
+    for (auto& type : _types) {
+        counts[type.first] = EventTypeCounts{type.second->recorded, type.second->evicted};
+    }
+    return counts;
+}
 
 EventAddResult EventManager::addEvent(std::shared_ptr<AnalyticEvent> event) {
-    std::unique_lock<std::recursive_mutex> lock1(this->_eventsMutex, std::defer_lock);
-    lock1.lock();
     EventAddResult result;
     if (event == nullptr) {
         return result;
     }
-    if (_events.size() >= EventBufferConfig::getInstance().get_max_buffer_size()) {
+
+    TypeState& type = typeState(event->getEventType());
+    const bool neverEvict = event->getRetention() == EventRetention::NeverEvict || type.neverEvict;
+    type.attempted++;
+
+    //while the buffer and the type's quota have room, claim a place and stage the event without taking _eventsMutex
+    const std::size_t maxBufferSize = EventBufferConfig::getInstance().get_max_buffer_size();
+    bool wasEmpty = false;
+    if (reserve(type, maxBufferSize, wasEmpty)) {
+        if (wasEmpty) {
+            //first event in an empty buffer is the oldest one.
+            _oldest_event_timestamp_ms = event->_timestamp_epoch_millis;
+        }
+        stage(Admitted{std::move(event), &type, neverEvict});
+        _total_attempted_inserts++;
+        result.added = true;
+        _events_recorded++;
+        type.recorded++;
+        return result;
+    }
+
+    //the buffer or the type's quota is full: the event has to displace another or be turned away
+    std::unique_lock<std::shared_timed_mutex> lock1(this->_eventsMutex);
+    mergeStaged();
+    //a harvest may have made room since; events other threads have made room for count as buffered
+    if (!reserve(type, maxBufferSize, wasEmpty)) {
         result.overflowed = true;
-        //throw away something...
-        int index = getRemovalIndex();
-        //concern if the total number of inserts exceeds RAND_MAX (guaranteed to be at least ~32,000, but could be 2,147,483,647) this will become crappy, index will always = 1;
-        //todo: this would be a good spot for agent health / recover
+        auto index = findVictim(type, neverEvict);
         if (index < _events.size()) {
-            //iterator the event to remove
-            auto eventIterator = _events.begin() + index;
+            auto& slot = _events[index];
+            TypeState& victimType = *_slots[index].type;
+            victimType.buffered--;
+            victimType.evicted++;
+            unplace(index);
             //remove it from the duplication store
-            std::stringstream deleteKey;
-            deleteKey << *eventIterator;
-            _eventDuplicationStore.remove(deleteKey.str());
-            //remove it from the vector
-            _events.erase(eventIterator);
-            //add new event to the vector
-            _events.push_back(event);
+            _eventDuplicationStore.remove(EventManager::createKey(slot));
+            //replace it in place
+            slot = event;
+            place(index, type, neverEvict);
+            type.buffered++;
             //insert new event into the duplication store
             _eventDuplicationStore.store(EventManager::createKey(event), event);
             result.added = true;
             _events_recorded++;
+            type.recorded++;
+        } else {
+            type.evicted++;
         }
-        // else: the random removal index landed outside the queue's current bounds --
-        // drop the incoming event instead of silently losing it (matches the Android
-        // agent's handling of the equivalent case).
         result.evicted = true;
         _events_evicted++;
     } else {
         //buffer size limit not reached
         //simply add new event to vector
         _events.push_back(event);
+        place(_events.size() - 1, type, neverEvict);
         //and to duplication store.
         _eventDuplicationStore.store(EventManager::createKey(event), event);
         if (_events.size() == 1) {
@@ -110,18 +388,49 @@ EventAddResult EventManager::addEvent(std::shared_ptr<AnalyticEvent> event) {
         }
         result.added = true;
         _events_recorded++;
+        type.recorded++;
     }
     //increment the total attempted inserts.
     _total_attempted_inserts++;
     return result;
 }
 
-int EventManager::getRemovalIndex() {
-    if (_total_attempted_inserts > 0) {
-        return rand() % _total_attempted_inserts;
-    } else {
+uint64_t EventManager::getRemovalIndex() {
+    //uniform over every insert attempted so far, this one included
+    return uniformRandom(_total_attempted_inserts + 1);
+}
+
+// splitmix64, one generator per thread: no shared state, and unlike rand() its range covers
+// any attempted insert count.
+static uint64_t& randomState() {
+    static thread_local uint64_t state = std::random_device{}() ^
+                                         ((uint64_t)std::random_device{}() << 32) ^
+                                         (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    return state;
+}
+
+void EventManager::seedRandom(uint64_t seed) {
+    randomState() = seed;
+}
+
+uint64_t EventManager::uniformRandom(uint64_t bound) {
+    uint64_t& state = randomState();
+    auto next = [&state] {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    if (bound == 0) {
         return 0;
     }
+    //reject the top sliver of the range that doesn't divide evenly by bound
+    const uint64_t limit = UINT64_MAX - (UINT64_MAX % bound);
+    uint64_t value;
+    do {
+        value = next();
+    } while (value >= limit);
+    return value % bound;
 }
 
 void EventManager::setMaxBufferTime(unsigned int seconds) {
@@ -228,10 +537,28 @@ std::shared_ptr<CustomEvent> EventManager::newCustomEvent(const char* eventType,
 }
 
 
+std::vector<std::shared_ptr<AnalyticEvent>> EventManager::snapshotEvents() const {
+    std::shared_lock<std::shared_timed_mutex> lock1(this->_eventsMutex);
+    std::vector<std::shared_ptr<AnalyticEvent>> events = _events;
+    for (auto& slot : _staging) {
+        std::lock_guard<std::mutex> slotLock(slot.mutex);
+        for (auto& admitted : slot.events) {
+            events.push_back(admitted.event);
+        }
+    }
+    return events;
+}
+
 std::shared_ptr<NRJSON::JsonArray> EventManager::toJSON() const {
-    std::unique_lock<std::recursive_mutex> lock1(this->_eventsMutex, std::defer_lock);
-    lock1.lock();
-    return EventManager::toJSON(_events);
+    return EventManager::toJSON(snapshotEvents());
+}
+
+void EventManager::writeJSON(std::ostream& os) const {
+    EventManager::writeJSON(os, snapshotEvents());
+}
+
+void EventManager::writeJSON(std::ostream& os, const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+    EventJSONWriter(os).write(events);
 }
 
 std::shared_ptr<NRJSON::JsonArray> EventManager::toJSON(std::vector<std::shared_ptr<AnalyticEvent>> events) {
@@ -1,8 +1,11 @@
 //  Copyright © 2023 New Relic. All rights reserved.
 
 #include "AnalyticEvent.hpp"
+#include <atomic>
 #include <chrono>
+#include <random>
 #include "Analytics/Attribute.hpp"
+#include "Analytics/EventJSONWriter.hpp"
 #include <iomanip>
 #include <Utilities/Number.hpp>
 #include <Utilities/String.hpp>
@@ -15,13 +18,39 @@ namespace NewRelic {
                                  double session_elapsed_time_sec,
                                  AttributeValidator& attributeValidator)
             : _eventType(eventType),
+              _id(nextId()),
               _timestamp_epoch_millis(timestamp_epoch_millis),
               _session_elapsed_time_sec(session_elapsed_time_sec),
               _attributeValidator(attributeValidator) {
     }
 
 
+    /*
+     * A per-process random seed plus a counter, run through the splitmix64 finalizer.
+     * The finalizer is a bijection, so ids never repeat within a process, and the seed
+     * keeps them apart from the ids of earlier launches still sitting in the dup store.
+     */
+    uint64_t AnalyticEvent::nextId() {
+        static const uint64_t seed = ((uint64_t)std::random_device{}() << 32) ^ std::random_device{}() ^
+                                     (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+        static std::atomic<uint64_t> counter{0};
+
+        uint64_t z = seed + counter.fetch_add(1, std::memory_order_relaxed) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t AnalyticEvent::getId() const {
+        return _id;
+    }
+
+    EventRetention AnalyticEvent::getRetention() const {
+        return EventRetention::Sampled;
+    }
+
     AnalyticEvent& AnalyticEvent::operator=(const AnalyticEvent& event) {
+        _id = event._id;
         _timestamp_epoch_millis = event._timestamp_epoch_millis;
         _session_elapsed_time_sec = event._session_elapsed_time_sec;
         _attributes = event._attributes;
@@ -49,6 +78,7 @@ namespace NewRelic {
         }
     AnalyticEvent::AnalyticEvent(const AnalyticEvent& event):
             _eventType(event._eventType),
+            _id(event._id),
             _timestamp_epoch_millis(event._timestamp_epoch_millis),
             _session_elapsed_time_sec(event._session_elapsed_time_sec),
             _attributeValidator (event._attributeValidator),
@@ -213,4 +243,10 @@ namespace NewRelic {
         }
         return std::make_shared<NRJSON::JsonObject>(object);
     }
+
+    void AnalyticEvent::addJSONFields(EventJSONWriter& writer) const {
+        writer.addField("eventType", getEventType(), true);
+        writer.addField("timestamp", (double)_timestamp_epoch_millis, true);
+        writer.addField("timeSinceLoad", _session_elapsed_time_sec, true);
+    }
 }
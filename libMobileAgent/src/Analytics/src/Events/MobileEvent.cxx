@@ -4,6 +4,7 @@
 //
 
 #include "MobileEvent.hpp"
+#include "Analytics/EventJSONWriter.hpp"
 namespace NewRelic {
     const std::string MobileEvent::__eventType = std::string("Mobile");
     MobileEvent::MobileEvent(unsigned long long timestamp_epoch_millis, double session_elapsed_time_sec,
@@ -27,4 +28,9 @@ namespace NewRelic {
 
         return json;
     }
+
+    void MobileEvent::addJSONFields(EventJSONWriter& writer) const {
+        AnalyticEvent::addJSONFields(writer);
+        writer.addField("category", getCategory(), false);
+    }
 }
@@ -1,6 +1,7 @@
 //  Copyright © 2023 New Relic. All rights reserved.
 
 #include "NamedAnalyticEvent.hpp"
+#include "Analytics/EventJSONWriter.hpp"
 #include <iomanip>
 #include <Utilities/Util.hpp>
 
@@ -30,6 +31,11 @@ namespace NewRelic {
         return json;
     }
 
+    void NamedAnalyticEvent::addJSONFields(EventJSONWriter& writer) const {
+        MobileEvent::addJSONFields(writer);
+        writer.addField("name", _name, false);
+    }
+
     bool NamedAnalyticEvent::equal(const AnalyticEvent& event) const {
         if (event.getEventType() != this->__eventType) return false;
         if (static_cast<const NamedAnalyticEvent&>(event).getCategory() != this->getCategory()) return false;
@@ -20,6 +20,9 @@ namespace NewRelic {
 
     const std::string& SessionAnalyticEvent::getCategory() const { return __category; }
 
+    //one per session; never sampled away, however many other events the session records
+    EventRetention SessionAnalyticEvent::getRetention() const { return EventRetention::NeverEvict; }
+
     std::shared_ptr<NRJSON::JsonObject> SessionAnalyticEvent::generateJSONObject() const {
         return MobileEvent::generateJSONObject();
     }
@@ -2,6 +2,7 @@
 
 #include <Analytics/Constants.hpp>
 #include "UserActionEvent.hpp"
+#include "Analytics/EventJSONWriter.hpp"
 
 namespace NewRelic{
     const std::string& UserActionEvent::__category = std::string(__kNRMA_RET_userAction);
@@ -26,6 +27,11 @@ namespace NewRelic{
         return json;
     }
 
+    void UserActionEvent::addJSONFields(EventJSONWriter& writer) const {
+        AnalyticEvent::addJSONFields(writer);
+        writer.addField("category", getCategory(), false);
+    }
+
     void UserActionEvent::put(std::ostream& os) const {
         os << UserActionEvent::__eventType << AnalyticEvent::_delimiter;
     }
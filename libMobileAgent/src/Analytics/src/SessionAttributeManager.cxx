@@ -37,97 +37,71 @@ namespace NewRelic {
     }
 
     bool SessionAttributeManager::incrementAttribute(const char *name, unsigned long long value) {
-        //access lock
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock();
-
-        auto attributeIterator = _sessionAttributes.find(name);
-        if(attributeIterator != _sessionAttributes.end()) {
-            auto attribute = attributeIterator->second->getValue();
-            if(attribute->getCategory() != BaseValue::Category::NUMBER) {
-                LLOG_ERROR("Unable to increment attribute \"%s\", stored value is not a number.",name);
-                return false;
-            }
-            auto* num = dynamic_cast<Number*>(attribute.get());
-            switch(num->getTag()) {
-                case Number::Tag::DOUBLE:
-                    return addSessionAttribute(name,num->doubleValue() + value);
-                case Number::Tag::LONG:
-                case Number::Tag::U_LONG:
-                    return addSessionAttribute(name,num->unsignedLongLongValue() + value);
-            }
-        }
-        return addSessionAttribute(name, value);
+        return incrementAttribute(name, value, nullptr);
     }
     bool SessionAttributeManager::incrementAttribute(const char *name, unsigned long long value, bool persistent) {
-        //access lock
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock(); // can throw std::system_error
-
-        auto attributeIterator = _sessionAttributes.find(name);
-        if(attributeIterator != _sessionAttributes.end()) {
-            auto attribute = attributeIterator->second->getValue();
-            if(attribute->getCategory() != BaseValue::Category::NUMBER) {
-                LLOG_ERROR("Unable to increment attribute \"%s\", stored value is not a number.",name);
-                return false;
-            }
-            auto* num = dynamic_cast<Number*>(attribute.get());
-            switch(num->getTag()) {
-                case Number::Tag::DOUBLE:
-                    return addSessionAttribute(name,num->doubleValue() + value);
-                case Number::Tag::LONG:
-                case Number::Tag::U_LONG:
-                    return addSessionAttribute(name,num->unsignedLongLongValue() + value);
-            }
-        }
-        return addSessionAttribute(name, value, persistent);
+        return incrementAttribute(name, value, &persistent);
     }
 
     bool SessionAttributeManager::incrementAttribute(const char *name, double value) {
-        //access lock
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock();
-
-        auto attributeIterator = _sessionAttributes.find(name);
-        if(attributeIterator != _sessionAttributes.end()) {
-            auto attribute = attributeIterator->second->getValue();
-            if(attribute->getCategory() != BaseValue::Category::NUMBER) {
-                LLOG_ERROR("Unable to increment attribute \"%s\", stored value is not a number.",name);
-                return false;
-            }
-            auto* num = dynamic_cast<Number*>(attribute.get());
-            switch(num->getTag()) {
-                case Number::Tag::DOUBLE:
-                    return addSessionAttribute(name,num->doubleValue() + value);
-                case Number::Tag::LONG:
-                case Number::Tag::U_LONG:
-                    return addSessionAttribute(name,num->unsignedLongLongValue() + value);
-            }
-        }
-            return addSessionAttribute(name, value);
+        return incrementAttribute(name, value, nullptr);
     }
     bool SessionAttributeManager::incrementAttribute(const char *name, double value, bool persistent) {
-        //access lock
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock(); // can throw std::system_error
+        return incrementAttribute(name, value, &persistent);
+    }
 
-        auto attributeIterator = _sessionAttributes.find(name);
-        if(attributeIterator != _sessionAttributes.end()) {
-            auto attribute = attributeIterator->second->getValue();
-            if(attribute->getCategory() != BaseValue::Category::NUMBER) {
-                LLOG_ERROR("Unable to increment attribute \"%s\", stored value is not a number.",name);
-                return false;
+    template<typename V>
+    std::shared_ptr<AttributeBase> SessionAttributeManager::createNumberAttribute(const char* name, V value) const {
+        return Attribute<V>::createAttribute(name,
+                                             _attributeValidator.getNameValidator(),
+                                             value,
+                                             [](V){return true;});
+    }
+
+    // The read of the current value and the write of the sum happen under one exclusive lock,
+    // so concurrent increments of the same attribute don't lose updates.
+    template<typename V>
+    bool SessionAttributeManager::incrementAttribute(const char *name, V value, const bool* persistent) {
+        try {
+            //access lock
+            std::unique_lock<std::shared_timed_mutex> attributeLock(_attributesLock); // can throw std::system_error
+
+            auto attributeIterator = _sessionAttributes.find(name);
+            if(attributeIterator != _sessionAttributes.end()) {
+                auto attribute = attributeIterator->second->getValue();
+                if(attribute->getCategory() != BaseValue::Category::NUMBER) {
+                    LLOG_ERROR("Unable to increment attribute \"%s\", stored value is not a number.",name);
+                    return false;
+                }
+                auto* num = dynamic_cast<Number*>(attribute.get());
+                switch(num->getTag()) {
+                    case Number::Tag::DOUBLE:
+                        return addAttributeLocked(createNumberAttribute(name, num->doubleValue() + value));
+                    case Number::Tag::LONG:
+                    case Number::Tag::U_LONG:
+                        return addAttributeLocked(createNumberAttribute(name, num->unsignedLongLongValue() + value));
+                }
             }
-            auto* num = dynamic_cast<Number*>(attribute.get());
-            switch(num->getTag()) {
-                case Number::Tag::DOUBLE:
-                    return addSessionAttribute(name,num->doubleValue() + value);
-                case Number::Tag::LONG:
-                case Number::Tag::U_LONG:
-                    return addSessionAttribute(name,num->unsignedLongLongValue() + value);
+            auto attrib = createNumberAttribute(name, value);
+            if (persistent == nullptr) {
+                return addAttributeLocked(attrib);
             }
+            if (attrib == nullptr) {
+                LLOG_VERBOSE("Failed to create attribute named \"%s\".", name);
+                return false;
+            }
+            attrib->setPersistent(*persistent);
+            return addAttributeLocked(attrib, *persistent);
+        } catch (std::invalid_argument& e) {
+            LLOG_ERROR("Unable to add session attribute named \"%s\" : %s",name,e.what());
+            return false;
+        } catch (std::system_error& e) {
+            LLOG_ERROR("Unable to add session attribute named \"%s\" : %s",name,e.what());
+            return false;
+        } catch (...) {
+            LLOG_ERROR("Unable to add session attribute named \"%s\"",name);
+            return false;
         }
-        return addSessionAttribute(name, value, persistent);
     }
 
     bool SessionAttributeManager::addSessionAttribute(const char *name, double value) {
@@ -356,8 +330,7 @@ bool SessionAttributeManager::addSessionAttribute(const char *name, unsigned lon
 bool SessionAttributeManager::removeSessionAttribute(const char *name) {
     //access lock
     try {
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock();
+        std::unique_lock<std::shared_timed_mutex> attributeLock(_attributesLock);
 
         auto attributeIterator = _sessionAttributes.find(name);
         if (attributeIterator != _sessionAttributes.end()) {
@@ -383,9 +356,8 @@ bool SessionAttributeManager::removeSessionAttribute(const char *name) {
 bool SessionAttributeManager::clearSessionAttributes() {
         //access lock
         try {
-            std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-            attributeLock.lock();
-            
+            std::unique_lock<std::shared_timed_mutex> attributeLock(_attributesLock);
+
             _attributeDuplicationStore.clear();
             _sessionAttributeStore.clear();
             _sessionAttributes.clear();
@@ -405,9 +377,9 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
 
     bool SessionAttributeManager::restorePersistentAttributes() {
         try {
-            //todo: update to use persistentAttributeStore
-            auto persistentAttributeMap = _sessionAttributeStore.load();
-            for (auto& iterator : persistentAttributeMap) {
+            // the store read its file when it was opened; load() would only read it again
+            auto persistentAttributeMap = _sessionAttributeStore.getCache();
+            for (auto& iterator : *persistentAttributeMap) {
                 auto value = iterator.second;
                 switch(value->getCategory()) {
                     case (BaseValue::Category::STRING):
@@ -439,12 +411,22 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
 
 
     bool SessionAttributeManager::addAttribute(std::shared_ptr<AttributeBase> attribute, bool persistent) {
-
         try {
-        //access lock
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock(); //can throw system_error
+            //access lock
+            std::unique_lock<std::shared_timed_mutex> attributeLock(_attributesLock); //can throw system_error
+            return addAttributeLocked(attribute, persistent);
+        } catch (std::system_error& e) {
+            LLOG_ERROR("Unable to add attribute \"%s\": %s",attribute->getName().c_str(),e.what());
+            return false;
+        } catch(...) {
+            LLOG_ERROR("Unable to add attribute \"%s\"",attribute->getName().c_str());
+            return false;
+        }
+    }
+
+    bool SessionAttributeManager::addAttributeLocked(std::shared_ptr<AttributeBase> attribute, bool persistent) {
 
+        try {
             if (attribute == nullptr) return false;
             std::shared_ptr<AttributeBase> insertAttribute = attribute;
             auto attributeIterator = _sessionAttributes.find(attribute->getName());
@@ -455,8 +437,8 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
                     //todo: update to use new persistentAttributeStore
                     _sessionAttributeStore.remove(attribute->getName());
                 }
-                insertAttribute = attributeIterator->second;
-                insertAttribute->setValue(attribute->getValue());
+                //replaced rather than updated in place: snapshots taken under the shared lock keep the old one
+                insertAttribute = std::make_shared<AttributeBase>(*attribute);
             } else if(_sessionAttributes.size() >= kAttributeLimit) {
                 //we are going to be updating a value, so we are going to be inserting
                 //validate we aren't going past the attribute limit by doing so.
@@ -497,8 +479,16 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
     bool SessionAttributeManager::addAttribute(std::shared_ptr<AttributeBase> attribute) {
         try {
             //access lock
-            std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-            attributeLock.lock();
+            std::unique_lock<std::shared_timed_mutex> attributeLock(_attributesLock);
+            return addAttributeLocked(attribute);
+        } catch(...) {
+            LLOG_ERROR("Unable to add attribute \"%s\"",attribute->getName().c_str());
+            return false;
+        }
+    }
+
+    bool SessionAttributeManager::addAttributeLocked(std::shared_ptr<AttributeBase> attribute) {
+        try {
             if (attribute == nullptr) {
                 LLOG_VERBOSE("Failed to create attribute.");
                 return false;
@@ -506,8 +496,9 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
             std::shared_ptr<AttributeBase> insertAttribute = attribute;
             auto attributeIterator = _sessionAttributes.find(attribute->getName());
             if (attributeIterator != _sessionAttributes.end()) {
-                insertAttribute = attributeIterator->second;
-                insertAttribute->setValue(attribute->getValue());
+                //replaced rather than updated in place: snapshots taken under the shared lock keep the old one
+                insertAttribute = std::make_shared<AttributeBase>(*attribute);
+                insertAttribute->setPersistent(attributeIterator->second->getPersistent());
             } else if(_sessionAttributes.size() >= kAttributeLimit) {
                 //we are going to be updating a value, so we are going to be inserting
                 //validate we aren't going past the attribute limit by doing so.
@@ -530,17 +521,19 @@ SessionAttributeManager::SessionAttributeManager(PersistentStore<std::string,Bas
     }
 
     const std::map<std::string, std::shared_ptr<AttributeBase>> SessionAttributeManager::getSessionAttributes() const {
-        std::unique_lock<std::recursive_mutex> attributeLock(_attributesLock,std::defer_lock);
-        attributeLock.lock();
+        //readers share the lock; only adds, removes and increments take it exclusively
+        std::shared_lock<std::shared_timed_mutex> attributeLock(_attributesLock);
         std::map<std::string, std::shared_ptr<AttributeBase>> tempMap = std::map<std::string, std::shared_ptr<AttributeBase>>(
                 _sessionAttributes);
 
+        std::lock_guard<std::mutex> privateLock(_privateAttributesLock);
         tempMap.insert(_privateSessionAttributes.cbegin(), _privateSessionAttributes.cend());
 
         return tempMap;
     }
 
     std::shared_ptr<NRJSON::JsonObject> SessionAttributeManager::generateJSONObject() const {
+        //attributes in the map are never modified, only replaced, so the snapshot can be read without the lock
         auto tempMap = this->getSessionAttributes();
         return generateJSONObject(tempMap);
     }
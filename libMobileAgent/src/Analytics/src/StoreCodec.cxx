@@ -0,0 +1,90 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Analytics/StoreCodec.hpp"
+#include "Analytics/EventDeserializer.hpp"
+#include <Analytics/AnalyticEvent.hpp>
+#include <Utilities/Util.hpp>
+#include <Utilities/Value.hpp>
+#include <cstring>
+#include <stdexcept>
+
+namespace NewRelic {
+    void StoreCodec<BaseValue>::encode(const BaseValue& value, std::string& out) const {
+        Value::encode(value, out);
+    }
+
+    //throws std::runtime_error
+    std::shared_ptr<BaseValue> StoreCodec<BaseValue>::decode(const char* data, std::size_t length) const {
+        auto value = Value::decode(data, length);
+        if (length != 0) {
+            throw std::runtime_error("trailing bytes after encoded value.");
+        }
+        return value;
+    }
+
+    /*
+     * header length (u32) | put() header | timestamp (u64) | elapsed time bits (u64) |
+     * attribute count (u32) | { name length (u32) | name | Value::encode }*
+     *
+     * The header is whatever the event's put() writes (type, category, name...), so the
+     * event subclass is still picked by EventDeserializer; everything after it skips the text.
+     */
+    void StoreCodec<AnalyticEvent>::encode(const AnalyticEvent& event, std::string& out) const {
+        std::ostringstream header;
+        event.put(header);
+        const std::string& type = header.str();
+        Util::Bytes::appendUInt32(out, (uint32_t)type.size());
+        out.append(type);
+
+        uint64_t elapsed = 0;
+        std::memcpy(&elapsed, &event._session_elapsed_time_sec, sizeof(elapsed));
+        Util::Bytes::appendUInt64(out, event._timestamp_epoch_millis);
+        Util::Bytes::appendUInt64(out, elapsed);
+
+        Util::Bytes::appendUInt32(out, (uint32_t)event._attributes.size());
+        for (auto it = event._attributes.cbegin(); it != event._attributes.cend(); it++) {
+            Util::Bytes::appendUInt32(out, (uint32_t)it->first.size());
+            out.append(it->first);
+            Value::encode(*it->second->getValue(), out);
+        }
+    }
+
+    //throws std::runtime_error, std::invalid_argument
+    std::shared_ptr<AnalyticEvent> StoreCodec<AnalyticEvent>::decode(const char* data, std::size_t length) const {
+        auto take = [&data, &length](std::size_t count) {
+            if (length < count) {
+                throw std::runtime_error("truncated event.");
+            }
+            const char* bytes = data;
+            data += count;
+            length -= count;
+            return bytes;
+        };
+
+        const uint32_t typeLength = Util::Bytes::readUInt32(take(4));
+        std::string header(take(typeLength), typeLength);
+        const uint64_t timestamp = Util::Bytes::readUInt64(take(8));
+        const uint64_t elapsedBits = Util::Bytes::readUInt64(take(8));
+
+        // the deserializer builds the right subclass from the header; the numbers are set exactly below
+        header.append("0\t0\t");
+        std::istringstream is(header);
+        auto event = EventDeserializer::deserialize(is);
+        if (event == nullptr) {
+            throw std::runtime_error("unrecognized event header.");
+        }
+        event->_timestamp_epoch_millis = timestamp;
+        std::memcpy(&event->_session_elapsed_time_sec, &elapsedBits, sizeof(elapsedBits));
+
+        const uint32_t count = Util::Bytes::readUInt32(take(4));
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t nameLength = Util::Bytes::readUInt32(take(4));
+            std::string name(take(nameLength), nameLength);
+            event->insertAttribute(std::make_shared<AttributeBase>(name, Value::decode(data, length)));
+        }
+        if (length != 0) {
+            throw std::runtime_error("trailing bytes after encoded event.");
+        }
+        return event;
+    }
+}
@@ -0,0 +1,171 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Analytics/StoreFile.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include <Utilities/libLogger.hpp>
+
+namespace NewRelic {
+    namespace {
+        struct FileDescriptor {
+            int fd;
+
+            ~FileDescriptor() {
+                if (fd != -1) {
+                    ::close(fd);
+                }
+            }
+        };
+    }
+
+    const char* const StoreFile::BACKUP_SUFFIX = ".bak";
+    const char* const StoreFile::TEMP_SUFFIX = ".tmp";
+
+    StoreFile::StoreFile(std::string path,
+                         bool atomic,
+                         Writer writer)
+            : _path(std::move(path)),
+              _atomic(atomic),
+              _writer(std::move(writer)) {
+        if (!_writer) {
+            _writer = [this](int fd, const char* data, std::size_t length) { writeAll(fd, data, length); };
+        }
+    }
+
+    void StoreFile::replace(const std::string& bytes) {
+        if (!_atomic) {
+            openStream(std::ios::trunc | std::ios::binary);
+            _out.write(bytes.data(), bytes.size());
+            _out.flush();
+            if (!_out) {
+                throw std::runtime_error("failed to write " + _path);
+            }
+            _size = bytes.size();
+            return;
+        }
+
+        // appends go through their own descriptor in this mode; don't keep the old inode open
+        close();
+        const std::string tempPath = _path + TEMP_SUFFIX;
+        {
+            FileDescriptor file{::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+            if (file.fd == -1) {
+                throw std::system_error(errno, std::generic_category(), "open " + tempPath);
+            }
+            _writer(file.fd, bytes.data(), bytes.size());
+            syncData(file.fd);
+        }
+        if (std::rename(tempPath.c_str(), _path.c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "rename " + tempPath);
+        }
+        _size = bytes.size();
+        syncDirectory();
+    }
+
+    // one group-committed flush is one sync however many records it carries
+    void StoreFile::append(const std::string& bytes) {
+        if (!_atomic) {
+            if (!_out.is_open()) {
+                openStream(std::ios::app | std::ios::binary);
+            }
+            _out.write(bytes.data(), bytes.size());
+            _out.flush();
+            if (!_out) {
+                throw std::runtime_error("failed to append to " + _path);
+            }
+            _size += bytes.size();
+            return;
+        }
+
+        FileDescriptor file{::open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644)};
+        if (file.fd == -1) {
+            throw std::system_error(errno, std::generic_category(), "open " + _path);
+        }
+        _writer(file.fd, bytes.data(), bytes.size());
+        syncData(file.fd);
+        _size += bytes.size();
+    }
+
+    void StoreFile::truncate() {
+        _size = 0;
+        openStream(std::ios::trunc);
+    }
+
+    bool StoreFile::moveToBackup() {
+        if (_out.is_open()) {
+            _out.flush();
+            _out.close();
+        }
+        _size = 0;
+        const std::string backupPath = _path + BACKUP_SUFFIX;
+        if (std::rename(_path.c_str(), backupPath.c_str()) != 0) {
+            return false;
+        }
+        openStream(std::ios::trunc);
+        return true;
+    }
+
+    void StoreFile::removeBackup() {
+        std::remove((_path + BACKUP_SUFFIX).c_str());
+    }
+
+    void StoreFile::removeTemp() {
+        std::remove((_path + TEMP_SUFFIX).c_str());
+    }
+
+    void StoreFile::close() {
+        if (_out.is_open()) {
+            _out.close();
+        }
+    }
+
+    //throws std::system_error
+    void StoreFile::writeAll(int fd,
+                             const char* data,
+                             std::size_t length) const {
+        while (length > 0) {
+            ssize_t written = ::write(fd, data, length);
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "write " + _path);
+            }
+            data += written;
+            length -= (std::size_t)written;
+        }
+    }
+
+    void StoreFile::syncData(int fd) {
+#if defined(__APPLE__)
+        // no fdatasync on Darwin
+        int rc = fsync(fd);
+#else
+        int rc = fdatasync(fd);
+#endif
+        if (rc == -1) {
+            throw std::system_error(errno, std::generic_category(), "sync");
+        }
+    }
+
+    void StoreFile::syncDirectory() const {
+        const std::size_t slash = _path.find_last_of('/');
+        const std::string directory = slash == std::string::npos ? "." : _path.substr(0, slash == 0 ? 1 : slash);
+        FileDescriptor dir{::open(directory.c_str(), O_RDONLY)};
+        if (dir.fd != -1 && fsync(dir.fd) == -1) {
+            LLOG_VERBOSE("Failed to sync directory \"%s\". Errno: %d", directory.c_str(), errno);
+        }
+    }
+
+    // unbuffered, so what was written is in the file once write() returns
+    void StoreFile::openStream(std::ios::openmode mode) {
+        _out.close();
+        _out.clear();
+        _out.open(_path, mode);
+        _out.rdbuf()->pubsetbuf(0, 0);
+    }
+}
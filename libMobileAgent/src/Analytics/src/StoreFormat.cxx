@@ -0,0 +1,119 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Analytics/StoreFormat.hpp"
+#include "Analytics/RecordFormat.hpp"
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+
+namespace NewRelic {
+    const char* const StoreFormat::JOURNAL_HEADER = "#NRJOURNAL1";
+
+    namespace {
+        // Same splitting as std::getline: the line excludes its '\n', and a final line needn't have one.
+        bool nextLine(std::string_view bytes,
+                      std::size_t& offset,
+                      std::string_view& line) {
+            if (offset >= bytes.size()) {
+                return false;
+            }
+            const std::size_t end = bytes.find('\n', offset);
+            if (end == std::string_view::npos) {
+                line = bytes.substr(offset);
+                offset = bytes.size();
+            } else {
+                line = bytes.substr(offset, end - offset);
+                offset = end + 1;
+            }
+            return true;
+        }
+    }
+
+    std::size_t StoreFormat::journalStart(const char* data,
+                                          std::size_t length) {
+        std::size_t offset = 0;
+        std::string_view header;
+        if (nextLine(std::string_view(data, length), offset, header) && header == JOURNAL_HEADER) {
+            return offset;
+        }
+        return 0;
+    }
+
+    bool StoreFormat::readJournal(const char* data,
+                                  std::size_t length,
+                                  std::size_t offset,
+                                  const std::function<void(char, const char*, std::size_t, const char*, std::size_t)>& onRecord) {
+        const std::string_view bytes(data, length);
+        std::string_view line;
+        std::string_view value;
+        try {
+            while (nextLine(bytes, offset, line)) {
+                if (line.empty()) {
+                    throw std::runtime_error("empty journal record");
+                }
+                if (line[0] == RecordFormat::REMOVE) {
+                    onRecord(RecordFormat::REMOVE, line.data() + 1, line.size() - 1, nullptr, 0);
+                } else if (line[0] == RecordFormat::PUT) {
+                    if (!nextLine(bytes, offset, value)) {
+                        throw std::runtime_error("truncated journal record");
+                    }
+                    onRecord(RecordFormat::PUT, line.data() + 1, line.size() - 1, value.data(), value.size());
+                } else {
+                    throw std::runtime_error("unknown journal record");
+                }
+            }
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    void StoreFormat::readPairs(const char* data,
+                                std::size_t length,
+                                const std::function<void(const char*, std::size_t, const char*, std::size_t)>& onPair) {
+        const std::string_view bytes(data, length);
+        std::size_t offset = 0;
+        std::string_view key;
+        std::string_view value;
+        while (nextLine(bytes, offset, key)) {
+            if (!nextLine(bytes, offset, value)) {
+                value = std::string_view();
+            }
+            onPair(key.data(), key.size(), value.data(), value.size());
+        }
+    }
+
+    std::size_t StoreFormat::chooseDropped(std::size_t size,
+                                           const std::vector<std::size_t>& sizes,
+                                           const std::vector<std::size_t>& oldestFirst,
+                                           std::size_t budget,
+                                           std::vector<bool>& dropped) {
+        dropped.assign(sizes.size(), false);
+        std::size_t count = 0;
+        for (const std::size_t i : oldestFirst) {
+            if (size <= budget) {
+                break;
+            }
+            dropped[i] = true;
+            size -= sizes[i];
+            count++;
+        }
+        return count;
+    }
+
+    void StoreFormat::removeRecords(std::string& bytes,
+                                    const std::vector<std::size_t>& sizes,
+                                    const std::vector<bool>& dropped) {
+        std::string kept;
+        std::size_t offset = bytes.size() - std::accumulate(sizes.begin(), sizes.end(), (std::size_t)0);
+        kept.reserve(bytes.size());
+        kept.append(bytes, 0, offset);
+        for (std::size_t i = 0; i < sizes.size(); i++) {
+            if (!dropped[i]) {
+                kept.append(bytes, offset, sizes[i]);
+            }
+            offset += sizes[i];
+        }
+        bytes.swap(kept);
+    }
+}
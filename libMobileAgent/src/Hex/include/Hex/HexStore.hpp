@@ -13,14 +13,17 @@
 #include <functional>
 #include <mutex>
 #include <Hex/HexReport.hpp>
+#include <Utilities/ShutdownCoordinator.hpp>
 
 namespace NewRelic {
     namespace Hex {
-        class HexStore {
+        class HexStore : private ShutdownCoordinator::Participant {
         public:
 
             explicit HexStore(const char* storePath);
 
+            virtual ~HexStore();
+
             void store(const std::shared_ptr<Report::HexReport>& report);
 
             /*
@@ -50,6 +53,7 @@ namespace NewRelic {
             // disk so the next readAll() pass picks it up again.
             void markFailed(const std::string& reportId);
 
+            // Releases this store's in-flight claims and deletes its reports on a background queue.
             void clear();
 
         protected:
@@ -61,6 +65,10 @@ namespace NewRelic {
             static const char* FILE_BASE;
             static const char* FILE_EXTENSION;
             mutable std::mutex _storeMutex;
+
+            // ShutdownCoordinator::Participant: waits for queued clear() sweeps (any store's)
+            bool awaitDrained(ShutdownCoordinator::CLOCK::time_point deadline) override;
+
             // NOTE: the set of reports currently in flight (handed to a publisher,
             // upload not yet resolved) is intentionally process-global rather than a
             // member here — see inFlightSet() in HexStore.cxx. Multiple HexStore
@@ -19,6 +19,7 @@
 #include <unordered_set>
 #include "Hex/HexStore.hpp"
 #include <Utilities/libLogger.hpp>
+#include <Utilities/WorkQueue.hpp>
 #include <cstddef>
 #include "hex-agent-data_generated.h"
 #include "jserror_generated.h"
@@ -57,6 +58,15 @@ namespace {
     struct DirCloser {
         void operator()(DIR* d) const noexcept { if (d) ::closedir(d); }
     };
+    // clear()'s directory sweeps need nothing but the path, so they run on one queue that outlives
+    // the stores: destroying a store neither drops its sweep nor waits for it
+    NewRelic::WorkQueue& sweepQueue() {
+        static NewRelic::WorkQueue queue(NewRelic::WorkQueue::DEFAULT_CAPACITY,
+                                         NewRelic::WorkQueue::OverflowPolicy::Spill,
+                                         &NewRelic::IOThreadPool::shared());
+        return queue;
+    }
+
     using UniqueFile = std::unique_ptr<FILE, FileCloser>;
     using UniqueDir  = std::unique_ptr<DIR,  DirCloser>;
 
@@ -109,7 +119,18 @@ namespace NewRelic {
         const char* HexStore::FILE_EXTENSION = ".fbad";
 
 
-        HexStore::HexStore(const char* storePath) : storePath(storePath) {}
+        HexStore::HexStore(const char* storePath) : storePath(storePath) {
+            ShutdownCoordinator::shared().enroll(this);
+        }
+
+        HexStore::~HexStore() {
+            ShutdownCoordinator::shared().withdraw(this);
+        }
+
+        bool HexStore::awaitDrained(ShutdownCoordinator::CLOCK::time_point deadline) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ShutdownCoordinator::CLOCK::now());
+            return sweepQueue().synchronize((unsigned int)std::max<long long>(remaining.count(), 0));
+        }
 
         void HexStore::store(const std::shared_ptr<Report::HexReport>& report) {
             // Bound the on-disk backlog before we add another file. Cheap single
@@ -283,10 +304,9 @@ namespace NewRelic {
                 }
             }
             std::string path = storePath;
-            // Honor the original async intent without the std::async-discarded-future
-            // gotcha (~future() of a launch::async future blocks). Use a detached
-            // thread so callers don't stall on disk I/O.
-            std::thread([path]() {
+            // Callers don't stall on disk I/O; like the detached thread this used to run on,
+            // the sweep may outlive the store.
+            sweepQueue().enqueue([path]() {
                 UniqueDir dirp(::opendir(path.c_str()));
                 if (!dirp) {
                     LLOG_ERROR("failed to open handled exception store dir: \"%s\".\nerror %d: %s",
@@ -307,7 +327,7 @@ namespace NewRelic {
                     std::string fullPath = path + "/" + filename;
                     std::remove(fullPath.c_str());
                 }
-            }).detach();
+            });
         }
 
         std::string HexStore::generateFilename() {
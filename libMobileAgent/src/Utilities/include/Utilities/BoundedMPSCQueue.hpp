@@ -0,0 +1,102 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_BOUNDEDMPSCQUEUE_HPP
+#define LIBMOBILEAGENT_BOUNDEDMPSCQUEUE_HPP
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace NewRelic {
+// Fixed-capacity FIFO ring that any number of threads may push to without locking, and one
+// thread at a time may pop from. Each slot carries a sequence number telling producers and the
+// consumer whose turn it is, so a push is one CAS on the tail and a pop touches no shared counter.
+// The capacity is rounded up to a power of two.
+template<typename T>
+class BoundedMPSCQueue {
+public:
+    explicit BoundedMPSCQueue(std::size_t capacity)
+            : _mask(roundUp(capacity) - 1),
+              _slots(new Slot[_mask + 1]),
+              _head(0),
+              _tail(0) {
+        for (std::size_t i = 0; i <= _mask; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMPSCQueue(const BoundedMPSCQueue&) = delete;
+    BoundedMPSCQueue& operator=(const BoundedMPSCQueue&) = delete;
+
+    // Returns false, leaving value untouched, if the ring is full.
+    bool push(T& value) {
+        std::size_t pos = _tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &_slots[pos & _mask];
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if nothing has been published at the head yet.
+    bool pop(T& value) {
+        Slot& slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+        _head++;
+        return true;
+    }
+
+    // Consumer only. The oldest published value, left in place, or nullptr.
+    T* front() {
+        Slot& slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return nullptr;
+        }
+        return &slot.value;
+    }
+
+    std::size_t capacity() const {
+        return _mask + 1;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static std::size_t roundUp(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const std::size_t _mask;
+    std::unique_ptr<Slot[]> _slots;
+    alignas(64) std::size_t _head;
+    alignas(64) std::atomic<std::size_t> _tail;
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_BOUNDEDMPSCQUEUE_HPP
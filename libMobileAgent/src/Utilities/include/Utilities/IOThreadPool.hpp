@@ -0,0 +1,73 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_IOTHREADPOOL_HPP
+#define LIBMOBILEAGENT_IOTHREADPOOL_HPP
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace NewRelic {
+class WorkQueue;
+
+// A small fixed set of threads that run WorkQueues created with a pool instead of a thread of their own.
+// A queue is handed to the pool when it goes from idle to having work, and at most one pool
+// thread runs a given queue at a time, so its items still run one by one in enqueue order.
+// The pool also keeps timers, so work that has to wait for a deadline doesn't hold one of its threads.
+class IOThreadPool {
+public:
+    typedef std::chrono::steady_clock CLOCK;
+
+    static const unsigned int DEFAULT_THREAD_COUNT = 2;
+
+    // Process-wide pool shared by the stores; never destroyed, so it outlives every static that uses it
+    static IOThreadPool& shared();
+
+    explicit IOThreadPool(unsigned int threadCount = DEFAULT_THREAD_COUNT);
+    ~IOThreadPool();
+
+    IOThreadPool(const IOThreadPool&) = delete;
+    IOThreadPool& operator=(const IOThreadPool&) = delete;
+
+    unsigned int getThreadCount() const;
+
+    // true on one of this pool's threads, i.e. inside a queue item or timer callback it runs
+    bool runsCurrentThread() const;
+
+    // Runs callback on a pool thread once at has passed. Callbacks should be short, e.g. hand an item to a WorkQueue.
+    void scheduleAt(const void* owner,
+                    CLOCK::time_point at,
+                    std::function<void()> callback);
+    // Drops owner's timers and waits for one of them that is firing; not to be called from owner's own callback
+    void cancelTimers(const void* owner);
+
+private:
+    friend class WorkQueue;
+
+    void schedule(WorkQueue* queue);
+    bool cancel(WorkQueue* queue); // true if the queue was waiting for a thread and has been taken off the list
+    void run();
+
+    struct Timer {
+        const void* owner;
+        std::function<void()> callback;
+    };
+
+    std::deque<WorkQueue*> _ready;
+    std::multimap<CLOCK::time_point, Timer> _timers; // guarded by _readyMutex
+    std::multiset<const void*> _firing;               // owners of the callbacks running now (guarded by _readyMutex)
+    std::mutex _readyMutex;
+    std::condition_variable _readySignaler;
+    std::condition_variable _firedSignaler;
+    bool _stopping;
+    std::vector<std::thread> _threads;
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_IOTHREADPOOL_HPP
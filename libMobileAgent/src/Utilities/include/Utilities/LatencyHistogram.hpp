@@ -0,0 +1,63 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_LATENCYHISTOGRAM_HPP
+#define LIBMOBILEAGENT_LATENCYHISTOGRAM_HPP
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NewRelic {
+// Lock-free histogram of durations in microseconds, bucketed the way HdrHistogram does it: each
+// power of two is split into SUB_BUCKETS linear buckets, so any recorded value is known to within
+// 1/SUB_BUCKETS (12.5%) whatever its size. Values past about 71 minutes land in the last bucket.
+class LatencyHistogram {
+public:
+    static const unsigned int SUB_BUCKET_BITS = 3;
+    static const unsigned int SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static const unsigned int MAX_EXPONENT = 31;
+    static const std::size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    // A point-in-time copy; snapshots of several histograms can be merged.
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        std::vector<uint64_t> buckets;
+
+        // upper bound, within the bucket precision, of the value below which percentile% of the samples fall
+        uint64_t percentile(double percentile) const;
+        double mean() const;
+        void merge(const Snapshot& other);
+    };
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t micros);
+
+    template<typename DURATION>
+    void record(DURATION duration) {
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(micros > 0 ? (uint64_t)micros : 0);
+    }
+
+    Snapshot snapshot() const;
+
+    static std::size_t bucketOf(uint64_t micros);
+    static uint64_t highestValueIn(std::size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_LATENCYHISTOGRAM_HPP
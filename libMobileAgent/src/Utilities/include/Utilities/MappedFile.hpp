@@ -0,0 +1,53 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_MAPPEDFILE_HPP
+#define LIBMOBILEAGENT_MAPPEDFILE_HPP
+
+#pragma once
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+namespace NewRelic {
+// Read-only view of a whole file, unmapped on destruction.
+// A missing or empty file maps to an empty view. A file that can't be mapped is read into memory instead.
+class MappedFile {
+public:
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return _data; }
+    std::size_t size() const { return _size; }
+
+    // false if the file exists but couldn't be read (out of descriptors or memory, no permission, ...);
+    // the view is empty then, but unlike a missing file's that doesn't mean the file is
+    bool readable() const { return _readable; }
+
+private:
+    bool readAll(int fd, std::size_t size);
+
+    const char* _data;
+    std::size_t _size;
+    bool _mapped;
+    bool _readable;
+    // holds the file when it couldn't be mapped
+    std::string _buffer;
+};
+
+// Lets an std::istream read straight out of a memory range (e.g. a MappedFile) without copying it.
+// reset() can point one buffer, and the istream over it, at a new range as often as needed.
+class MemoryStreamBuf : public std::streambuf {
+public:
+    MemoryStreamBuf() = default;
+    MemoryStreamBuf(const char* data, std::size_t size) { reset(data, size); }
+
+    void reset(const char* data, std::size_t size) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_MAPPEDFILE_HPP
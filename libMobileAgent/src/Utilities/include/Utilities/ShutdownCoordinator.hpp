@@ -0,0 +1,68 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_SHUTDOWNCOORDINATOR_HPP
+#define LIBMOBILEAGENT_SHUTDOWNCOORDINATOR_HPP
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace NewRelic {
+// Everything in the library with background work enrolls here, so that when the app is backgrounded
+// or about to go away all of it can be finished against one deadline rather than each owner waiting
+// out its own timeout in turn. drain() first tells every participant to start finishing, then
+// waits for each of them until the shared deadline and no longer; work still unfinished stays
+// queued with its owner, whose destructor waits for it, so none of it outlives the owner.
+class ShutdownCoordinator {
+public:
+    typedef std::chrono::steady_clock CLOCK;
+
+    // the whole of a drain() given no budget of its own
+    static const std::chrono::milliseconds DEFAULT_BUDGET;
+
+    class Participant {
+    public:
+        virtual ~Participant() = default;
+
+        // Start finishing pending work (cut throttles short, queue the last writes); must not block.
+        virtual void beginDrain() {}
+
+        // Wait for the work begun by beginDrain() until deadline; true if all of it finished.
+        virtual bool awaitDrained(CLOCK::time_point deadline) = 0;
+    };
+
+    struct Result {
+        unsigned int participants = 0;
+        unsigned int drained = 0;
+        unsigned int timedOut = 0;
+        std::chrono::microseconds elapsed{0};
+    };
+
+    // Process-wide coordinator; never destroyed, so stores owned by statics can withdraw during exit
+    static ShutdownCoordinator& shared();
+
+    ShutdownCoordinator() = default;
+    ShutdownCoordinator(const ShutdownCoordinator&) = delete;
+    ShutdownCoordinator& operator=(const ShutdownCoordinator&) = delete;
+
+    // A participant withdraws before it is destroyed. withdraw() waits while a drain() in progress
+    // still has that participant in hand, so it may not be called from inside a Participant callback.
+    void enroll(Participant* participant);
+    void withdraw(Participant* participant);
+
+    Result drain(std::chrono::milliseconds budget = DEFAULT_BUDGET);
+
+private:
+    // done with participant for this drain; wakes a withdraw() waiting on it
+    void release(Participant* participant);
+
+    std::mutex _participantsMutex;
+    std::condition_variable _drainedSignaler;
+    std::vector<Participant*> _participants;
+    std::multiset<Participant*> _draining; // one entry per drain() still using the participant
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_SHUTDOWNCOORDINATOR_HPP
@@ -24,7 +24,7 @@ namespace NewRelic {
         friend std::ostream& operator<<(std::ostream& os, const String& dt);
         virtual bool equal(const BaseValue& value) const;
         friend bool operator==(const String& rhs, const String& lhs);
-        const std::string getValue();
+        const std::string& getValue() const;
     };
 }
 #endif
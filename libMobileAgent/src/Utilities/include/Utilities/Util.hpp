@@ -9,6 +9,8 @@
 
 #include <string>
 #include <map>
+#include <cstddef>
+#include <cstdint>
 
 namespace NewRelic {
     class Util {
@@ -24,6 +26,45 @@ namespace NewRelic {
             //throws std::out_of_range, std::length_error
             static std::string& replaceCharactersInString(std::string& string,const std::map<std::string,std::string>& replacementMap);
         };
+
+        // little-endian fixed width integers for the binary store formats
+        class Bytes {
+        public:
+            static void writeUInt32(char* bytes, uint32_t value) {
+                for (int i = 0; i < 4; i++) {
+                    bytes[i] = (char)((value >> (8 * i)) & 0xFF);
+                }
+            }
+
+            static void appendUInt32(std::string& out, uint32_t value) {
+                char bytes[4];
+                writeUInt32(bytes, value);
+                out.append(bytes, 4);
+            }
+
+            static void appendUInt64(std::string& out, uint64_t value) {
+                char bytes[8];
+                for (int i = 0; i < 8; i++) {
+                    bytes[i] = (char)((value >> (8 * i)) & 0xFF);
+                }
+                out.append(bytes, 8);
+            }
+
+            static uint32_t readUInt32(const char* bytes) {
+                const unsigned char* b = (const unsigned char*)bytes;
+                return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+            }
+
+            static uint64_t readUInt64(const char* bytes) {
+                return (uint64_t)readUInt32(bytes) | ((uint64_t)readUInt32(bytes + 4) << 32);
+            }
+        };
+
+        class Checksum {
+        public:
+            // CRC-32 (IEEE 802.3). pass a previous result as crc to checksum data in pieces.
+            static uint32_t crc32(const void* data, std::size_t length, uint32_t crc = 0);
+        };
     };
 }
 #endif //PROJECT_UTIL_HPP
@@ -3,6 +3,8 @@
 #include <Utilities/Number.hpp>
 #include <Utilities/String.hpp>
 #include <Utilities/Boolean.hpp>
+#include <cstddef>
+#include <string>
 
 #ifndef __Value_H_
 #define __Value_H_
@@ -20,6 +22,13 @@ namespace NewRelic {
         static std::shared_ptr<Number> createValue(int);
         static std::shared_ptr<Number> createValue(unsigned int);
         static std::shared_ptr<BaseValue> createValue(std::istream& is);
+
+        // Compact binary form used by the persistent stores: a category byte, then the raw value
+        // (string bytes, number bits, bool byte) with none of the iostream text formatting.
+        static void encode(const BaseValue& value, std::string& out);
+        // Reads one encoded value from the front of data and advances data / length past it.
+        // throws std::runtime_error on truncated or unrecognized input.
+        static std::shared_ptr<BaseValue> decode(const char*& data, std::size_t& length);
     };
 
 }
@@ -0,0 +1,119 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_WORKCOMPLETION_HPP
+#define LIBMOBILEAGENT_WORKCOMPLETION_HPP
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <Utilities/IOThreadPool.hpp>
+
+namespace NewRelic {
+// Lets a caller wait for one queued work item rather than for the whole queue.
+// Copies share the same item; a default-constructed WorkCompletion tracks nothing and reads as Dropped.
+// On a thread of the pool the item runs on, wait() doesn't block, as that could hold the very thread the
+// item needs; it returns the status as it is. Such callers run the queue instead, see WorkQueue::synchronize().
+class WorkCompletion {
+    struct State;
+
+public:
+    enum class Status {
+        Pending,
+        Completed,
+        Failed,  // the item threw
+        Dropped  // rejected, cleared, or abandoned when its queue terminated
+    };
+
+    // Held by the queued item: finish() reports the outcome, and an item destroyed without finishing reports Dropped.
+    class Signal {
+    public:
+        // pool: where the item runs, if on a pool
+        explicit Signal(const IOThreadPool* pool = nullptr) : _state(std::make_shared<State>()) {
+            _state->pool = pool;
+        }
+
+        Signal(Signal&&) noexcept = default;
+        Signal& operator=(Signal&&) = delete;
+        Signal(const Signal&) = delete;
+        Signal& operator=(const Signal&) = delete;
+
+        ~Signal() {
+            finish(Status::Dropped);
+        }
+
+        WorkCompletion completion() const {
+            return WorkCompletion(_state);
+        }
+
+        void finish(Status status) {
+            if (_state != nullptr) {
+                _state->set(status);
+                _state.reset();
+            }
+        }
+
+    private:
+        std::shared_ptr<State> _state;
+    };
+
+    WorkCompletion() = default;
+
+    Status status() const {
+        return _state != nullptr ? (Status)_state->status.load() : Status::Dropped;
+    }
+
+    Status wait() const {
+        if (_state == nullptr) {
+            return Status::Dropped;
+        }
+        if (onPool()) {
+            return status();
+        }
+        std::unique_lock<std::mutex> lk(_state->m);
+        _state->finished.wait(lk, [this] { return (Status)_state->status.load() != Status::Pending; });
+        return (Status)_state->status.load();
+    }
+
+    // Pending if the item hasn't finished after timeout_ms
+    Status wait(unsigned int timeout_ms) const {
+        if (_state == nullptr) {
+            return Status::Dropped;
+        }
+        if (onPool()) {
+            return status();
+        }
+        std::unique_lock<std::mutex> lk(_state->m);
+        _state->finished.wait_for(lk, std::chrono::milliseconds(timeout_ms), [this] { return (Status)_state->status.load() != Status::Pending; });
+        return (Status)_state->status.load();
+    }
+
+private:
+    struct State {
+        std::atomic<int> status{(int)Status::Pending};
+        std::mutex m;
+        std::condition_variable finished;
+        const IOThreadPool* pool = nullptr;
+
+        void set(Status value) {
+            {
+                std::lock_guard<std::mutex> lk(m);
+                int pending = (int)Status::Pending;
+                status.compare_exchange_strong(pending, (int)value);
+            }
+            finished.notify_all();
+        }
+    };
+
+    explicit WorkCompletion(std::shared_ptr<State> state) : _state(std::move(state)) {}
+
+    bool onPool() const {
+        return _state->pool != nullptr && _state->pool->runsCurrentThread();
+    }
+
+    std::shared_ptr<State> _state;
+};
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_WORKCOMPLETION_HPP
@@ -0,0 +1,144 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef LIBMOBILEAGENT_WORKITEM_HPP
+#define LIBMOBILEAGENT_WORKITEM_HPP
+
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace NewRelic {
+// A move-only void() callable. Callables of up to INLINE_SIZE bytes (a lambda capturing a few
+// pointers, or an std::function) are stored inline; larger ones are moved to the heap.
+class WorkItem {
+public:
+    static const std::size_t INLINE_SIZE = 48;
+
+    WorkItem() noexcept : _ops(nullptr) {}
+
+    template<typename F,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, WorkItem>::value>::type>
+    WorkItem(F&& f) : _ops(nullptr) {
+        typedef typename std::decay<F>::type FN;
+        emplace<FN>(std::forward<F>(f), std::integral_constant<bool, fitsInline<FN>()>());
+    }
+
+    WorkItem(WorkItem&& other) noexcept : _ops(nullptr) {
+        moveFrom(other);
+    }
+
+    WorkItem& operator=(WorkItem&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    WorkItem(const WorkItem&) = delete;
+    WorkItem& operator=(const WorkItem&) = delete;
+
+    ~WorkItem() {
+        reset();
+    }
+
+    void operator()() {
+        _ops->invoke(&_storage);
+    }
+
+    explicit operator bool() const noexcept {
+        return _ops != nullptr;
+    }
+
+    void reset() noexcept {
+        if (_ops != nullptr) {
+            _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (* invoke)(void*);
+        void (* relocate)(void* to, void* from) noexcept; // move-constructs into `to`, destroys `from`
+        void (* destroy)(void*) noexcept;
+    };
+
+    template<typename FN>
+    static constexpr bool fitsInline() {
+        return sizeof(FN) <= INLINE_SIZE
+               && alignof(FN) <= alignof(std::max_align_t)
+               && std::is_nothrow_move_constructible<FN>::value;
+    }
+
+    template<typename FN, typename F>
+    void emplace(F&& f,
+                 std::true_type /* inline */) {
+        ::new (static_cast<void*>(&_storage)) FN(std::forward<F>(f));
+        _ops = &InlineOps<FN>::ops;
+    }
+
+    template<typename FN, typename F>
+    void emplace(F&& f,
+                 std::false_type /* inline */) {
+        ::new (static_cast<void*>(&_storage)) FN*(new FN(std::forward<F>(f)));
+        _ops = &HeapOps<FN>::ops;
+    }
+
+    template<typename FN>
+    struct InlineOps {
+        static void invoke(void* p) {
+            (*static_cast<FN*>(p))();
+        }
+
+        static void relocate(void* to, void* from) noexcept {
+            ::new (to) FN(std::move(*static_cast<FN*>(from)));
+            static_cast<FN*>(from)->~FN();
+        }
+
+        static void destroy(void* p) noexcept {
+            static_cast<FN*>(p)->~FN();
+        }
+
+        static constexpr Ops ops = {&invoke, &relocate, &destroy};
+    };
+
+    template<typename FN>
+    struct HeapOps {
+        static void invoke(void* p) {
+            (**static_cast<FN**>(p))();
+        }
+
+        static void relocate(void* to, void* from) noexcept {
+            ::new (to) FN*(*static_cast<FN**>(from));
+        }
+
+        static void destroy(void* p) noexcept {
+            delete *static_cast<FN**>(p);
+        }
+
+        static constexpr Ops ops = {&invoke, &relocate, &destroy};
+    };
+
+    void moveFrom(WorkItem& other) noexcept {
+        if (other._ops != nullptr) {
+            other._ops->relocate(&_storage, &other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type _storage;
+    const Ops* _ops;
+};
+
+// definitions of the ops tables, which C++14 still needs out of class
+template<typename FN>
+constexpr WorkItem::Ops WorkItem::InlineOps<FN>::ops;
+
+template<typename FN>
+constexpr WorkItem::Ops WorkItem::HeapOps<FN>::ops;
+} // namespace NewRelic
+#endif //LIBMOBILEAGENT_WORKITEM_HPP
@@ -2,38 +2,179 @@
 #define LIBMOBILEAGENT_WORKQUEUE_HPP
 
 #pragma once
-#include <queue>
-#include <functional>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
 #include <future>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <Utilities/BoundedMPSCQueue.hpp>
+#include <Utilities/IOThreadPool.hpp>
+#include <Utilities/LatencyHistogram.hpp>
+#include <Utilities/WorkCompletion.hpp>
+#include <Utilities/WorkItem.hpp>
 
 namespace NewRelic {
+// Runs work items one at a time on a worker thread of its own or, given a pool, as a strand on the
+// pool's threads. Items run in enqueue order within a Priority; higher priorities go first, except that an
+// item given a deadline jumps ahead of the other priorities once the deadline has passed.
+// enqueue() takes no lock while the ring has room; what happens once it is full is set by the OverflowPolicy.
+// Called on a thread of the queue's own pool, synchronize() doesn't wait for the pool: that could hold
+// the very thread the queue needs. The caller runs the queue itself whenever no other thread has it.
 class WorkQueue {
 public:
-    WorkQueue();
+    enum class OverflowPolicy {
+        Spill,  // keep the item in an unbounded, locked overflow list until the ring drains
+        Reject  // drop the item; enqueue() returns false
+    };
+
+    enum class Priority {
+        Control,    // clears, loads and other work something is waiting on
+        Normal,     // flushes
+        Background  // compaction and other housekeeping
+    };
+
+    // Counters since the queue was created; durations are in microseconds.
+    struct Statistics {
+        uint64_t enqueued = 0;
+        uint64_t executed = 0;
+        uint64_t failed = 0;   // executed, but threw
+        uint64_t rejected = 0; // refused by OverflowPolicy::Reject, or enqueued after terminate()
+        uint64_t cleared = 0;  // dropped by clearQueue()
+        uint64_t depth = 0;    // waiting to start right now
+        uint64_t maxDepth = 0;
+        LatencyHistogram::Snapshot queueWait; // enqueue() to start
+        LatencyHistogram::Snapshot runTime;
+        LatencyHistogram::Snapshot synchronizeWait;
+
+        void merge(const Statistics& other);
+    };
+
+    // terminate() outcomes across every queue in the process; the queues themselves are usually gone by the time anyone asks.
+    struct TerminationStatistics {
+        uint64_t terminations = 0;
+        uint64_t timedOut = 0;  // terminate(timeout_ms) gave up waiting for the running item
+        uint64_t abandoned = 0; // items still queued when their queue terminated
+        LatencyHistogram::Snapshot wait;
+    };
+
+    static const std::size_t DEFAULT_CAPACITY = 256;
+    // items taken off the queue together and run before synchronize() waiters are signalled;
+    // a drain batch size of 1 takes and signals item by item
+    static const std::size_t DEFAULT_DRAIN_BATCH_SIZE = 32;
+    // items a pool thread runs from one queue before giving the other queues a turn
+    static const std::size_t POOL_BATCH_SIZE = 64;
+
+    explicit WorkQueue(std::size_t capacity = DEFAULT_CAPACITY,
+                       OverflowPolicy policy = OverflowPolicy::Spill,
+                       IOThreadPool* pool = nullptr,
+                       std::size_t drainBatchSize = DEFAULT_DRAIN_BATCH_SIZE);
     ~WorkQueue();
 
-    void enqueue(std::function<void()> workItem);
+    bool enqueue(WorkItem workItem,
+                 Priority priority = Priority::Normal); // false if the item was rejected or the queue terminated
+    // startWithin: once it has waited this long, the item runs ahead of the other priorities
+    bool enqueue(WorkItem workItem,
+                 Priority priority,
+                 std::chrono::milliseconds startWithin);
+    // As enqueue(), returning a completion that can be waited on for this item alone
+    WorkCompletion enqueueTracked(WorkItem workItem,
+                                  Priority priority = Priority::Normal);
     void clearQueue();
     bool isEmpty();
     void synchronize();          // Wait until all queued work finished (no timeout - CAUTION: may block indefinitely)
     bool synchronize(unsigned int timeout_ms);  // Wait with timeout, returns true if completed, false if timed out
+                                                // (or at once, called from one of this queue's own pooled items)
     void terminate();            // Explicit shutdown (DEPRECATED: blocks indefinitely)
     bool terminate(unsigned int timeout_ms);    // Shutdown with timeout, returns true if joined, false if detached
 
+    Statistics getStatistics() const;
+    static TerminationStatistics getTerminationStatistics();
+
 private:
+    friend class IOThreadPool;
+
+    typedef std::chrono::steady_clock::time_point DEADLINE_T;
+
+    struct Task {
+        WorkItem workItem;
+        DEADLINE_T deadline = DEADLINE_T::max();
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    // One FIFO per priority, each a ring with its own overflow list.
+    struct Lane {
+        explicit Lane(std::size_t capacity) : ring(capacity), spilling(false) {}
+
+        BoundedMPSCQueue<Task> ring;
+        std::deque<Task> overflow;
+        std::mutex overflowMutex;
+        std::atomic<bool> spilling;
+    };
+
+    static const std::size_t LANE_COUNT = 3;
+
+    bool push(Task& task,
+              Priority priority);
+    bool publish(Task& task,
+                 Priority priority);
+    Lane* select(DEADLINE_T now,
+                 bool& overdue);
+    static Task* front(Lane& lane);
+    static bool pop(Lane& lane,
+                    Task& task);
+
     void task_thread();
+    void runScheduled();
+    std::size_t drain(std::size_t limit);
+    std::size_t take(std::size_t limit, unsigned int& clears);
+    bool awaitReleased(const std::chrono::milliseconds* timeout);
+    bool runHere(const DEADLINE_T* deadline);
+    bool claim();
+    void finished(std::size_t count);
+    void abandonQueued();
+    void awaitPushes();
+    std::size_t dropQueued();
+    void recordTermination(std::chrono::steady_clock::time_point start,
+                           bool completed);
+
+    std::array<std::unique_ptr<Lane>, LANE_COUNT> _lanes;
+    const OverflowPolicy _policy;
+    std::atomic<std::size_t> _deadlines; // queued items with a deadline
+    std::mutex _consumerMutex;   // one consumer at a time: the worker, or clearQueue()
+    const std::size_t _drainBatchSize;
+    std::vector<Task> _batch; // taken off the queue and not yet run; only touched by whoever runs the queue
+    std::atomic<unsigned int> _clears; // bumped by clearQueue(), which also drops the rest of the batch in hand
+
+    std::atomic<std::size_t> _queued;     // enqueued, not yet started (or dropped) by the worker
+    std::atomic<std::size_t> _unfinished; // enqueued, not yet run to completion
+    std::atomic<bool> _sleeping;  // dedicated worker only
+    IOThreadPool* const _pool;
+    std::atomic<bool> _scheduled; // pool only: handed to the pool and not yet given back (guarded by _threadMutex when cleared)
+    std::atomic<unsigned int> _idleWaiters;
+    std::atomic<unsigned int> _pushing; // push() calls past their shouldTerminate check and not yet returned
+
+    std::atomic<uint64_t> _enqueued;
+    std::atomic<uint64_t> _executed;
+    std::atomic<uint64_t> _failed;
+    std::atomic<uint64_t> _rejected;
+    std::atomic<uint64_t> _cleared;
+    std::atomic<uint64_t> _maxDepth;
+    std::atomic<uint64_t> _abandoned;       // dropped by terminate(), from the queue or from a batch in hand
+    std::atomic<bool> _terminationRecorded; // only the first terminate() counts
+    LatencyHistogram _queueWait;
+    LatencyHistogram _runTime;
+    LatencyHistogram _synchronizeWait;
 
-    std::queue<std::function<void()>> _queue;
-    std::recursive_mutex _queueMutex;
     std::mutex _threadMutex;
     std::condition_variable taskSignaler;
+    std::mutex _idleMutex;
+    std::condition_variable idleSignaler;
     std::future<void> worker;
     std::atomic<bool> shouldTerminate;
-    std::atomic<bool> executing;
-    bool queueReady;
 };
 } // namespace NewRelic
 #endif //LIBMOBILEAGENT_WORKQUEUE_HPP
@@ -0,0 +1,137 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Utilities/IOThreadPool.hpp"
+#include "Utilities/WorkQueue.hpp"
+#include <algorithm>
+
+namespace NewRelic {
+    namespace {
+        // the pool the calling thread belongs to, if any
+        thread_local const IOThreadPool* currentPool = nullptr;
+    }
+
+    IOThreadPool& IOThreadPool::shared() {
+        // leaked: stores and controllers with static lifetime still hand it work while statics are destroyed
+        static IOThreadPool* pool = new IOThreadPool();
+        return *pool;
+    }
+
+    IOThreadPool::IOThreadPool(unsigned int threadCount) : _stopping(false) {
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        _threads.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; i++) {
+            _threads.emplace_back(&IOThreadPool::run, this);
+        }
+    }
+
+    IOThreadPool::~IOThreadPool() {
+        {
+            std::lock_guard<std::mutex> readyLock(_readyMutex);
+            _stopping = true;
+        }
+        _readySignaler.notify_all();
+        for (auto& thread : _threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    unsigned int IOThreadPool::getThreadCount() const {
+        return (unsigned int)_threads.size();
+    }
+
+    bool IOThreadPool::runsCurrentThread() const {
+        return currentPool == this;
+    }
+
+    void IOThreadPool::schedule(WorkQueue* queue) {
+        {
+            std::lock_guard<std::mutex> readyLock(_readyMutex);
+            _ready.push_back(queue);
+        }
+        _readySignaler.notify_one();
+    }
+
+    void IOThreadPool::scheduleAt(const void* owner,
+                                  CLOCK::time_point at,
+                                  std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> readyLock(_readyMutex);
+            _timers.emplace(at, Timer{owner, std::move(callback)});
+        }
+        // a waiting thread may be sleeping until a later timer
+        _readySignaler.notify_all();
+    }
+
+    void IOThreadPool::cancelTimers(const void* owner) {
+        std::unique_lock<std::mutex> readyLock(_readyMutex);
+        for (auto it = _timers.begin(); it != _timers.end();) {
+            if (it->second.owner == owner) {
+                it = _timers.erase(it);
+            } else {
+                it++;
+            }
+        }
+        _firedSignaler.wait(readyLock, [this, owner] { return _firing.count(owner) == 0; });
+    }
+
+    bool IOThreadPool::cancel(WorkQueue* queue) {
+        std::lock_guard<std::mutex> readyLock(_readyMutex);
+        auto it = std::find(_ready.begin(), _ready.end(), queue);
+        if (it == _ready.end()) {
+            return false;
+        }
+        _ready.erase(it);
+        return true;
+    }
+
+    void IOThreadPool::run() {
+        currentPool = this;
+        while (true) {
+            WorkQueue* queue = nullptr;
+            Timer timer{nullptr, nullptr};
+            {
+                std::unique_lock<std::mutex> readyLock(_readyMutex);
+                while (true) {
+                    // queues handed over before the pool stopped still get their turn
+                    if (!_ready.empty()) {
+                        queue = _ready.front();
+                        _ready.pop_front();
+                        break;
+                    }
+                    if (!_timers.empty() && _timers.begin()->first <= CLOCK::now()) {
+                        timer = std::move(_timers.begin()->second);
+                        _timers.erase(_timers.begin());
+                        _firing.insert(timer.owner);
+                        break;
+                    }
+                    if (_stopping) {
+                        return;
+                    }
+                    if (_timers.empty()) {
+                        _readySignaler.wait(readyLock);
+                    } else {
+                        _readySignaler.wait_until(readyLock, _timers.begin()->first);
+                    }
+                }
+            }
+            if (queue != nullptr) {
+                queue->runScheduled();
+                continue;
+            }
+            try {
+                timer.callback();
+            } catch (...) {
+                // swallow exceptions
+            }
+            {
+                std::lock_guard<std::mutex> readyLock(_readyMutex);
+                _firing.erase(_firing.find(timer.owner));
+            }
+            _firedSignaler.notify_all();
+        }
+    }
+}
@@ -0,0 +1,96 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Utilities/LatencyHistogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace NewRelic {
+    LatencyHistogram::LatencyHistogram() : _count(0),
+                                           _sum(0),
+                                           _max(0) {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Values below SUB_BUCKETS get a bucket each. Above that, the bucket is picked by the position of
+    // the highest set bit and the SUB_BUCKET_BITS bits under it.
+    std::size_t LatencyHistogram::bucketOf(uint64_t micros) {
+        if (micros < SUB_BUCKETS) {
+            return (std::size_t)micros;
+        }
+        unsigned int exponent = 63 - (unsigned int)__builtin_clzll(micros);
+        if (exponent > MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
+        const uint64_t sub = (micros >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + (std::size_t)sub;
+    }
+
+    uint64_t LatencyHistogram::highestValueIn(std::size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        const unsigned int exponent = (unsigned int)(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+        const uint64_t sub = bucket % SUB_BUCKETS;
+        const uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+        return (1ull << exponent) + (sub + 1) * width - 1;
+    }
+
+    void LatencyHistogram::record(uint64_t micros) {
+        _buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(micros, std::memory_order_relaxed);
+        uint64_t max = _max.load(std::memory_order_relaxed);
+        while (micros > max && !_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Taken while other threads record, so the totals can be a sample or two apart from the buckets.
+    LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+        Snapshot snapshot;
+        snapshot.buckets.resize(BUCKET_COUNT);
+        for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+            snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.count = _count.load(std::memory_order_relaxed);
+        snapshot.sum = _sum.load(std::memory_order_relaxed);
+        snapshot.max = _max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    uint64_t LatencyHistogram::Snapshot::percentile(double percentile) const {
+        uint64_t total = 0;
+        for (uint64_t bucket : buckets) {
+            total += bucket;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(std::min(percentile, 100.0) / 100.0 * (double)total));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return std::min(highestValueIn(i), max);
+            }
+        }
+        return max;
+    }
+
+    double LatencyHistogram::Snapshot::mean() const {
+        return count == 0 ? 0.0 : (double)sum / (double)count;
+    }
+
+    void LatencyHistogram::Snapshot::merge(const Snapshot& other) {
+        if (buckets.size() < other.buckets.size()) {
+            buckets.resize(other.buckets.size());
+        }
+        for (std::size_t i = 0; i < other.buckets.size(); i++) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+}
@@ -0,0 +1,81 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Utilities/MappedFile.hpp"
+#include "Utilities/libLogger.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace NewRelic {
+    MappedFile::MappedFile(const char* path) : _data(nullptr),
+                                               _size(0),
+                                               _mapped(false),
+                                               _readable(true) {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            if (errno != ENOENT) {
+                _readable = false;
+                LLOG_VERBOSE("Failed to open \"%s\". Errno: %d", path, errno);
+            }
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            _readable = false;
+            LLOG_VERBOSE("Failed to stat \"%s\". Errno: %d", path, errno);
+        } else if (!S_ISREG(st.st_mode)) {
+            _readable = false;
+            LLOG_VERBOSE("\"%s\" is not a regular file.", path);
+        } else if (st.st_size > 0) {
+            void* region = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (region != MAP_FAILED) {
+                _data = static_cast<const char*>(region);
+                _size = (std::size_t)st.st_size;
+                _mapped = true;
+            } else {
+                LLOG_VERBOSE("Failed to map \"%s\", reading it instead. Errno: %d", path, errno);
+                _readable = readAll(fd, (std::size_t)st.st_size);
+            }
+        }
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (_mapped) {
+            munmap(const_cast<char*>(_data), _size);
+        }
+    }
+
+    bool MappedFile::readAll(int fd, std::size_t size) {
+        try {
+            _buffer.resize(size);
+        } catch (std::exception&) {
+            LLOG_VERBOSE("Failed to allocate %zu bytes to read a file into.", size);
+            return false;
+        }
+        std::size_t done = 0;
+        while (done < size) {
+            ssize_t n = read(fd, &_buffer[done], size - done);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n == -1) {
+                LLOG_VERBOSE("Failed to read file. Errno: %d", errno);
+                _buffer.clear();
+                return false;
+            }
+            if (n == 0) {
+                // the file got shorter since fstat
+                break;
+            }
+            done += (std::size_t)n;
+        }
+        _buffer.resize(done);
+        _data = _buffer.data();
+        _size = _buffer.size();
+        return true;
+    }
+}
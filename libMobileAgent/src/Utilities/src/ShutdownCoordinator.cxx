@@ -0,0 +1,75 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include "Utilities/ShutdownCoordinator.hpp"
+#include "Utilities/libLogger.hpp"
+#include <algorithm>
+
+namespace NewRelic {
+    const std::chrono::milliseconds ShutdownCoordinator::DEFAULT_BUDGET(1500);
+
+    ShutdownCoordinator& ShutdownCoordinator::shared() {
+        static ShutdownCoordinator* coordinator = new ShutdownCoordinator();
+        return *coordinator;
+    }
+
+    void ShutdownCoordinator::enroll(Participant* participant) {
+        std::lock_guard<std::mutex> participantsLock(_participantsMutex);
+        _participants.push_back(participant);
+    }
+
+    void ShutdownCoordinator::withdraw(Participant* participant) {
+        std::unique_lock<std::mutex> participantsLock(_participantsMutex);
+        _participants.erase(std::remove(_participants.begin(), _participants.end(), participant), _participants.end());
+        _drainedSignaler.wait(participantsLock, [this, participant] { return _draining.count(participant) == 0; });
+    }
+
+    void ShutdownCoordinator::release(Participant* participant) {
+        std::lock_guard<std::mutex> participantsLock(_participantsMutex);
+        _draining.erase(_draining.find(participant));
+        _drainedSignaler.notify_all();
+    }
+
+    // Participants are copied out and marked as draining, so the lock isn't held while waiting on them;
+    // one withdrawing meanwhile waits only until its own wait is over, which the deadline bounds.
+    ShutdownCoordinator::Result ShutdownCoordinator::drain(std::chrono::milliseconds budget) {
+        const auto start = CLOCK::now();
+        const auto deadline = start + budget;
+        Result result;
+
+        std::vector<Participant*> participants;
+        {
+            std::lock_guard<std::mutex> participantsLock(_participantsMutex);
+            participants = _participants;
+            _draining.insert(participants.begin(), participants.end());
+        }
+        result.participants = (unsigned int)participants.size();
+        for (auto participant : participants) {
+            try {
+                participant->beginDrain();
+            } catch (...) {
+                LLOG_VERBOSE("Failed to start draining a shutdown participant.");
+            }
+        }
+        for (auto participant : participants) {
+            bool drained = false;
+            try {
+                drained = participant->awaitDrained(deadline);
+            } catch (...) {
+                LLOG_VERBOSE("Failed to drain a shutdown participant.");
+            }
+            release(participant);
+            if (drained) {
+                result.drained++;
+            } else {
+                result.timedOut++;
+            }
+        }
+
+        result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(CLOCK::now() - start);
+        if (result.timedOut > 0) {
+            LLOG_VERBOSE("Shutdown drain ran out of its %lld ms budget; %u of %u participants still busy.",
+                         (long long)budget.count(), result.timedOut, result.participants);
+        }
+        return result;
+    }
+}
@@ -47,7 +47,7 @@ namespace NewRelic {
         return this->_value == sValue->_value;
     }
 
-    const std::string String::getValue() {
+    const std::string& String::getValue() const {
         return _value;
     }
 
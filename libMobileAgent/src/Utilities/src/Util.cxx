@@ -4,6 +4,7 @@
 //
 
 #include "Utilities/Util.hpp"
+#include <array>
 
 namespace NewRelic {
 
@@ -73,4 +74,25 @@ namespace NewRelic {
     std::string& NewRelic::Util::Strings::escapeCharacterLiterals(std::string&& s) {
         return escapeCharacterLiterals(s);
     }
+
+    uint32_t NewRelic::Util::Checksum::crc32(const void* data, std::size_t length, uint32_t crc) {
+        static const auto table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        auto bytes = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+        for (std::size_t i = 0; i < length; i++) {
+            crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
 }
@@ -1,7 +1,10 @@
 //  Copyright © 2023 New Relic. All rights reserved.
 
 #include "Utilities/Value.hpp"
+#include "Utilities/Util.hpp"
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 namespace NewRelic {
     //std::bad_alloc may throw
@@ -56,4 +59,85 @@ namespace NewRelic {
         //std::make_shared can throw std::bad_alloc
         return std::make_shared<Number>(Number((unsigned long long)value));
     }
+
+    //WARNING: these bytes are persisted; don't renumber them.
+    static const char __kEncodedString = 's';
+    static const char __kEncodedDouble = 'd';
+    static const char __kEncodedLong = 'l';
+    static const char __kEncodedUnsignedLong = 'u';
+    static const char __kEncodedBoolean = 'b';
+
+    void Value::encode(const BaseValue& value, std::string& out) {
+        switch (value.getCategory()) {
+            case BaseValue::Category::STRING: {
+                const std::string& string = static_cast<const String&>(value)._value;
+                out.push_back(__kEncodedString);
+                Util::Bytes::appendUInt32(out, (uint32_t)string.size());
+                out.append(string);
+                break;
+            }
+            case BaseValue::Category::NUMBER: {
+                const Number& number = static_cast<const Number&>(value);
+                uint64_t bits = 0;
+                switch (number.tag) {
+                    case Number::Tag::DOUBLE:
+                        out.push_back(__kEncodedDouble);
+                        std::memcpy(&bits, &number.dbl, sizeof(bits));
+                        break;
+                    case Number::Tag::LONG:
+                        out.push_back(__kEncodedLong);
+                        bits = (uint64_t)number.ll;
+                        break;
+                    case Number::Tag::U_LONG:
+                        out.push_back(__kEncodedUnsignedLong);
+                        bits = number.ull;
+                        break;
+                }
+                Util::Bytes::appendUInt64(out, bits);
+                break;
+            }
+            case BaseValue::Category::BOOLEAN:
+                out.push_back(__kEncodedBoolean);
+                out.push_back(static_cast<const Boolean&>(value).getValue() ? 1 : 0);
+                break;
+        }
+    }
+
+    std::shared_ptr<BaseValue> Value::decode(const char*& data, std::size_t& length) {
+        auto take = [&data, &length](std::size_t count) {
+            if (length < count) {
+                throw std::runtime_error("truncated value.");
+            }
+            const char* bytes = data;
+            data += count;
+            length -= count;
+            return bytes;
+        };
+
+        const char type = *take(1);
+        switch (type) {
+            case __kEncodedString: {
+                const uint32_t size = Util::Bytes::readUInt32(take(4));
+                const char* bytes = take(size);
+                // already escaped when it was created; createValue(const char*) would escape it again
+                auto string = std::make_shared<String>(String(""));
+                string->_value.assign(bytes, size);
+                return string;
+            }
+            case __kEncodedDouble: {
+                const uint64_t bits = Util::Bytes::readUInt64(take(8));
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return std::make_shared<Number>(Number(value));
+            }
+            case __kEncodedLong:
+                return std::make_shared<Number>(Number((__int64_t)Util::Bytes::readUInt64(take(8))));
+            case __kEncodedUnsignedLong:
+                return std::make_shared<Number>(Number((__uint64_t)Util::Bytes::readUInt64(take(8))));
+            case __kEncodedBoolean:
+                return std::make_shared<Boolean>(Boolean(*take(1) != 0));
+            default:
+                throw std::runtime_error("unrecognized encoded value.");
+        }
+    }
 }
@@ -5,114 +5,576 @@
 
 #include "Utilities/WorkQueue.hpp"
 #include "Utilities/libLogger.hpp"
+#include <algorithm>
+#include <thread>
 
 namespace NewRelic {
-    WorkQueue::WorkQueue()  : shouldTerminate(false),
-                              executing(false),
-                              queueReady(false) {
-        worker = std::async(std::launch::async, &WorkQueue::task_thread, this);
+    namespace {
+        struct Terminations {
+            std::atomic<uint64_t> terminations{0};
+            std::atomic<uint64_t> timedOut{0};
+            std::atomic<uint64_t> abandoned{0};
+            LatencyHistogram wait;
+        };
+
+        // never destroyed: queues owned by static objects terminate during exit
+        Terminations& terminations() {
+            static Terminations* terminations = new Terminations();
+            return *terminations;
+        }
+
+        // the queues whose items the calling thread is inside, innermost first
+        struct Running {
+            const WorkQueue* queue;
+            const Running* outer;
+        };
+        thread_local const Running* currentRunning = nullptr;
+
+        class RunningScope {
+        public:
+            explicit RunningScope(const WorkQueue* queue) : _running{queue, currentRunning} {
+                currentRunning = &_running;
+            }
+
+            ~RunningScope() {
+                currentRunning = _running.outer;
+            }
+
+        private:
+            Running _running;
+        };
+
+        bool runsOnThisThread(const WorkQueue* queue) {
+            for (const Running* running = currentRunning; running != nullptr; running = running->outer) {
+                if (running->queue == queue) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    WorkQueue::WorkQueue(std::size_t capacity,
+                         OverflowPolicy policy,
+                         IOThreadPool* pool,
+                         std::size_t drainBatchSize) : _policy(policy),
+                                                       _deadlines(0),
+                                                       _drainBatchSize(drainBatchSize > 0 ? drainBatchSize : 1),
+                                                       _clears(0),
+                                                       _queued(0),
+                                                       _unfinished(0),
+                                                       _sleeping(false),
+                                                       _pool(pool),
+                                                       _scheduled(false),
+                                                       _idleWaiters(0),
+                                                       _pushing(0),
+                                                       _enqueued(0),
+                                                       _executed(0),
+                                                       _failed(0),
+                                                       _rejected(0),
+                                                       _cleared(0),
+                                                       _maxDepth(0),
+                                                       _abandoned(0),
+                                                       _terminationRecorded(false),
+                                                       shouldTerminate(false) {
+        // control and housekeeping items are few; they spill (or are rejected) past a small ring
+        const std::size_t sideCapacity = std::max<std::size_t>(capacity / 16, 8);
+        _lanes[(int)Priority::Control].reset(new Lane(sideCapacity));
+        _lanes[(int)Priority::Normal].reset(new Lane(capacity));
+        _lanes[(int)Priority::Background].reset(new Lane(sideCapacity));
+        _batch.reserve(_drainBatchSize);
+        if (_pool == nullptr) {
+            worker = std::async(std::launch::async, &WorkQueue::task_thread, this);
+        }
     }
 
 
     void WorkQueue::task_thread() {
         while (!shouldTerminate.load()) {
-            {
-                std::unique_lock<std::mutex> threadLock(_threadMutex);
-                if (!queueReady) {
-                    taskSignaler.wait(threadLock, [this] { return queueReady || shouldTerminate.load(); });
-                    continue;
-                }
-                threadLock.unlock();
-            }
-            std::unique_lock<std::recursive_mutex> queueLock(_queueMutex);
-            if(!_queue.empty()) {
-                auto f = _queue.front();
-                _queue.pop();
-                executing.store(true);
-                queueLock.unlock();
-                try {
-                    f();
-                } catch (std::exception& e) {
-                    // swallow exceptions
-                } catch (...) {
-                    // swallow exceptions
+            if (drain(_drainBatchSize) > 0) {
+                continue;
+            }
+
+            if (_queued.load() > 0) {
+                // a producer has counted its item but not published it yet
+                std::this_thread::yield();
+                continue;
+            }
+
+            // _sleeping is set before _queued is checked, and enqueue() bumps _queued before checking
+            // _sleeping, so at least one side sees the other and an item never waits on a sleeping worker.
+            std::unique_lock<std::mutex> threadLock(_threadMutex);
+            _sleeping.store(true);
+            taskSignaler.wait(threadLock, [this] { return _queued.load() > 0 || shouldTerminate.load(); });
+            _sleeping.store(false);
+        }
+    }
+
+    // Called on a pool thread. Runs up to POOL_BATCH_SIZE items, then either goes back on the pool's
+    // list or, with nothing left, hands the queue back so the next enqueue() schedules it again.
+    void WorkQueue::runScheduled() {
+        std::size_t ran = 0;
+        {
+            RunningScope running(this);
+            while (ran < POOL_BATCH_SIZE && !shouldTerminate.load()) {
+                const std::size_t drained = drain(std::min(_drainBatchSize, POOL_BATCH_SIZE - ran));
+                if (drained == 0) {
+                    break;
                 }
+                ran += drained;
+            }
+        }
 
-                executing.store(false);
-                // Notify any waiting synchronize() calls
+        bool reschedule = false;
+        {
+            // cleared under the lock: terminate() may destroy the queue as soon as it sees _scheduled false
+            std::lock_guard<std::mutex> threadLock(_threadMutex);
+            _scheduled.store(false);
+            // same pairing as the dedicated worker's _sleeping: enqueue() bumps _queued before it tests _scheduled
+            if (!shouldTerminate.load() && _queued.load() > 0) {
+                reschedule = !_scheduled.exchange(true);
+            }
+            if (!reschedule) {
                 taskSignaler.notify_all();
-            } else {
-                queueReady = false;
-                queueLock.unlock();
             }
         }
+        if (reschedule) {
+            if (ran == 0) {
+                // a producer has counted its item but not published it yet
+                std::this_thread::yield();
+            }
+            _pool->schedule(this);
+        }
+    }
+
+    // Takes up to limit items and runs them, then signals synchronize() once for the whole batch.
+    // Returns the number of items taken.
+    std::size_t WorkQueue::drain(std::size_t limit) {
+        unsigned int clears;
+        const std::size_t taken = take(limit, clears);
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < taken; i++) {
+            _queued.fetch_sub(1);
+            if (shouldTerminate.load() || _clears.load() != clears) {
+                // dropped like the items still in the queue
+                (shouldTerminate.load() ? _abandoned : _cleared).fetch_add(1);
+                continue;
+            }
+            _queueWait.record(now - _batch[i].enqueued);
+            try {
+                _batch[i].workItem();
+            } catch (std::exception& e) {
+                // swallow exceptions
+                _failed.fetch_add(1);
+            } catch (...) {
+                // swallow exceptions
+                _failed.fetch_add(1);
+            }
+            // release the captures before synchronize() can return
+            _batch[i].workItem.reset();
+            const auto started = now;
+            now = std::chrono::steady_clock::now();
+            _runTime.record(now - started);
+            _executed.fetch_add(1);
+        }
+        _batch.clear();
+        if (taken > 0) {
+            finished(taken);
+        }
+        return taken;
+    }
+
+    // Moves up to limit of the oldest items of the selected priority into _batch; for a lane picked
+    // for an overdue item, only as many items as are overdue.
+    // clears is set to the clearQueue() count the batch was taken under.
+    std::size_t WorkQueue::take(std::size_t limit,
+                                unsigned int& clears) {
+        std::lock_guard<std::mutex> consumerLock(_consumerMutex);
+        clears = _clears.load();
+        const auto now = _deadlines.load() > 0 ? std::chrono::steady_clock::now() : DEADLINE_T::min();
+        bool overdue = false;
+        Lane* lane = select(now, overdue);
+        if (lane == nullptr) {
+            return 0;
+        }
+        Task task;
+        while (_batch.size() < limit) {
+            if (overdue) {
+                Task* head = front(*lane);
+                if (head == nullptr || head->deadline > now) {
+                    break;
+                }
+            }
+            if (!pop(*lane, task)) {
+                break;
+            }
+            if (task.deadline != DEADLINE_T::max()) {
+                _deadlines.fetch_sub(1);
+            }
+            _batch.push_back(std::move(task));
+        }
+        return _batch.size();
+    }
+
+    // The highest priority lane whose oldest item is past its deadline or, failing that, the highest
+    // priority lane with anything in it. Only the oldest item of each lane is checked for a deadline.
+    // callers hold _consumerMutex
+    WorkQueue::Lane* WorkQueue::select(DEADLINE_T now,
+                                       bool& overdue) {
+        if (now != DEADLINE_T::min()) {
+            for (auto& lane : _lanes) {
+                Task* head = front(*lane);
+                if (head != nullptr && head->deadline <= now) {
+                    overdue = true;
+                    return lane.get();
+                }
+            }
+        }
+        for (auto& lane : _lanes) {
+            if (front(*lane) != nullptr) {
+                return lane.get();
+            }
+        }
+        return nullptr;
+    }
+
+    // Items spilled while the ring was full are all newer than the ones already in the ring, so the ring comes first.
+    // callers hold _consumerMutex
+    WorkQueue::Task* WorkQueue::front(Lane& lane) {
+        Task* head = lane.ring.front();
+        if (head == nullptr && lane.spilling.load()) {
+            std::lock_guard<std::mutex> overflowLock(lane.overflowMutex);
+            if (!lane.overflow.empty()) {
+                // producers only push_back, which leaves the front element where it is
+                head = &lane.overflow.front();
+            }
+        }
+        return head;
+    }
+
+    // callers hold _consumerMutex
+    bool WorkQueue::pop(Lane& lane,
+                        Task& task) {
+        if (lane.ring.pop(task)) {
+            return true;
+        }
+        if (!lane.spilling.load()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> overflowLock(lane.overflowMutex);
+        if (lane.overflow.empty()) {
+            return false;
+        }
+        task = std::move(lane.overflow.front());
+        lane.overflow.pop_front();
+        lane.spilling.store(!lane.overflow.empty());
+        return true;
+    }
+
+    void WorkQueue::finished(std::size_t count) {
+        if (_unfinished.fetch_sub(count) == count && _idleWaiters.load() > 0) {
+            std::lock_guard<std::mutex> idleLock(_idleMutex);
+            idleSignaler.notify_all();
+        }
     }
 
     void WorkQueue::clearQueue() {
-        std::lock_guard<std::recursive_mutex> queueLock(_queueMutex);
-        std::queue<std::function<void(void)>> empty;
-        std::swap(_queue, empty);
+        std::size_t dropped;
+        {
+            std::lock_guard<std::mutex> consumerLock(_consumerMutex);
+            dropped = dropQueued();
+            _clears.fetch_add(1);
+        }
+        if (dropped > 0) {
+            _cleared.fetch_add(dropped);
+            _queued.fetch_sub(dropped);
+            finished(dropped);
+        }
+    }
+
+    // terminate() side of clearQueue(): the items left in the queue will never run, so synchronize()
+    // stops waiting for them
+    void WorkQueue::abandonQueued() {
+        std::size_t dropped;
+        {
+            std::lock_guard<std::mutex> consumerLock(_consumerMutex);
+            dropped = dropQueued();
+        }
+        if (dropped > 0) {
+            _abandoned.fetch_add(dropped);
+            _queued.fetch_sub(dropped);
+            finished(dropped);
+        }
+    }
+
+    // Waits out the push() calls that got past shouldTerminate before terminate() set it; they don't block.
+    void WorkQueue::awaitPushes() {
+        while (_pushing.load() > 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Empties every lane and returns how many items were in them.
+    // callers hold _consumerMutex
+    std::size_t WorkQueue::dropQueued() {
+        std::size_t dropped = 0;
+        for (auto& lane : _lanes) {
+            std::size_t withDeadline = 0;
+            Task task;
+            while (lane->ring.pop(task)) {
+                withDeadline += task.deadline != DEADLINE_T::max();
+                dropped++;
+            }
+            std::lock_guard<std::mutex> overflowLock(lane->overflowMutex);
+            for (const auto& spilled : lane->overflow) {
+                withDeadline += spilled.deadline != DEADLINE_T::max();
+            }
+            dropped += lane->overflow.size();
+            lane->overflow.clear();
+            lane->spilling.store(false);
+            _deadlines.fetch_sub(withDeadline);
+        }
+        return dropped;
     }
 
 
     bool WorkQueue::isEmpty() {
-        std::lock_guard<std::recursive_mutex> lk(_queueMutex);
-        return _queue.empty();
+        return _queued.load() == 0;
     }
 
     void WorkQueue::synchronize() {
-        // Use condition variable wait instead of busy-wait loop
-        std::unique_lock<std::mutex> threadLock(_threadMutex);
-        taskSignaler.wait(threadLock, [this] {
-            return isEmpty() && !executing.load();
-        });
+        const auto start = std::chrono::steady_clock::now();
+        if (_pool != nullptr && _pool->runsCurrentThread()) {
+            runHere(nullptr);
+            _synchronizeWait.record(std::chrono::steady_clock::now() - start);
+            return;
+        }
+        _idleWaiters.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> idleLock(_idleMutex);
+            idleSignaler.wait(idleLock, [this] {
+                return _unfinished.load() == 0;
+            });
+        }
+        _idleWaiters.fetch_sub(1);
+        _synchronizeWait.record(std::chrono::steady_clock::now() - start);
     }
 
     bool WorkQueue::synchronize(unsigned int timeout_ms) {
-        // Wait with timeout using condition variable
-        std::unique_lock<std::mutex> threadLock(_threadMutex);
-        return taskSignaler.wait_for(
-            threadLock,
-            std::chrono::milliseconds(timeout_ms),
-            [this] {
-                return isEmpty() && !executing.load();
+        const auto start = std::chrono::steady_clock::now();
+        if (_pool != nullptr && _pool->runsCurrentThread()) {
+            const DEADLINE_T deadline = start + std::chrono::milliseconds(timeout_ms);
+            const bool completed = runHere(&deadline);
+            _synchronizeWait.record(std::chrono::steady_clock::now() - start);
+            return completed;
+        }
+        _idleWaiters.fetch_add(1);
+        bool completed;
+        {
+            std::unique_lock<std::mutex> idleLock(_idleMutex);
+            completed = idleSignaler.wait_for(
+                idleLock,
+                std::chrono::milliseconds(timeout_ms),
+                [this] {
+                    return _unfinished.load() == 0;
+                }
+            );
+        }
+        _idleWaiters.fetch_sub(1);
+        _synchronizeWait.record(std::chrono::steady_clock::now() - start);
+        return completed;
+    }
+
+    // synchronize() on a thread of the queue's own pool: whenever no other thread has the queue, this one
+    // takes it off the pool's list and runs it. Inside one of the queue's own items it can't wait for the
+    // rest, which only run after that item, and returns false at once.
+    bool WorkQueue::runHere(const DEADLINE_T* deadline) {
+        if (runsOnThisThread(this)) {
+            return false;
+        }
+        while (_unfinished.load() > 0) {
+            const auto now = std::chrono::steady_clock::now();
+            if (deadline != nullptr && now >= *deadline) {
+                return false;
+            }
+            if (claim()) {
+                runScheduled();
+                continue;
+            }
+            // another thread runs it; look again once it is done or has handed the queue back to the pool
+            auto wake = now + std::chrono::milliseconds(1);
+            if (deadline != nullptr && *deadline < wake) {
+                wake = *deadline;
+            }
+            _idleWaiters.fetch_add(1);
+            {
+                std::unique_lock<std::mutex> idleLock(_idleMutex);
+                idleSignaler.wait_until(idleLock, wake, [this] {
+                    return _unfinished.load() == 0;
+                });
             }
-        );
+            _idleWaiters.fetch_sub(1);
+        }
+        return true;
+    }
+
+    // Takes the queue for the calling thread, as the pool does before runScheduled(): true if no
+    // thread had it, or if it was waiting on the pool's list and has been taken off.
+    bool WorkQueue::claim() {
+        std::lock_guard<std::mutex> threadLock(_threadMutex);
+        if (shouldTerminate.load()) {
+            return false;
+        }
+        if (!_scheduled.exchange(true)) {
+            return true;
+        }
+        return _pool->cancel(this);
     }
 
 
-    void WorkQueue::enqueue(std::function<void()> workItem){
-        std::lock_guard<std::recursive_mutex> lk(_queueMutex);
-        _queue.push(workItem);
-        {
-            std::lock_guard<std::mutex> _threadLock(_threadMutex);
-            queueReady = true;
+    bool WorkQueue::enqueue(WorkItem workItem,
+                            Priority priority) {
+        Task task{std::move(workItem), DEADLINE_T::max(), std::chrono::steady_clock::now()};
+        return push(task, priority);
+    }
+
+    bool WorkQueue::enqueue(WorkItem workItem,
+                            Priority priority,
+                            std::chrono::milliseconds startWithin) {
+        const auto now = std::chrono::steady_clock::now();
+        Task task{std::move(workItem), now + startWithin, now};
+        return push(task, priority);
+    }
+
+    WorkCompletion WorkQueue::enqueueTracked(WorkItem workItem,
+                                             Priority priority) {
+        WorkCompletion::Signal signal(_pool);
+        WorkCompletion completion = signal.completion();
+        // a rejected or dropped item takes the signal with it, which reports Dropped
+        enqueue([workItem = std::move(workItem), signal = std::move(signal)]() mutable {
+            try {
+                workItem();
+            } catch (...) {
+                workItem.reset();
+                signal.finish(WorkCompletion::Status::Failed);
+                throw;
+            }
+            workItem.reset();
+            signal.finish(WorkCompletion::Status::Completed);
+        }, priority);
+        return completion;
+    }
+
+    // Counted in _pushing before shouldTerminate is checked, and until the item is published and the
+    // queue scheduled. terminate() sets shouldTerminate and then waits for the count to drop, so a push
+    // either sees the flag or is done before abandonQueued() and awaitReleased(): none leaves an item
+    // behind that synchronize() would wait for, or hands the queue to the pool once it is released.
+    bool WorkQueue::push(Task& task,
+                         Priority priority) {
+        _pushing.fetch_add(1);
+        bool pushed = false;
+        try {
+            if (shouldTerminate.load()) {
+                _rejected.fetch_add(1);
+            } else {
+                pushed = publish(task, priority);
+            }
+        } catch (...) {
+            _pushing.fetch_sub(1);
+            throw;
         }
-        taskSignaler.notify_all();
+        _pushing.fetch_sub(1);
+        return pushed;
+    }
+
+    bool WorkQueue::publish(Task& task,
+                            Priority priority) {
+        const bool hasDeadline = task.deadline != DEADLINE_T::max();
+        if (hasDeadline) {
+            _deadlines.fetch_add(1);
+        }
+        _queued.fetch_add(1);
+        _unfinished.fetch_add(1);
+
+        Lane& lane = *_lanes[(int)priority];
+        if (lane.spilling.load() || !lane.ring.push(task)) {
+            switch (_policy) {
+                case OverflowPolicy::Spill: {
+                    std::lock_guard<std::mutex> overflowLock(lane.overflowMutex);
+                    lane.overflow.push_back(std::move(task));
+                    lane.spilling.store(true);
+                    break;
+                }
+                case OverflowPolicy::Reject:
+                    if (hasDeadline) {
+                        _deadlines.fetch_sub(1);
+                    }
+                    _queued.fetch_sub(1);
+                    finished(1);
+                    _rejected.fetch_add(1);
+                    return false;
+            }
+        }
+
+        const uint64_t depth = _queued.load();
+        uint64_t maxDepth = _maxDepth.load(std::memory_order_relaxed);
+        while (depth > maxDepth && !_maxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed)) {
+        }
+
+        if (_pool != nullptr) {
+            if (!_scheduled.exchange(true)) {
+                _pool->schedule(this);
+            }
+        } else if (_sleeping.load()) {
+            std::lock_guard<std::mutex> threadLock(_threadMutex);
+            taskSignaler.notify_one();
+        }
+        _enqueued.fetch_add(1);
+        return true;
     }
 
 
     void WorkQueue::terminate() {
+        const auto start = std::chrono::steady_clock::now();
         {
             std::lock_guard<std::mutex> _threadLock(_threadMutex);
             shouldTerminate.store(true);
         }
         taskSignaler.notify_all();
+        awaitPushes();
+        abandonQueued();
 
-        if (worker.valid()) {
+        if (_pool != nullptr) {
+            awaitReleased(nullptr);
+        } else if (worker.valid()) {
             // This blocks indefinitely - use with caution
             worker.get();
         }
+        recordTermination(start, true);
     }
 
     bool WorkQueue::terminate(unsigned int timeout_ms) {
+        const auto start = std::chrono::steady_clock::now();
         {
             std::lock_guard<std::mutex> _threadLock(_threadMutex);
             shouldTerminate.store(true);
         }
         taskSignaler.notify_all();
+        awaitPushes();
+        abandonQueued();
+
+        if (_pool != nullptr) {
+            const std::chrono::milliseconds timeout(timeout_ms);
+            const bool completed = awaitReleased(&timeout);
+            if (!completed) {
+                LLOG_VERBOSE("WorkQueue terminate timed out after %u ms - pool thread still running an item", timeout_ms);
+            }
+            recordTermination(start, completed);
+            return completed;
+        }
 
         if (!worker.valid()) {
+            recordTermination(start, true);
             return true;
         }
 
@@ -122,19 +584,94 @@ namespace NewRelic {
         if (status == std::future_status::ready) {
             // Worker completed, consume the future value
             worker.get();
+            recordTermination(start, true);
             return true;
         } else {
             // Timeout occurred
             // Note: std::future cannot be detached like std::thread
             // The async task will continue running in the background
             LLOG_VERBOSE("WorkQueue terminate timed out after %u ms - worker will complete asynchronously", timeout_ms);
+            recordTermination(start, false);
             return false;
         }
     }
 
+    // Counts the first terminate() only; the destructor terminates again after an owner already has.
+    // If it timed out, the item then running can still finish or drop more, so the abandoned count is a lower bound.
+    void WorkQueue::recordTermination(std::chrono::steady_clock::time_point start,
+                                      bool completed) {
+        if (_terminationRecorded.exchange(true)) {
+            return;
+        }
+        auto& totals = terminations();
+        totals.terminations.fetch_add(1);
+        if (!completed) {
+            totals.timedOut.fetch_add(1);
+        }
+        totals.abandoned.fetch_add(_abandoned.load() + _queued.load());
+        totals.wait.record(std::chrono::steady_clock::now() - start);
+    }
+
+    WorkQueue::Statistics WorkQueue::getStatistics() const {
+        Statistics statistics;
+        statistics.enqueued = _enqueued.load();
+        statistics.executed = _executed.load();
+        statistics.failed = _failed.load();
+        statistics.rejected = _rejected.load();
+        statistics.cleared = _cleared.load();
+        statistics.depth = _queued.load();
+        statistics.maxDepth = _maxDepth.load();
+        statistics.queueWait = _queueWait.snapshot();
+        statistics.runTime = _runTime.snapshot();
+        statistics.synchronizeWait = _synchronizeWait.snapshot();
+        return statistics;
+    }
+
+    WorkQueue::TerminationStatistics WorkQueue::getTerminationStatistics() {
+        auto& totals = terminations();
+        TerminationStatistics statistics;
+        statistics.terminations = totals.terminations.load();
+        statistics.timedOut = totals.timedOut.load();
+        statistics.abandoned = totals.abandoned.load();
+        statistics.wait = totals.wait.snapshot();
+        return statistics;
+    }
+
+    void WorkQueue::Statistics::merge(const Statistics& other) {
+        enqueued += other.enqueued;
+        executed += other.executed;
+        failed += other.failed;
+        rejected += other.rejected;
+        cleared += other.cleared;
+        depth += other.depth;
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        queueWait.merge(other.queueWait);
+        runTime.merge(other.runTime);
+        synchronizeWait.merge(other.synchronizeWait);
+    }
+
+    // Pool only: waits until no pool thread holds the queue. A queue still waiting on the pool's
+    // list is simply taken off it. Waits indefinitely without a timeout.
+    bool WorkQueue::awaitReleased(const std::chrono::milliseconds* timeout) {
+        std::unique_lock<std::mutex> threadLock(_threadMutex);
+        if (_scheduled.load() && _pool->cancel(this)) {
+            _scheduled.store(false);
+        }
+        auto released = [this] { return !_scheduled.load(); };
+        if (timeout == nullptr) {
+            taskSignaler.wait(threadLock, released);
+            return true;
+        }
+        return taskSignaler.wait_for(threadLock, *timeout, released);
+    }
+
     WorkQueue::~WorkQueue() {
         // Use timeout terminate to avoid indefinite blocking
-        terminate(1000);
+        if (!terminate(1000) && _pool != nullptr) {
+            // a pool thread is still in one of our items and must be done with the queue before it goes away
+            LLOG_VERBOSE("WorkQueue destructor: pool thread still active, waiting for completion");
+            awaitReleased(nullptr);
+        }
 
         // If worker is still valid (timeout occurred), we must wait for it
         // std::future destructor will block if the async result hasn't been retrieved
@@ -36,7 +36,7 @@ namespace NewRelic {
         }
 
         void SetUp() {
-            Application::getInstance().setContext(ApplicationContext("accountId","applicationId"));
+            Application::getInstance().setContext(ApplicationContext("accountId","applicationId",""));
         }
 
         virtual void TearDown() {
@@ -48,14 +48,14 @@ namespace NewRelic {
             remove(attributeStore.getFullStorePath());
             remove(sessionDataPath);
 
-            Application::getInstance().setContext(ApplicationContext("",""));
+            Application::getInstance().setContext(ApplicationContext("","",""));
         }
     };
 
     TEST_F(AnalyticsControllerTest, testInteractionEvent) {
         AnalyticsController controller(epoch_time_ms, sessionDataPath, eventStore, attributeStore);
 
-        ASSERT_TRUE(controller.addInteractionEvent("display viewcontroller", 1.43));
+        ASSERT_TRUE(controller.addInteractionEvent("display viewcontroller", 1.43, false, false));
         ASSERT_TRUE(controller.addSessionEndAttribute());
     }
 
@@ -88,9 +88,9 @@ namespace NewRelic {
 
         auto payload = Connectivity::Facade::getInstance().newPayload();
 
-        ASSERT_TRUE(controller.addNetworkErrorEvent(someRequestData, someBadNetworkResponse, std::move(payload)));
-        ASSERT_TRUE(controller.addHTTPErrorEvent(someOtherRequestData, someBadHttpResponse, std::move(payload)));
-        ASSERT_FALSE(controller.addHTTPErrorEvent(emptyRequestData, someBadHttpResponse, std::move(payload)));
+        ASSERT_TRUE(controller.addNetworkErrorEvent(someRequestData, someBadNetworkResponse, std::move(payload), false, false));
+        ASSERT_TRUE(controller.addHTTPErrorEvent(someOtherRequestData, someBadHttpResponse, std::move(payload), false, false));
+        ASSERT_FALSE(controller.addHTTPErrorEvent(emptyRequestData, someBadHttpResponse, std::move(payload), false, false));
     }
 
     TEST_F(AnalyticsControllerTest, testVariousNetworkErrors) {
@@ -108,7 +108,7 @@ namespace NewRelic {
 
         AnalyticsController controller(epoch_time_ms, sessionDataPath, eventStore, attributeStore);
 
-        auto result = controller.addNetworkErrorEvent(failedRequest, failedResponse, std::move(payload));
+        auto result = controller.addNetworkErrorEvent(failedRequest, failedResponse, std::move(payload), false, false);
         ASSERT_TRUE(result);
     }
 
@@ -135,9 +135,9 @@ TEST_F(AnalyticsControllerTest, testRequestEvent) {
 
     auto payload = Connectivity::Facade::getInstance().startTrip();
 
-    ASSERT_TRUE(controller.addRequestEvent(someRequestData, someOkHttpResponse, std::move(payload)));
-    ASSERT_TRUE(controller.addRequestEvent(someRequestData, someOkHttpResponse, std::move(payload)));
-    ASSERT_FALSE(controller.addRequestEvent(emptyRequestData, someBadHttpResponse, std::move(payload)));
+    ASSERT_TRUE(controller.addRequestEvent(someRequestData, someOkHttpResponse, std::move(payload), false, false));
+    ASSERT_TRUE(controller.addRequestEvent(someRequestData, someOkHttpResponse, std::move(payload), false, false));
+    ASSERT_FALSE(controller.addRequestEvent(emptyRequestData, someBadHttpResponse, std::move(payload), false, false));
 }
 
 
@@ -153,6 +153,24 @@ TEST_F(AnalyticsControllerTest, testRequestEvent) {
         auto json = controller.getEventsJSON(true);
     }
 
+    TEST_F(AnalyticsControllerTest, testHarvestEvents) {
+        AnalyticsController controller(epoch_time_ms, sessionDataPath, eventStore, attributeStore);
+
+        auto event = controller.newEvent("hello!");
+        event->addAttribute("pewpew", 123);
+        ASSERT_TRUE(controller.addEvent(event));
+        ASSERT_TRUE(controller.addEvent(controller.newEvent("world!")));
+
+        std::stringstream built;
+        built << *controller.getEventsJSON(false);
+        std::stringstream streamed;
+        controller.writeEventsJSON(streamed, false);
+        ASSERT_EQ(built.str(), streamed.str());
+
+        ASSERT_EQ(2, controller.getEventsJSON(true)->size());
+        ASSERT_EQ(0, controller.getEventsJSON(true)->size());
+    }
+
 
 
     TEST_F(AnalyticsControllerTest, testReservedWords) {
@@ -516,7 +534,7 @@ TEST_F(AnalyticsControllerTest, testRequestEvent) {
         ASSERT_TRUE(event == nullptr);
 
         bool result = false;
-        ASSERT_NO_THROW(result = controller.addInteractionEvent("", 100));
+        ASSERT_NO_THROW(result = controller.addInteractionEvent("", 100, false, false));
         ASSERT_FALSE(result);
 
         result = false;
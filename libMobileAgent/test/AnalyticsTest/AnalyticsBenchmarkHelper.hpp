@@ -0,0 +1,24 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef PROJECT_ANALYTICSBENCHMARKHELPER_HPP
+#define PROJECT_ANALYTICSBENCHMARKHELPER_HPP
+
+#include <Analytics/AttributeValidator.hpp>
+
+// What the Analytics *Benchmark_test fixtures share on top of BenchmarkHelper.
+class AnalyticsBenchmarkHelper {
+
+public:
+    // accepts every name and value, so the benchmarks time the code under test rather than validation
+    static NewRelic::AttributeValidator& validator() {
+        static NewRelic::AttributeValidator validator{[](const char*) { return true; },
+                                                      [](const char*) { return true; },
+                                                      [](const char*) { return true; }};
+        return validator;
+    }
+
+private:
+    AnalyticsBenchmarkHelper() {}
+};
+
+#endif //PROJECT_ANALYTICSBENCHMARKHELPER_HPP
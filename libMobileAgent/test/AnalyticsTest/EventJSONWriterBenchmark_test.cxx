@@ -0,0 +1,128 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/EventManager.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+#include "AnalyticsBenchmarkHelper.hpp"
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define NR_HEAP_BLOCK_SIZE(p) malloc_size(p)
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define NR_HEAP_BLOCK_SIZE(p) malloc_usable_size(p)
+#endif
+
+#ifdef NR_HEAP_BLOCK_SIZE
+// Heap in use through operator new, and its high-water mark; both sides count the block's usable
+// size, so blocks allocated before a measurement starts balance out when they are freed.
+static std::atomic<long long> heapInUse{0};
+static std::atomic<long long> heapPeak{0};
+
+void* operator new(std::size_t size) {
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    long long now = heapInUse += (long long)NR_HEAP_BLOCK_SIZE(p);
+    long long peak = heapPeak.load(std::memory_order_relaxed);
+    while (now > peak && !heapPeak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        heapInUse -= (long long)NR_HEAP_BLOCK_SIZE(p);
+        std::free(p);
+    }
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+#endif
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+class EventJSONWriterBenchmark : public ::testing::Test {
+protected:
+    static const int EVENTS = 1000;
+    static const int HARVESTS = 50;
+
+    struct Result {
+        double bytesPerSecond;
+        long long peakHeapBytes; // above what was in use before the harvest; -1 where it can't be measured
+        std::size_t length;
+    };
+
+    // network-request-sized events: a handful of strings and numbers each
+    static std::vector<std::shared_ptr<AnalyticEvent>> harvest() {
+        std::vector<std::shared_ptr<AnalyticEvent>> events;
+        for (int i = 0; i < EVENTS; i++) {
+            auto event = EventManager::newCustomEvent("MobileRequest", 1700000000000 + i, i * 0.25, AnalyticsBenchmarkHelper::validator());
+            event->addAttribute("requestUrl", "https://api.example.com/v1/items?page=\"2\"");
+            event->addAttribute("requestMethod", "GET");
+            event->addAttribute("requestDomain", "api.example.com");
+            event->addAttribute("connectionType", "wifi");
+            event->addAttribute("statusCode", 200);
+            event->addAttribute("bytesReceived", 48213ull);
+            event->addAttribute("responseTime", 0.412 + i / 1000.0);
+            event->addAttribute("offline", false);
+            events.push_back(event);
+        }
+        return events;
+    }
+
+    template<typename Harvest>
+    static Result run(const std::vector<std::shared_ptr<AnalyticEvent>>& events,
+                      Harvest write) {
+        std::size_t length = 0;
+        long long peak = -1;
+        auto elapsed = BenchmarkHelper::seconds([&] {
+            for (int i = 0; i < HARVESTS; i++) {
+#ifdef NR_HEAP_BLOCK_SIZE
+                const long long before = heapInUse.load();
+                heapPeak.store(before);
+#endif
+                length = write(events);
+#ifdef NR_HEAP_BLOCK_SIZE
+                peak = std::max(peak, heapPeak.load() - before);
+#endif
+            }
+        });
+        return Result{(double)length * HARVESTS / elapsed, peak, length};
+    }
+};
+
+// What NRMAAnalytics does at harvest: the events as JSON text, from the event list to the finished string.
+TEST_F(EventJSONWriterBenchmark, DISABLED_testThousandEventHarvest) {
+    auto events = harvest();
+
+    Result dom = run(events, [](const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+        auto json = EventManager::toJSON(events);
+        std::stringstream stream;
+        stream << std::setprecision(13) << *json;
+        return stream.str().size();
+    });
+    Result streamed = run(events, [](const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+        std::stringstream stream;
+        stream << std::setprecision(13);
+        EventManager::writeJSON(stream, events);
+        return stream.str().size();
+    });
+
+    ASSERT_EQ(dom.length, streamed.length);
+    std::cout << EVENTS << " events, " << streamed.length << " bytes: "
+              << "JsonArray " << (long long)(dom.bytesPerSecond / 1024) << " KiB/s (peak heap " << dom.peakHeapBytes / 1024 << " KiB)"
+              << ", EventJSONWriter " << (long long)(streamed.bytesPerSecond / 1024) << " KiB/s (peak heap " << streamed.peakHeapBytes / 1024 << " KiB)"
+              << std::endl;
+}
+} // namespace NewRelic
@@ -0,0 +1,92 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/EventJSONWriter.hpp>
+#include <Analytics/EventManager.hpp>
+#include <iomanip>
+#include <sstream>
+#include <gmock/gmock.h>
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+class EventJSONWriterTest : public ::testing::Test {
+protected:
+    AttributeValidator validator = AttributeValidator([](const char*) { return true; },
+                                                      [](const char*) { return true; },
+                                                      [](const char*) { return true; });
+
+    // what NRMAAnalytics sends: the NRJSON array streamed at the harvest's precision
+    static std::string viaDOM(std::vector<std::shared_ptr<AnalyticEvent>> events) {
+        std::stringstream stream;
+        stream << std::setprecision(13) << *EventManager::toJSON(events);
+        return stream.str();
+    }
+
+    static std::string streamed(const std::vector<std::shared_ptr<AnalyticEvent>>& events) {
+        std::stringstream stream;
+        stream << std::setprecision(13);
+        EventManager::writeJSON(stream, events);
+        return stream.str();
+    }
+};
+
+TEST_F(EventJSONWriterTest, testEmpty) {
+    ASSERT_EQ(viaDOM({}), streamed({}));
+}
+
+TEST_F(EventJSONWriterTest, testMatchesDOMForEveryEventKind) {
+    std::vector<std::shared_ptr<AnalyticEvent>> events;
+
+    auto custom = EventManager::newCustomEvent("Fruit", 1234567890123, 0.1 + 0.2, validator);
+    custom->addAttribute("name", "huckle\"berry\\");
+    custom->addAttribute("weight", 12.000000000000002);
+    custom->addAttribute("count", 3ull);
+    custom->addAttribute("delta", -7ll);
+    custom->addAttribute("ripe", true);
+    events.push_back(custom);
+
+    events.push_back(EventManager::newCustomMobileEvent("Custom", 1700000000000, 3, validator));
+    events.push_back(EventManager::newInteractionAnalyticEvent("Display MainView", 1, 2.5, validator));
+    events.push_back(EventManager::newSessionAnalyticEvent(2, 1e-7, validator));
+    events.push_back(EventManager::newUserActionEvent(3, 123456.789, validator));
+    events.push_back(EventManager::newBreadcrumbEvent(4, 0, validator));
+
+    ASSERT_EQ(viaDOM(events), streamed(events));
+}
+
+TEST_F(EventJSONWriterTest, testAttributesNamedLikeFields) {
+    // the DOM kept whichever was set last: attributes replace the base fields, subclass fields replace attributes
+    auto interaction = EventManager::newInteractionAnalyticEvent("Display MainView", 1, 2.5, validator);
+    interaction->addAttribute("timestamp", "later");
+    interaction->addAttribute("category", "mine");
+    interaction->addAttribute("name", 4);
+    interaction->addAttribute("aaa", false);
+    interaction->addAttribute("zzz", 1.5);
+
+    std::vector<std::shared_ptr<AnalyticEvent>> events{interaction};
+    std::string json = streamed(events);
+    ASSERT_EQ(viaDOM(events), json);
+    ASSERT_NE(std::string::npos, json.find("\"timestamp\": \"later\""));
+    ASSERT_NE(std::string::npos, json.find("\"name\": \"Display MainView\""));
+}
+
+TEST_F(EventJSONWriterTest, testWritesEventManagerSnapshot) {
+    PersistentStore<std::string, AnalyticEvent> store{"eventjsonwriter", "", &EventManager::newEvent};
+    EventManager manager{store};
+    for (int i = 0; i < 10; i++) {
+        manager.addEvent(EventManager::newCustomEvent("Fruit", 1000 + i, i, validator));
+    }
+
+    std::stringstream expected;
+    expected << *manager.toJSON();
+    std::stringstream actual;
+    manager.writeJSON(actual);
+    ASSERT_EQ(expected.str(), actual.str());
+
+    manager.empty();
+    store.clear();
+    store.synchronize();
+    remove(store.getFullStorePath());
+}
+} // namespace NewRelic
@@ -0,0 +1,67 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/EventManager.hpp>
+#include <Analytics/EventBufferConfig.hpp>
+#include <iostream>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+#include "AnalyticsBenchmarkHelper.hpp"
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+static const char* BENCHMARK_EVENT_STORE = "eventmanagerbenchmark_events";
+
+class EventManagerBenchmark : public ::testing::Test {
+protected:
+    static const int EVENTS_PER_THREAD = 4000;
+
+    virtual void SetUp() {
+        std::remove(BENCHMARK_EVENT_STORE);
+    }
+
+    virtual void TearDown() {
+        EventBufferConfig::getInstance().setMaxEventBufferSize(EventBufferConfig::kMaxEventBufferSizeDefault);
+        std::remove(BENCHMARK_EVENT_STORE);
+    }
+
+    // Each thread records its own events, the way network instrumentation does from the request
+    // callbacks. Returns addEvent() calls per second.
+    static double run(int threads,
+                      unsigned int maxBufferSize) {
+        PersistentStore<std::string, AnalyticEvent> store{BENCHMARK_EVENT_STORE, "", &EventManager::newEvent};
+        EventManager manager{store};
+        manager.setMaxBufferSize(maxBufferSize);
+
+        std::vector<std::vector<std::shared_ptr<AnalyticEvent>>> prepared(threads);
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < EVENTS_PER_THREAD; i++) {
+                auto event = EventManager::newCustomEvent("Benchmark", 1000 + i, t, AnalyticsBenchmarkHelper::validator());
+                event->addAttribute("thread", t);
+                event->addAttribute("index", i);
+                prepared[t].push_back(event);
+            }
+        }
+
+        auto elapsed = BenchmarkHelper::secondsOnThreads(threads, [&](int t) {
+            for (auto& event : prepared[t]) {
+                manager.addEvent(event);
+            }
+        });
+
+        store.synchronize();
+        return (double)threads * EVENTS_PER_THREAD / elapsed;
+    }
+};
+
+TEST_F(EventManagerBenchmark, DISABLED_testRecordingThreads) {
+    for (int threads : {1, 2, 4, 8, 16}) {
+        double withRoom = run(threads, threads * EVENTS_PER_THREAD);
+        double full = run(threads, EventBufferConfig::kMaxEventBufferSizeDefault);
+        std::cout << threads << " threads: "
+                  << (long long)withRoom << " events/s with room in the buffer, "
+                  << (long long)full << " events/s once it is full" << std::endl;
+    }
+}
+} // namespace NewRelic
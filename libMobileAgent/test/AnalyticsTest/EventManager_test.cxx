@@ -1,6 +1,9 @@
 #include <gmock/gmock.h>
 #include <Analytics/EventManager.hpp>
+#include <Analytics/AnalyticsController.hpp>
+#include <future>
 #include <string>
+#include <thread>
 #include <Analytics/EventBufferConfig.hpp>
 
 using ::testing::Eq;
@@ -70,6 +73,7 @@ protected:
     virtual void TearDown() {
         EventBufferConfig::getInstance().setMaxEventBufferTime(EventBufferConfig::kMaxEventBufferTimeSecDefault);
         EventBufferConfig::getInstance().setMaxEventBufferSize(EventBufferConfig::kMaxEventBufferSizeDefault);
+        EventBufferConfig::getInstance().clearEventTypePolicies();
         remove(store.getFullStorePath());
         remove(sessionDataPath);
     }
@@ -80,7 +84,7 @@ public:
     MockEventManager(PersistentStore<std::string, AnalyticEvent>& store) : EventManager(store) {
     }
 
-    MOCK_METHOD0(getRemovalIndex, int());
+    MOCK_METHOD0(getRemovalIndex, uint64_t());
 };
 
 TEST_F(EventManagerTest, testPersistantBuffer) {
@@ -218,6 +222,132 @@ TEST_F(EventManagerTest, testDuplicationStore) {
     ASSERT_EQ(*event, *storedEvent);
 }
 
+TEST_F(EventManagerTest, testIdenticalEventsKeepSeparateKeys) {
+    EventManager manager{store};
+    auto first = manager.newCustomMobileEvent("blah", epoch_time_ms, 1, validator);
+    auto second = manager.newCustomMobileEvent("blah", epoch_time_ms, 1, validator);
+    ASSERT_EQ(*first, *second);
+    ASSERT_NE(EventManager::createKey(first), EventManager::createKey(second));
+    ASSERT_EQ((std::size_t)EventManager::KEY_LENGTH, EventManager::createKey(first).size());
+
+    auto copy = std::make_shared<CustomMobileEvent>(*first);
+    ASSERT_EQ(EventManager::createKey(first), EventManager::createKey(copy));
+    ASSERT_TRUE(EventManager::isValidKey(EventManager::createKey(first), second));
+    auto later = manager.newCustomMobileEvent("blah", epoch_time_ms + 1, 1, validator);
+    ASSERT_FALSE(EventManager::isValidKey(EventManager::createKey(first), later));
+
+    manager.addEvent(first);
+    manager.addEvent(second);
+    store.synchronize();
+    ASSERT_EQ(2, store.load().size());
+
+    //stores written before events had ids are keyed by their serialization
+    std::stringstream ss;
+    ss << *first;
+    std::string legacy{ss.str()};
+    legacy.erase(std::remove_if(legacy.begin(), legacy.end(), &isspace), legacy.end());
+    ASSERT_TRUE(EventManager::isValidKey(legacy, second));
+    ASSERT_FALSE(EventManager::isValidKey(legacy.substr(1), second));
+}
+
+TEST_F(EventManagerTest, testReloadedEventKeepsItsKey) {
+    {
+        EventManager manager{store};
+        manager.addEvent(manager.newCustomMobileEvent("blah", epoch_time_ms, 1, validator));
+        store.synchronize();
+    }
+
+    PersistentStore<std::string, AnalyticEvent> reloaded{storeFilename, sessionDataPath, &EventManager::newEvent,
+                                                         &EventManager::adoptKey};
+    auto events = reloaded.load();
+    ASSERT_EQ(1, events.size());
+    //the reloaded event maps back to its own record, so evicting or harvesting it removes that record
+    ASSERT_EQ(events.begin()->first, EventManager::createKey(events.begin()->second));
+}
+
+TEST_F(EventManagerTest, testReloadedTextEventsKeepTheirKeys) {
+    //a text store keeps 15 digits of the elapsed time, which doesn't give every double back exactly
+    {
+        EventManager manager{store};
+        for (double elapsed : {1.0, 12.345678901234567, 0.1 + 0.2}) {
+            manager.addEvent(manager.newCustomMobileEvent("blah", epoch_time_ms, elapsed, validator));
+        }
+        store.synchronize();
+    }
+
+    PersistentStore<std::string, AnalyticEvent> reloaded{storeFilename, sessionDataPath, &EventManager::newEvent,
+                                                         &EventManager::adoptKey};
+    auto events = reloaded.load();
+    ASSERT_EQ(3, events.size());
+    for (const auto& event : events) {
+        ASSERT_EQ(event.first, EventManager::createKey(event.second));
+    }
+}
+
+// stands in for a slow serialization: generateJSONObject() waits until the test lets it go
+class BlockingEvent : public AnalyticEvent {
+public:
+    mutable std::promise<void> started;
+    std::shared_future<void> release;
+
+    BlockingEvent(std::shared_future<void> release, AttributeValidator& validator)
+            : AnalyticEvent(std::make_shared<std::string>("Blocking"), 1, 0, validator),
+              release(release) {}
+
+    virtual void put(std::ostream& os) const {
+        os << getEventType() << AnalyticEvent::_delimiter;
+    }
+
+    virtual std::shared_ptr<NRJSON::JsonObject> generateJSONObject() const {
+        started.set_value();
+        release.wait();
+        return AnalyticEvent::generateJSONObject();
+    }
+};
+
+TEST_F(EventManagerTest, testHarvestSerializesWithoutEventsLock) {
+    PersistentStore<std::string, BaseValue> attributeStore{"harvestattributes", "", &Value::createValue};
+    AnalyticsController controller(epoch_time_ms, sessionDataPath, store, attributeStore);
+    std::promise<void> release;
+    auto blocking = std::make_shared<BlockingEvent>(release.get_future().share(), validator);
+    ASSERT_TRUE(controller.addEvent(blocking));
+
+    auto harvest = std::async(std::launch::async, [&controller] { return controller.getEventsJSON(true); });
+    blocking->started.get_future().wait();
+
+    //the first harvest is mid-serialization; recording and the next harvest go ahead against the new buffer
+    ASSERT_TRUE(controller.addEvent(controller.newEvent("during")));
+    auto next = std::async(std::launch::async, [&controller] { return controller.getEventsJSON(true); });
+    bool finished = next.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    release.set_value();
+    ASSERT_TRUE(finished);
+    ASSERT_EQ(1, next.get()->size());
+    ASSERT_EQ(1, harvest.get()->size());
+
+    attributeStore.synchronize();
+    remove(attributeStore.getFullStorePath());
+    remove(controller.getPersistentAttributeStoreName());
+}
+
+TEST_F(EventManagerTest, testHarvestRemovesOnlyHarvestedRecords) {
+    PersistentStore<std::string, BaseValue> attributeStore{"harvestattributes", "", &Value::createValue};
+    AnalyticsController controller(epoch_time_ms, sessionDataPath, store, attributeStore);
+    auto harvested = controller.newEvent("harvested");
+    ASSERT_TRUE(controller.addEvent(harvested));
+    //stands in for an event staged after the harvest's merge
+    auto staged = controller.newEvent("staged");
+    store.store(EventManager::createKey(staged), staged);
+
+    ASSERT_EQ(1, controller.getEventsJSON(true)->size());
+    ASSERT_EQ(nullptr, store.get(EventManager::createKey(harvested)));
+    ASSERT_NE(nullptr, store.get(EventManager::createKey(staged)));
+
+    store.clear();
+    attributeStore.synchronize();
+    remove(attributeStore.getFullStorePath());
+    remove(controller.getPersistentAttributeStoreName());
+}
+
 TEST_F(EventManagerTest, testJSONAsValue) {
     auto validator = AttributeValidator([](const char* name) { return true; },
                                                             [](const char* value) { return true; },
@@ -384,8 +514,10 @@ TEST_F(EventManagerTest, testAddEventIncrementsRecordedCount) {
 }
 
 TEST_F(EventManagerTest, testOverflowEvictsAndIncrementsEvictedCount) {
-    EventManager manager{store};
+    MockEventManager manager{store};
     manager.setMaxBufferSize(1);
+    EXPECT_CALL(manager, getRemovalIndex())
+            .WillOnce(Return(0)); // the reservoir picks the only resident event
 
     auto first = manager.newCustomMobileEvent("custom", epoch_time_ms - 1000, 1, validator);
     auto firstResult = manager.addEvent(first);
@@ -395,8 +527,6 @@ TEST_F(EventManagerTest, testOverflowEvictsAndIncrementsEvictedCount) {
     auto second = manager.newCustomMobileEvent("custom 2", epoch_time_ms, 1, validator);
     auto secondResult = manager.addEvent(second);
 
-    // total_attempted_inserts == 1 at this point, so getRemovalIndex() == rand() % 1 == 0,
-    // deterministically evicting the only resident event.
     ASSERT_TRUE(secondResult.added);
     ASSERT_TRUE(secondResult.overflowed);
     ASSERT_TRUE(secondResult.evicted);
@@ -428,5 +558,149 @@ TEST_F(EventManagerTest, testOutOfBoundsRemovalIndexDropsIncomingEvent) {
     ASSERT_EQ(1, json->size());
     ASSERT_EQ(((*json)[0]["name"]).as_string(), "custom"); // original event survives
 }
+
+TEST_F(EventManagerTest, testQuotaCapsFloodingEventType) {
+    EventManager manager{store};
+    manager.setMaxBufferSize(100);
+    EventBufferConfig::getInstance().setEventTypePolicy("Flood", EventTypePolicy{10, EventRetention::Sampled});
+
+    for (int i = 0; i < 1000; i++) {
+        manager.addEvent(manager.newCustomEvent("Flood", epoch_time_ms + i, 1, validator));
+    }
+    for (int i = 0; i < 50; i++) {
+        manager.addEvent(manager.newCustomEvent("Quiet", epoch_time_ms + i, 1, validator));
+    }
+
+    // the flood is sampled within its own quota; the other type is never displaced by it
+    auto json = manager.toJSON();
+    int flood = 0, quiet = 0;
+    for (int i = 0; i < json->size(); i++) {
+        ((*json)[i]["eventType"].as_string() == "Flood" ? flood : quiet)++;
+    }
+    ASSERT_EQ(10, flood);
+    ASSERT_EQ(50, quiet);
+
+    // a harvest returns the quota to the type
+    manager.empty();
+    for (int i = 0; i < 20; i++) {
+        manager.addEvent(manager.newCustomEvent("Flood", epoch_time_ms + i, 1, validator));
+    }
+    ASSERT_EQ(10, manager.toJSON()->size());
+}
+
+TEST_F(EventManagerTest, testSessionEventIsNeverEvicted) {
+    EventManager manager{store};
+    manager.setMaxBufferSize(10);
+
+    ASSERT_TRUE(manager.addEvent(manager.newSessionAnalyticEvent(epoch_time_ms, 1, validator)).added);
+    for (int i = 0; i < 1000; i++) {
+        manager.addEvent(manager.newCustomEvent("Flood", epoch_time_ms + i, 1, validator));
+    }
+    // a full buffer still takes the next session event, in the place of a sampled one
+    ASSERT_TRUE(manager.addEvent(manager.newSessionAnalyticEvent(epoch_time_ms + 1, 2, validator)).added);
+    for (int i = 0; i < 1000; i++) {
+        manager.addEvent(manager.newCustomEvent("Flood", epoch_time_ms + i, 1, validator));
+    }
+
+    auto json = manager.toJSON();
+    ASSERT_EQ(10, json->size());
+    int sessions = 0;
+    for (int i = 0; i < json->size(); i++) {
+        if ((*json)[i]["category"].as_string() == "Session") {
+            sessions++;
+        }
+    }
+    ASSERT_EQ(2, sessions);
+}
+
+TEST_F(EventManagerTest, testEventTypeCounts) {
+    EventManager manager{store};
+    manager.setMaxBufferSize(100);
+    EventBufferConfig::getInstance().setEventTypePolicy("Flood", EventTypePolicy{5, EventRetention::Sampled});
+
+    for (int i = 0; i < 30; i++) {
+        manager.addEvent(manager.newCustomEvent("Flood", epoch_time_ms + i, 1, validator));
+    }
+    for (int i = 0; i < 3; i++) {
+        manager.addEvent(manager.newCustomEvent("Quiet", epoch_time_ms + i, 1, validator));
+    }
+
+    auto counts = manager.getEventTypeCounts();
+    ASSERT_EQ(3, counts["Quiet"].recorded);
+    ASSERT_EQ(0, counts["Quiet"].evicted);
+    // every offer past the quota evicts one Flood event, the newcomer or a resident
+    ASSERT_EQ(25, counts["Flood"].evicted);
+    ASSERT_EQ(manager.getEventsRecordedCount(), counts["Flood"].recorded + counts["Quiet"].recorded);
+    ASSERT_EQ(manager.getEventsEvictedCount(), counts["Flood"].evicted);
+}
+
+TEST_F(EventManagerTest, testConcurrentAddEvent) {
+    EventManager manager{store};
+    manager.setMaxBufferSize(4000);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 600; i++) {
+                manager.addEvent(manager.newCustomMobileEvent(("c" + std::to_string(t)).c_str(), epoch_time_ms + i, 1, validator));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // staged or merged, every event is accounted for and the buffer never grows past its maximum
+    ASSERT_EQ(4000, manager.toJSON()->size());
+    ASSERT_EQ(800, manager.getEventsEvictedCount());
+    ASSERT_LE(4000, manager.getEventsRecordedCount());
+
+    manager.empty();
+    ASSERT_EQ(0, manager.toJSON()->size());
+    manager.addEvent(manager.newCustomMobileEvent("after", epoch_time_ms, 1, validator));
+    ASSERT_EQ(1, manager.toJSON()->size());
+}
+
+TEST_F(EventManagerTest, testReservoirKeepsEveryEventEquallyLikely) {
+    // Offer OFFERED events to a buffer of BUFFER_SIZE, TRIALS times over; each event should be
+    // kept in about BUFFER_SIZE / OFFERED of the trials, whether it came first or last.
+    const int BUFFER_SIZE = 5;
+    const int OFFERED = 40;
+    const int TRIALS = 2000;
+    std::vector<int> kept(OFFERED, 0);
+    // a fixed seed keeps the check from failing on the rare unlucky run
+    EventManager::seedRandom(20231017);
+    for (int trial = 0; trial < TRIALS; trial++) {
+        EventManager manager{store};
+        manager.setMaxBufferSize(BUFFER_SIZE);
+        for (int i = 0; i < OFFERED; i++) {
+            manager.addEvent(manager.newCustomMobileEvent(std::to_string(i).c_str(), epoch_time_ms, 1, validator));
+        }
+        auto json = manager.toJSON();
+        ASSERT_EQ(BUFFER_SIZE, json->size());
+        for (auto& event : *json) {
+            kept[std::stoi(event["name"].as_string())]++;
+        }
+        manager.empty();
+    }
+
+    // chi-squared with 39 degrees of freedom; 80 is beyond the 0.01% tail
+    const double expected = (double)TRIALS * BUFFER_SIZE / OFFERED;
+    double chiSquared = 0;
+    for (int count : kept) {
+        chiSquared += (count - expected) * (count - expected) / expected;
+    }
+    ASSERT_LT(chiSquared, 80);
+}
+
+TEST_F(EventManagerTest, testUniformRandomStaysInBounds) {
+    for (uint64_t bound : {(uint64_t)1, (uint64_t)2, (uint64_t)3, (uint64_t)1000, (uint64_t)1 << 40, (uint64_t)UINT64_MAX}) {
+        for (int i = 0; i < 1000; i++) {
+            ASSERT_LT(EventManager::uniformRandom(bound), bound);
+        }
+    }
+    //a type's reservoir can be asked for a pick before anything of the type was offered
+    ASSERT_EQ(0u, EventManager::uniformRandom(0));
+}
 } // namespace NewRelic
 
@@ -0,0 +1,120 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/Stores/FileBackedStore.hpp>
+#include <Analytics/RecordFormat.hpp>
+#include <Utilities/Value.hpp>
+#include <fstream>
+#include <iostream>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+static const char* BENCHMARK_TEXT_FILE = "fbsbenchmark_text";
+static const char* BENCHMARK_BINARY_FILE = "fbsbenchmark_binary";
+
+class FileBackedStoreBenchmark : public ::testing::Test {
+protected:
+    virtual void TearDown() {
+        std::remove(BENCHMARK_TEXT_FILE);
+        std::remove(BENCHMARK_BINARY_FILE);
+    }
+
+    static std::shared_ptr<BaseValue> valueAt(int i) {
+        if (i % 2) {
+            return Value::createValue(("value" + std::to_string(i)).c_str());
+        }
+        return Value::createValue((long long)i * 1000);
+    }
+
+    static void writeFiles(int records) {
+        std::ofstream text{BENCHMARK_TEXT_FILE, std::ios::trunc | std::ios::binary};
+        std::string binary;
+        RecordFormat::appendHeader(binary);
+        for (int i = 0; i < records; i++) {
+            const std::string key = "key" + std::to_string(i);
+            std::ostringstream value;
+            value << *valueAt(i);
+            text << key << '\n' << value.str() << '\n';
+            const std::size_t start = RecordFormat::beginRecord(binary, RecordFormat::PUT, key.data(), key.size());
+            Value::encode(*valueAt(i), binary);
+            RecordFormat::endRecord(binary, start);
+        }
+        std::ofstream out{BENCHMARK_BINARY_FILE, std::ios::trunc | std::ios::binary};
+        out.write(binary.data(), binary.size());
+    }
+
+    // the ifstream loader FileBackedStore used before: getline per line, a stringstream per value
+    static std::map<std::string, std::shared_ptr<BaseValue>> streamLoad(const char* path) {
+        std::map<std::string, std::shared_ptr<BaseValue>> map;
+        std::ifstream in{path};
+        std::string key;
+        std::string value;
+        while (std::getline(in, key)) {
+            std::getline(in, value);
+            std::stringstream is{value};
+            map[key] = Value::createValue(is);
+        }
+        return map;
+    }
+};
+
+TEST_F(FileBackedStoreBenchmark, DISABLED_testLoadTime) {
+    StoreOptions binaryOptions;
+    binaryOptions.format = StoreOptions::Format::Binary;
+
+    for (int records : {1000, 10000, 100000}) {
+        writeFiles(records);
+
+        std::size_t loaded = 0;
+        auto streamed = BenchmarkHelper::bestMicros([&] { loaded = streamLoad(BENCHMARK_TEXT_FILE).size(); });
+        ASSERT_EQ(records, loaded);
+
+        FileBackedStore<std::string, BaseValue> textStore{BENCHMARK_TEXT_FILE, "", &Value::createValue};
+        auto mappedText = BenchmarkHelper::bestMicros([&] { loaded = textStore.load().size(); });
+        ASSERT_EQ(records, loaded);
+
+        FileBackedStore<std::string, BaseValue> binaryStore{BENCHMARK_BINARY_FILE, "", &Value::createValue, binaryOptions};
+        auto mappedBinary = BenchmarkHelper::bestMicros([&] { loaded = binaryStore.load().size(); });
+        ASSERT_EQ(records, loaded);
+
+        std::cout << records << " records: ifstream loader " << streamed << " us"
+                  << ", mapped text " << mappedText << " us"
+                  << ", mapped binary " << mappedBinary << " us" << std::endl;
+    }
+}
+
+// A flush serializes from a snapshot of the cache, so store() calls made meanwhile find the map
+// shared. Each round takes a snapshot, stores into the store while it is alive, then lets it go.
+TEST_F(FileBackedStoreBenchmark, DISABLED_testStoreWhileSnapshotted) {
+    const int rounds = 100;
+    const int storesPerRound = 10;
+
+    for (int records : {1000, 10000, 100000}) {
+        CacheBackedStore<std::string, BaseValue> store;
+        for (int i = 0; i < records; i++) {
+            store.store("key" + std::to_string(i), valueAt(i));
+        }
+
+        double storing = 0;
+        for (int round = 0; round < rounds; round++) {
+            auto flushing = store.snapshot();
+            storing += BenchmarkHelper::seconds([&] {
+                for (int i = 0; i < storesPerRound; i++) {
+                    store.store("key" + std::to_string((round * storesPerRound + i) % records), valueAt(i));
+                }
+            });
+        }
+        ASSERT_EQ(records, store.load().size());
+
+        // what each round cost when the first store() copied the shared map
+        auto snapshot = store.snapshot();
+        auto copying = BenchmarkHelper::bestMicros([&] { std::map<std::string, std::shared_ptr<BaseValue>> copy{*snapshot}; });
+
+        std::cout << records << " records: " << (long long)(storing * 1e6 / rounds) << " us per round of "
+                  << storesPerRound << " stores, copying the cache " << copying << " us" << std::endl;
+    }
+}
+} // namespace NewRelic
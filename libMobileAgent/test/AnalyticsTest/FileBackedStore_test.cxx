@@ -1,8 +1,15 @@
 
 #include <Analytics/Stores/FileBackedStore.hpp>
 #include <Analytics/EventManager.hpp>
+#include <Utilities/Value.hpp>
+#include "PersistentStoreHelper.hpp"
+#include <algorithm>
 #include <fstream>
+#include <random>
 #include <iostream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <gmock/gmock.h>
 using ::testing::Eq;
 using ::testing::Test;
@@ -11,6 +18,7 @@ using ::testing::Test;
 namespace NewRelic {
 
 static const char* FILEBACKSTORE_TEMP_FILE = "fbstest_tempStore";
+static const char* FILEBACKSTORE_LEGACY_FILE = "fbstest_legacyStore.txt";
 
 class FileBackedStoreTest: public ::testing::Test {
 
@@ -21,10 +29,12 @@ protected:
 
     virtual void SetUp() {
         remove(FILEBACKSTORE_TEMP_FILE);
+        remove(FILEBACKSTORE_LEGACY_FILE);
     }
 
     virtual void TearDown() {
         remove(FILEBACKSTORE_TEMP_FILE);
+        remove(FILEBACKSTORE_LEGACY_FILE);
     }
 
 
@@ -47,10 +57,58 @@ TEST_F(FileBackedStoreTest, testStore) {
 
 }
 
+TEST_F(FileBackedStoreTest, testSnapshots) {
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    fbs.store("huckle", Value::createValue("berry"));
+
+    ASSERT_EQ(nullptr, fbs.get("straw"));
+    // a lookup miss doesn't add the key
+    ASSERT_EQ(1, fbs.getCache()->size());
+
+    auto before = fbs.getCache();
+    ASSERT_EQ(before, fbs.getCache()); // no writes in between, no copy
+    fbs.store("straw", Value::createValue("berry"));
+    fbs.remove("huckle");
+    // the writes made while the snapshot shares the cache are read back before they are folded in
+    ASSERT_EQ(nullptr, fbs.get("huckle"));
+    ASSERT_TRUE(*Value::createValue("berry") == *fbs.get("straw"));
+
+    ASSERT_EQ(1, before->size());
+    ASSERT_TRUE(before->count("huckle"));
+    auto after = fbs.getCache();
+    ASSERT_EQ(1, after->size());
+    ASSERT_TRUE(after->count("straw"));
+
+    auto swapped = fbs.swap();
+    ASSERT_EQ(1, swapped.size());
+    ASSERT_TRUE(fbs.getCache()->empty());
+    ASSERT_EQ(1, after->size());
+}
+
+TEST_F(FileBackedStoreTest, testSwapBacksUpPendingWrites) {
+    const std::string backup = std::string(FILEBACKSTORE_TEMP_FILE) + ".bak";
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        fbs.store("huckle", Value::createValue("berry"));
+        fbs.store("straw", Value::createValue("berry"));
+
+        // no synchronize(): swap() flushes what is pending before the file becomes the backup
+        ASSERT_EQ(2, fbs.swap().size());
+        ASSERT_FALSE(PersistentStoreHelper::storeIsEmpty(backup.c_str()));
+        std::rename(backup.c_str(), (backup + ".kept").c_str());
+    }
+
+    FileBackedStore<std::string, BaseValue> restored{(backup + ".kept").c_str(), "", &Value::createValue, options};
+    ASSERT_EQ(2, restored.getCache()->size());
+    std::remove((backup + ".kept").c_str());
+}
+
 TEST_F(FileBackedStoreTest, testInvalidEvents) {
 
     FileBackedStore<std::string,AnalyticEvent> fbs{FILEBACKSTORE_TEMP_FILE, "", &EventManager::newEvent, [](std::string const& key, std::shared_ptr<AnalyticEvent> event){
-        return key == EventManager::createKey(event);
+        return EventManager::isValidKey(key, event);
     }};
 
     PersistentStore<std::string, AnalyticEvent> store{"tmp","",&EventManager::newEvent};
@@ -83,4 +141,738 @@ TEST_F(FileBackedStoreTest, testInvalidEvents) {
         ASSERT_TRUE(map.size() == 0);
     }
 }
+
+class CountingFileBackedStore : public FileBackedStore<std::string, BaseValue> {
+public:
+    std::atomic<int> flushes{0};
+
+    CountingFileBackedStore(const char* filename) : FileBackedStore(filename, "", &Value::createValue) {}
+
+    CountingFileBackedStore(const char* filename,
+                            const StoreOptions& options)
+            : FileBackedStore(filename, "", &Value::createValue, options) {}
+
+    virtual void flush() {
+        flushes++;
+        FileBackedStore::flush();
+    }
+};
+
+TEST_F(FileBackedStoreTest, testBurstIsCoalesced) {
+    CountingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE};
+    for (int i = 0; i < 5000; i++) {
+        fbs.store("attribute" + std::to_string(i % 100), Value::createValue(i));
+    }
+    fbs.synchronize();
+
+    // one flush per throttle window rather than one per store()
+    ASSERT_LT(fbs.flushes.load(), 50);
+
+    // the last write of the burst reached the file without another store() or the destructor
+    FileBackedStore<std::string, BaseValue> reader{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    auto map = *reader.getCache();
+    ASSERT_EQ(100, map.size());
+    ASSERT_TRUE(*Value::createValue(4999) == *map["attribute99"]);
+}
+
+TEST_F(FileBackedStoreTest, testIdleFlushTakesOneWritePerBurst) {
+    StoreOptions options;
+    options.flushIdle = std::chrono::milliseconds(100);
+    options.flushMaxDelay = std::chrono::seconds(10);
+    CountingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE, options};
+    for (int i = 0; i < 5000; i++) {
+        fbs.store("counter", Value::createValue(i));
+    }
+
+    // nothing asks for the flush: it goes out once the writes stop
+    for (int i = 0; i < 100 && fbs.flushes.load() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_EQ(1, fbs.flushes.load());
+
+    FileBackedStore<std::string, BaseValue> reader{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    auto map = *reader.getCache();
+    ASSERT_TRUE(*Value::createValue(4999) == *map["counter"]);
+}
+
+TEST_F(FileBackedStoreTest, testRecordThresholdFlushesEarly) {
+    StoreOptions options;
+    options.flushRecords = 10;
+    options.flushMaxDelay = std::chrono::seconds(30);
+    CountingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE, options};
+    for (int i = 0; i < 9; i++) {
+        fbs.store("attribute" + std::to_string(i), Value::createValue(i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(0, fbs.flushes.load());
+
+    fbs.store("attribute9", Value::createValue(9));
+    for (int i = 0; i < 100 && fbs.flushes.load() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    ASSERT_EQ(1, fbs.flushes.load());
+
+    FileBackedStore<std::string, BaseValue> reader{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    ASSERT_EQ(10, reader.getCache()->size());
+}
+
+TEST_F(FileBackedStoreTest, testShutdownDrainFlushesPendingWrites) {
+    StoreOptions options;
+    options.flushIdle = std::chrono::seconds(10);
+    options.flushMaxDelay = std::chrono::seconds(10);
+    CountingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE, options};
+    fbs.store("pending", Value::createValue("write"));
+
+    // the flush would otherwise wait out its triggers; the drain sends it straight away
+    auto result = ShutdownCoordinator::shared().drain(std::chrono::milliseconds(1000));
+    ASSERT_LE(1u, result.drained);
+    ASSERT_EQ(0u, result.timedOut);
+    ASSERT_EQ(1, fbs.flushes.load());
+
+    FileBackedStore<std::string, BaseValue> reader{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    ASSERT_EQ(1, reader.getCache()->size());
+}
+
+// requests the pending flush the way a shutdown drain does, between beginDrain() and awaitDrained()
+class RequestingFileBackedStore : public CountingFileBackedStore {
+public:
+    using CountingFileBackedStore::CountingFileBackedStore;
+    using FileBackedStore::requestFlush;
+    using FileBackedStore::releaseFlush;
+};
+
+TEST_F(FileBackedStoreTest, testSynchronizeKeepsOtherFlushRequests) {
+    StoreOptions options;
+    options.flushIdle = std::chrono::seconds(10);
+    options.flushMaxDelay = std::chrono::seconds(10);
+    RequestingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE, options};
+    fbs.requestFlush();
+    fbs.store("first", Value::createValue(1));
+    fbs.synchronize();
+    ASSERT_EQ(1, fbs.flushes.load());
+
+    // the synchronize() above is over, but the outstanding request still sends the next flush straight away
+    fbs.store("second", Value::createValue(2));
+    for (int i = 0; i < 50 && fbs.flushes.load() < 2; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    ASSERT_EQ(2, fbs.flushes.load());
+    fbs.releaseFlush();
+}
+
+TEST_F(FileBackedStoreTest, testPendingFlushesDoNotHoldThePool) {
+    StoreOptions options;
+    options.flushMaxDelay = std::chrono::seconds(10);
+    options.flushIdle = std::chrono::seconds(10);
+    std::vector<std::unique_ptr<CountingFileBackedStore>> waiting;
+    for (unsigned int i = 0; i <= IOThreadPool::DEFAULT_THREAD_COUNT; i++) {
+        waiting.emplace_back(new CountingFileBackedStore(("fbstest_waiting" + std::to_string(i)).c_str(), options));
+        waiting.back()->store("pending", Value::createValue((int)i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // more stores have a flush pending than the pool has threads; another store's queue still runs
+    CountingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE};
+    fbs.store("attribute", Value::createValue(1));
+    auto start = std::chrono::steady_clock::now();
+    fbs.swap();
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+
+    for (auto& store : waiting) {
+        ASSERT_EQ(0, store->flushes.load());
+        store->synchronize();
+        ASSERT_EQ(1, store->flushes.load());
+        remove(store->getFullStorePath());
+    }
+    remove((std::string(FILEBACKSTORE_TEMP_FILE) + ".bak").c_str());
+}
+
+TEST_F(FileBackedStoreTest, testSwapFromEveryPoolThread) {
+    // every thread of the pool calls swap() at once; none of them may wait for the pool to flush
+    const unsigned int threads = IOThreadPool::shared().getThreadCount();
+    std::vector<std::unique_ptr<FileBackedStore<std::string, BaseValue>>> stores;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<WorkCompletion> swaps;
+    std::atomic<unsigned int> arrived(0);
+    std::atomic<std::size_t> swapped(0);
+    for (unsigned int i = 0; i < threads; i++) {
+        stores.emplace_back(new FileBackedStore<std::string, BaseValue>(("fbstest_pooled" + std::to_string(i)).c_str(), "", &Value::createValue));
+        stores.back()->store("huckle", Value::createValue("berry"));
+        queues.emplace_back(new WorkQueue(WorkQueue::DEFAULT_CAPACITY, WorkQueue::OverflowPolicy::Spill, &IOThreadPool::shared()));
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        FileBackedStore<std::string, BaseValue>* store = stores[i].get();
+        swaps.push_back(queues[i]->enqueueTracked([&arrived, &swapped, store, threads] {
+            arrived++;
+            while (arrived.load() < threads) {
+                std::this_thread::yield();
+            }
+            swapped += store->swap().size();
+        }));
+    }
+
+    for (auto& swap : swaps) {
+        ASSERT_EQ(WorkCompletion::Status::Completed, swap.wait(2000));
+    }
+    ASSERT_EQ(threads, swapped.load());
+    for (auto& store : stores) {
+        const std::string backup = std::string(store->getFullStorePath()) + ".bak";
+        ASSERT_FALSE(PersistentStoreHelper::storeIsEmpty(backup.c_str()));
+        remove(store->getFullStorePath());
+        remove(backup.c_str());
+    }
+}
+
+TEST_F(FileBackedStoreTest, testLoadFromEveryPoolThread) {
+    // every thread of the pool waits on a store still loading in the background, with no thread left to load it
+    const unsigned int threads = IOThreadPool::shared().getThreadCount();
+    StoreOptions options;
+    options.loading = StoreOptions::Loading::Background;
+    for (unsigned int i = 0; i < threads; i++) {
+        FileBackedStore<std::string, BaseValue> fbs{("fbstest_pooled" + std::to_string(i)).c_str(), "", &Value::createValue};
+        fbs.store("huckle", Value::createValue("berry"));
+    }
+    std::vector<std::unique_ptr<FileBackedStore<std::string, BaseValue>>> stores;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<WorkCompletion> loads;
+    std::atomic<unsigned int> arrived(0);
+    std::promise<void> opened;
+    std::shared_future<void> storesOpened = opened.get_future().share();
+    std::atomic<std::size_t> loaded(0);
+    for (unsigned int i = 0; i < threads; i++) {
+        queues.emplace_back(new WorkQueue(WorkQueue::DEFAULT_CAPACITY, WorkQueue::OverflowPolicy::Spill, &IOThreadPool::shared()));
+        loads.push_back(queues[i]->enqueueTracked([&arrived, &loaded, &stores, storesOpened, i] {
+            arrived++;
+            storesOpened.wait();
+            auto& store = *stores[i];
+            store.store("straw", Value::createValue("berry"));
+            store.synchronize();
+            loaded += store.load().size();
+        }));
+    }
+    while (arrived.load() < threads) {
+        std::this_thread::yield();
+    }
+    // the loads are queued while every pool thread is taken
+    for (unsigned int i = 0; i < threads; i++) {
+        stores.emplace_back(new FileBackedStore<std::string, BaseValue>(("fbstest_pooled" + std::to_string(i)).c_str(), "", &Value::createValue, options));
+    }
+    opened.set_value();
+
+    for (auto& load : loads) {
+        ASSERT_EQ(WorkCompletion::Status::Completed, load.wait(2000));
+    }
+    ASSERT_EQ(2 * threads, loaded.load());
+    for (auto& store : stores) {
+        remove(store->getFullStorePath());
+    }
+}
+
+TEST_F(FileBackedStoreTest, testUnreadableFileIsNotOverwritten) {
+    const char* readableLater = "fbstest_readableLater";
+    {
+        FileBackedStore<std::string, BaseValue> fbs{readableLater, "", &Value::createValue};
+        fbs.store("huckle", Value::createValue("old"));
+        fbs.store("straw", Value::createValue("berry"));
+    }
+    // a directory can't be read as a store file, just like a file there are no descriptors or memory left for
+    ASSERT_EQ(0, mkdir(FILEBACKSTORE_TEMP_FILE, 0700));
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+        fbs.store("huckle", Value::createValue("berry"));
+        fbs.synchronize();
+        struct stat st;
+        ASSERT_EQ(0, stat(FILEBACKSTORE_TEMP_FILE, &st));
+        ASSERT_TRUE(S_ISDIR(st.st_mode));
+        // still can't be read; what was stored is kept
+        ASSERT_EQ(1, fbs.load().size());
+
+        // once the file can be read, it is merged in under the writes made meanwhile
+        ASSERT_EQ(0, rmdir(FILEBACKSTORE_TEMP_FILE));
+        ASSERT_EQ(0, rename(readableLater, FILEBACKSTORE_TEMP_FILE));
+        fbs.store("goose", Value::createValue("berry"));
+        fbs.synchronize();
+    }
+
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+    auto store = fbs.load();
+    ASSERT_EQ(3, store.size());
+    ASSERT_TRUE(*Value::createValue("berry") == *store["huckle"]);
+    ASSERT_TRUE(*Value::createValue("berry") == *store["straw"]);
+    ASSERT_TRUE(*Value::createValue("berry") == *store["goose"]);
+}
+
+TEST_F(FileBackedStoreTest, testJournalReplay) {
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        fbs.store("huckle", Value::createValue("berry"));
+        fbs.store("straw", Value::createValue("berry"));
+        fbs.store("huckle", Value::createValue(1.5));
+        fbs.remove("straw");
+        fbs.synchronize();
+    }
+
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE};
+    std::string header;
+    std::getline(file, header);
+    ASSERT_EQ(std::string(FileBackedStore<std::string, BaseValue>::journalHeader()), header);
+    file.close();
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    auto map = *reloaded.getCache();
+    ASSERT_EQ(1, map.size());
+    ASSERT_TRUE(*Value::createValue(1.5) == *map["huckle"]);
+}
+
+TEST_F(FileBackedStoreTest, testJournalCompaction) {
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.compactionMinRecords = 16;
+    options.compactionThreshold = 0.5;
+
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    for (int i = 0; i < 100; i++) {
+        fbs.store("counter", Value::createValue(i));
+        fbs.load(); // forces the pending record out
+    }
+    fbs.synchronize();
+
+    // 100 overwrites of one key would be 100 records without compaction
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE};
+    std::string line;
+    int lines = 0;
+    while (std::getline(file, line)) lines++;
+    ASSERT_LT(lines, 2 * 16 + 1);
+
+    auto map = fbs.load();
+    ASSERT_EQ(1, map.size());
+    ASSERT_TRUE(*Value::createValue(99) == *map["counter"]);
+}
+
+static int countLines(const char* path) {
+    std::ifstream file{path};
+    std::string line;
+    int lines = 0;
+    while (std::getline(file, line)) lines++;
+    return lines;
+}
+
+TEST_F(FileBackedStoreTest, testRemoveAllWritesOneBatch) {
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.compactionMinRecords = 100000;
+
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    std::vector<std::string> keys;
+    for (int i = 0; i < 200; i++) {
+        keys.push_back("key" + std::to_string(i));
+        fbs.store(keys.back(), Value::createValue(i));
+    }
+    fbs.synchronize();
+    ASSERT_EQ(1 + 2 * 200, countLines(FILEBACKSTORE_TEMP_FILE));
+
+    // a few keys: one tombstone each
+    fbs.removeAll(std::vector<std::string>(keys.begin(), keys.begin() + 5));
+    fbs.synchronize();
+    ASSERT_EQ(1 + 2 * 200 + 5, countLines(FILEBACKSTORE_TEMP_FILE));
+
+    // most of the store: rewritten from the 5 entries left rather than 190 more tombstones
+    fbs.removeAll(std::vector<std::string>(keys.begin() + 5, keys.begin() + 195));
+    fbs.synchronize();
+    ASSERT_EQ(1 + 2 * 5, countLines(FILEBACKSTORE_TEMP_FILE));
+
+    FileBackedStore<std::string, BaseValue> reader{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    auto map = *reader.getCache();
+    ASSERT_EQ(5, map.size());
+    ASSERT_TRUE(*Value::createValue(199) == *map["key199"]);
+}
+
+TEST_F(FileBackedStoreTest, testJournalMigratesLegacyFile) {
+    {
+        FileBackedStore<std::string, BaseValue> legacy{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+        legacy.store("huckle", Value::createValue("berry"));
+        legacy.synchronize();
+    }
+
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_EQ(1, fbs.getCache()->size());
+
+    fbs.store("straw", Value::createValue("berry"));
+    auto map = fbs.load();
+    ASSERT_EQ(2, map.size());
+}
+
+TEST_F(FileBackedStoreTest, testBinaryRoundTrip) {
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        fbs.store("huckle", Value::createValue("berry\nwith a newline"));
+        fbs.store("straw", Value::createValue(1.5));
+        fbs.synchronize();
+        fbs.load();
+    }
+
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    ASSERT_EQ(std::string("NRSB"), std::string(magic, sizeof(magic)));
+    file.close();
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    auto map = *reloaded.getCache();
+    ASSERT_EQ(2, map.size());
+    ASSERT_TRUE(*Value::createValue("berry\nwith a newline") == *map["huckle"]);
+    ASSERT_TRUE(*Value::createValue(1.5) == *map["straw"]);
+}
+
+TEST_F(FileBackedStoreTest, testBinaryDropsOnlyDamagedRecords) {
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        fbs.store("aaaa", Value::createValue("first"));
+        fbs.load();
+        fbs.store("bbbb", Value::createValue("second"));
+        fbs.load();
+        fbs.store("cccc", Value::createValue("third"));
+        fbs.load();
+    }
+
+    std::string bytes;
+    {
+        std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    // flip a byte inside the second record's key, then tear the last record in half
+    auto second = bytes.find("bbbb");
+    ASSERT_NE(std::string::npos, second);
+    bytes[second] = 'x';
+    auto third = bytes.find("cccc");
+    ASSERT_NE(std::string::npos, third);
+    bytes.resize(third + 2);
+    {
+        std::ofstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary | std::ios::trunc};
+        file.write(bytes.data(), bytes.size());
+    }
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    auto map = *reloaded.getCache();
+    ASSERT_EQ(1, map.size());
+    ASSERT_TRUE(*Value::createValue("first") == *map["aaaa"]);
+
+    // the damaged file is rewritten, so later appends land after a clean record
+    reloaded.store("dddd", Value::createValue("fourth"));
+    reloaded.load();
+    FileBackedStore<std::string, BaseValue> again{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_EQ(2, again.load().size());
+}
+
+TEST_F(FileBackedStoreTest, testBinaryMigratesTextFile) {
+    {
+        FileBackedStore<std::string, BaseValue> legacy{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue};
+        legacy.store("huckle", Value::createValue("berry"));
+        legacy.synchronize();
+        legacy.load();
+    }
+
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        ASSERT_EQ(1, fbs.getCache()->size());
+        fbs.synchronize();
+    }
+
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    ASSERT_EQ(std::string("NRSB"), std::string(magic, sizeof(magic)));
+    file.close();
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_TRUE(*Value::createValue("berry") == *reloaded.getCache()->at("huckle"));
+}
+
+TEST_F(FileBackedStoreTest, testBinaryMovesOffLegacyFile) {
+    {
+        // what an older release left: a text store under the old name
+        FileBackedStore<std::string, BaseValue> legacy{FILEBACKSTORE_LEGACY_FILE, "", &Value::createValue};
+        legacy.store("huckle", Value::createValue("berry"));
+        legacy.synchronize();
+    }
+
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.legacyFilename = FILEBACKSTORE_LEGACY_FILE;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        ASSERT_TRUE(*Value::createValue("berry") == *fbs.getCache()->at("huckle"));
+        fbs.synchronize();
+    }
+
+    // the old name is gone, so a release that only reads text starts empty rather than misreading binary
+    std::ifstream legacyFile{FILEBACKSTORE_LEGACY_FILE};
+    ASSERT_FALSE(legacyFile.good());
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    ASSERT_EQ(std::string("NRSB"), std::string(magic, sizeof(magic)));
+    file.close();
+
+    {
+        // a legacy file showing up next to the store's own file is stale; it's removed, not read
+        FileBackedStore<std::string, BaseValue> stale{FILEBACKSTORE_LEGACY_FILE, "", &Value::createValue};
+        stale.store("huckle", Value::createValue("stale"));
+        stale.synchronize();
+    }
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_TRUE(*Value::createValue("berry") == *reloaded.getCache()->at("huckle"));
+    std::ifstream staleFile{FILEBACKSTORE_LEGACY_FILE};
+    ASSERT_FALSE(staleFile.good());
+}
+
+TEST_F(FileBackedStoreTest, testBinaryMigratesTextValues) {
+    // a version 1 file: binary records holding operator<< text values
+    std::string bytes;
+    RecordFormat::appendHeader(bytes);
+    bytes[4] = (char)RecordFormat::TEXT_VALUES_VERSION;
+    std::ostringstream value;
+    value << *Value::createValue(1.5);
+    RecordFormat::appendRecord(bytes, RecordFormat::PUT, "straw", 5, value.str().data(), value.str().size());
+    {
+        std::ofstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary | std::ios::trunc};
+        file.write(bytes.data(), bytes.size());
+    }
+
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        ASSERT_TRUE(*Value::createValue(1.5) == *fbs.getCache()->at("straw"));
+        fbs.synchronize();
+    }
+
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+    char header[RecordFormat::HEADER_SIZE];
+    file.read(header, sizeof(header));
+    ASSERT_EQ((int)RecordFormat::VERSION, (int)(uint8_t)header[4]);
+    file.close();
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_TRUE(*Value::createValue(1.5) == *reloaded.getCache()->at("straw"));
+}
+
+TEST_F(FileBackedStoreTest, testEntryLimitEvictsOldest) {
+    StoreOptions options;
+    options.maxEntries = 3;
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    fbs.store("a", Value::createValue(1));
+    fbs.store("b", Value::createValue(2));
+    fbs.store("c", Value::createValue(3));
+    fbs.store("d", Value::createValue(4));
+    ASSERT_EQ(3, fbs.getCache()->size());
+    ASSERT_EQ(nullptr, fbs.get("a"));
+
+    // storing a key again makes it the newest
+    fbs.store("b", Value::createValue(5));
+    fbs.store("e", Value::createValue(6));
+    ASSERT_EQ(nullptr, fbs.get("c"));
+    ASSERT_NE(nullptr, fbs.get("b"));
+    ASSERT_EQ(2, fbs.getEvictionCounts().entries);
+
+    fbs.synchronize();
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_EQ(3, reloaded.getCache()->size());
+}
+
+TEST_F(FileBackedStoreTest, testAgeLimitEvictsExpired) {
+    StoreOptions options;
+    options.maxAge = std::chrono::milliseconds(20);
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    fbs.store("old", Value::createValue(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    fbs.store("new", Value::createValue(2));
+
+    ASSERT_EQ(nullptr, fbs.get("old"));
+    ASSERT_NE(nullptr, fbs.get("new"));
+    ASSERT_EQ(1, fbs.getEvictionCounts().age);
+}
+
+TEST_F(FileBackedStoreTest, testByteLimitBoundsFile) {
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.maxBytes = 4096;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        for (int i = 0; i < 500; i++) {
+            fbs.store("key" + std::to_string(i), Value::createValue("a value of some length"));
+            if (i % 50 == 49) {
+                fbs.load(); // forces the pending records out
+                std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary | std::ios::ate};
+                ASSERT_LE((std::size_t)file.tellg(), options.maxBytes);
+            }
+        }
+        ASSERT_GT(fbs.getEvictionCounts().bytes, 0);
+        // the newest entries are the ones kept
+        ASSERT_NE(nullptr, fbs.get("key499"));
+        ASSERT_EQ(nullptr, fbs.get("key0"));
+    }
+
+    std::ifstream file{FILEBACKSTORE_TEMP_FILE, std::ios::binary | std::ios::ate};
+    ASSERT_LE((std::size_t)file.tellg(), options.maxBytes);
+    file.close();
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    ASSERT_NE(nullptr, reloaded.get("key499"));
+}
+
+TEST_F(FileBackedStoreTest, testBackgroundLoad) {
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        for (int i = 0; i < 5000; i++) {
+            fbs.store("key" + std::to_string(i), Value::createValue(i));
+        }
+        fbs.synchronize();
+    }
+
+    options.loading = StoreOptions::Loading::Background;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        // writes made while the file is still being read win over what's in it
+        fbs.store("key0", Value::createValue("newer"));
+        fbs.remove("key1");
+        ASSERT_TRUE(fbs.awaitLoaded(5000));
+
+        auto map = *fbs.getCache();
+        ASSERT_EQ(4999, map.size());
+        ASSERT_TRUE(*Value::createValue("newer") == *map["key0"]);
+        ASSERT_EQ(0, map.count("key1"));
+        ASSERT_TRUE(*Value::createValue(4999) == *map["key4999"]);
+        fbs.synchronize();
+    }
+
+    FileBackedStore<std::string, BaseValue> reloaded{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    auto map = reloaded.load(); // waits for the load
+    ASSERT_EQ(4999, map.size());
+    ASSERT_TRUE(*Value::createValue("newer") == *map["key0"]);
+    ASSERT_EQ(0, map.count("key1"));
+}
+
+TEST_F(FileBackedStoreTest, testClearDuringBackgroundLoad) {
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    {
+        FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+        for (int i = 0; i < 5000; i++) {
+            fbs.store("key" + std::to_string(i), Value::createValue(i));
+        }
+        fbs.synchronize();
+    }
+
+    options.loading = StoreOptions::Loading::Background;
+    FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+    fbs.clear();
+    fbs.store("huckle", Value::createValue("berry"));
+    ASSERT_TRUE(fbs.awaitLoaded(5000));
+    ASSERT_EQ(1, fbs.getCache()->size());
+    ASSERT_EQ(1, fbs.load().size());
+}
+
+// Stands in for the process dying part way through a write: once `budget` bytes have gone
+// out, the write in progress stops there and nothing after it reaches the file.
+class CrashingFileBackedStore : public FileBackedStore<std::string, BaseValue> {
+public:
+    CrashingFileBackedStore(const char* filename, const StoreOptions& options, std::size_t budget)
+            : FileBackedStore(filename, "", &Value::createValue, options),
+              _budget(budget) {}
+
+protected:
+    virtual void writeBytes(int fd, const char* data, std::size_t length) {
+        if (length > _budget) {
+            FileBackedStore::writeBytes(fd, data, _budget);
+            _budget = 0;
+            throw std::runtime_error("killed");
+        }
+        _budget -= length;
+        FileBackedStore::writeBytes(fd, data, length);
+    }
+
+private:
+    std::size_t _budget;
+};
+
+static std::map<std::string, std::string> contents(const std::map<std::string, std::shared_ptr<BaseValue>>& map) {
+    std::map<std::string, std::string> result;
+    for (const auto& entry : map) {
+        std::ostringstream os;
+        os << *entry.second;
+        result[entry.first] = os.str();
+    }
+    return result;
+}
+
+TEST_F(FileBackedStoreTest, testAtomicReplaceSurvivesTornWrites) {
+    const char* crashCopy = "fbstest_crashCopy";
+    std::mt19937 random(20231017);
+
+    for (auto writeMode : {StoreOptions::WriteMode::Rewrite, StoreOptions::WriteMode::Journal}) {
+        StoreOptions options;
+        options.format = StoreOptions::Format::Binary;
+        options.durability = StoreOptions::Durability::AtomicReplace;
+        options.writeMode = writeMode;
+
+        for (int iteration = 0; iteration < 25; iteration++) {
+            remove(FILEBACKSTORE_TEMP_FILE);
+            std::map<std::string, std::string> state;
+            {
+                FileBackedStore<std::string, BaseValue> fbs{FILEBACKSTORE_TEMP_FILE, "", &Value::createValue, options};
+                for (int i = 0; i < 10; i++) {
+                    fbs.store("key" + std::to_string(i), Value::createValue("old"));
+                }
+                state = contents(fbs.load());
+            }
+
+            // every state the file may legitimately hold: the old one, then one more update at a time
+            std::vector<std::map<std::string, std::string>> states{state};
+            std::vector<std::pair<std::string, std::string>> updates;
+            for (int i = 0; i < 15; i++) {
+                updates.emplace_back("key" + std::to_string(i * 7 % 13), std::to_string(i));
+            }
+            for (const auto& update : updates) {
+                state[update.first] = contents({{update.first, Value::createValue(update.second.c_str())}})[update.first];
+                states.push_back(state);
+            }
+
+            {
+                CrashingFileBackedStore fbs{FILEBACKSTORE_TEMP_FILE, options, std::uniform_int_distribution<std::size_t>(0, 600)(random)};
+                for (const auto& update : updates) {
+                    fbs.store(update.first, Value::createValue(update.second.c_str()));
+                }
+                fbs.synchronize();
+
+                // snapshot the disk as the crash left it; the store's destructor would still write
+                std::ifstream in{FILEBACKSTORE_TEMP_FILE, std::ios::binary};
+                std::ofstream out{crashCopy, std::ios::binary | std::ios::trunc};
+                out << in.rdbuf();
+            }
+
+            FileBackedStore<std::string, BaseValue> recovered{crashCopy, "", &Value::createValue, options};
+            auto loaded = contents(*recovered.getCache());
+            ASSERT_NE(states.end(), std::find(states.begin(), states.end(), loaded)) << "iteration " << iteration;
+        }
+    }
+    remove(crashCopy);
+    remove((std::string(FILEBACKSTORE_TEMP_FILE) + ".tmp").c_str());
+}
 } // namespace NewRelic
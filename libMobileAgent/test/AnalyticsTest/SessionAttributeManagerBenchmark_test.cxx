@@ -0,0 +1,73 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/SessionAttributeManager.hpp>
+#include <Utilities/Value.hpp>
+#include <atomic>
+#include <iostream>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+#include "AnalyticsBenchmarkHelper.hpp"
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+static const char* BENCHMARK_ATTRIBUTE_STORE = "attributebenchmark_attributes";
+static const char* BENCHMARK_ATTRIBUTE_DUP_STORE = "attributebenchmark_dup";
+
+class SessionAttributeManagerBenchmark : public ::testing::Test {
+protected:
+    static const int OPERATIONS_PER_THREAD = 4000;
+
+    virtual void SetUp() {
+        std::remove(BENCHMARK_ATTRIBUTE_STORE);
+        std::remove(BENCHMARK_ATTRIBUTE_DUP_STORE);
+    }
+
+    virtual void TearDown() {
+        std::remove(BENCHMARK_ATTRIBUTE_STORE);
+        std::remove(BENCHMARK_ATTRIBUTE_DUP_STORE);
+    }
+
+    // Readers take attribute snapshots the way every handled-exception report and harvest does;
+    // writers increment attributes. Returns operations per second across all threads.
+    static double run(int readers,
+                      int writers) {
+        PersistentStore<std::string, BaseValue> attributeStore{BENCHMARK_ATTRIBUTE_STORE, "", &Value::createValue};
+        PersistentStore<std::string, BaseValue> dupStore{BENCHMARK_ATTRIBUTE_DUP_STORE, "", &Value::createValue};
+        SessionAttributeManager manager{attributeStore, dupStore, AnalyticsBenchmarkHelper::validator()};
+        for (int i = 0; i < 64; i++) {
+            manager.addSessionAttribute(("attribute" + std::to_string(i)).c_str(), (long long)i);
+        }
+
+        std::atomic<unsigned long long> sizes{0};
+        auto elapsed = BenchmarkHelper::secondsOnThreads(readers + writers, [&](int t) {
+            if (t < readers) {
+                for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+                    if (i % 8 == 0) {
+                        sizes += manager.generateJSONObject()->size();
+                    } else {
+                        sizes += manager.getSessionAttributes().size();
+                    }
+                }
+            } else {
+                const int w = t - readers;
+                for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+                    manager.incrementAttribute(("attribute" + std::to_string((w * 7 + i) % 64)).c_str(), 1ULL);
+                }
+            }
+        });
+
+        attributeStore.synchronize();
+        dupStore.synchronize();
+        return (double)(readers + writers) * OPERATIONS_PER_THREAD / elapsed;
+    }
+};
+
+TEST_F(SessionAttributeManagerBenchmark, DISABLED_testMixedReadWrite) {
+    for (auto mix : {std::make_pair(8, 0), std::make_pair(7, 1), std::make_pair(4, 4), std::make_pair(1, 7)}) {
+        std::cout << mix.first << " readers, " << mix.second << " writers: "
+                  << (long long)run(mix.first, mix.second) << " ops/s" << std::endl;
+    }
+}
+} // namespace NewRelic
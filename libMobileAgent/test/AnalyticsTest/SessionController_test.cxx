@@ -74,6 +74,8 @@ namespace NewRelic {
     public:
         MockPersistentStore(const char *sharedPath, AttributeValidator &validator) : PersistentStore<K, T>(
                 "blah.txt", "", &Value::createValue) {
+            ON_CALL(*this, getCache())
+                    .WillByDefault(Return(std::make_shared<const std::map<K, std::shared_ptr<T>>>()));
         }
 
         virtual ~MockPersistentStore() { }
@@ -86,6 +88,8 @@ namespace NewRelic {
                 name));
 
         MOCK_METHOD0_T(load, std::map<K, std::shared_ptr<T>>(void));
+
+        MOCK_METHOD0_T(getCache, std::shared_ptr<const std::map<K, std::shared_ptr<T>>>(void));
     };
 
 
@@ -158,8 +162,8 @@ namespace NewRelic {
         map["hello"] = attrib->getValue();
         map["blah"] = attrib2->getValue();
 
-        EXPECT_CALL((persistentStore), load())
-                .WillOnce(Return(map));
+        EXPECT_CALL((persistentStore), getCache())
+                .WillOnce(Return(std::make_shared<const std::map<std::string, std::shared_ptr<BaseValue>>>(map)));
         //this gets called when the persistent attributes are pushed to the in memory std::map.
         EXPECT_CALL((persistentStore), store(_, _))
                 .Times(2);
@@ -414,6 +418,47 @@ namespace NewRelic {
         ASSERT_TRUE((*json)["6"].as_float() == 59.0f);
     };
 
+    TEST_F(SessionAttributesTest, testConcurrentIncrements) {
+        MockPersistentStore<std::string, BaseValue> persistentStore{"", validator};
+        PersistentStore<std::string, BaseValue> store{storeName, "", &Value::createValue};
+        SessionAttributeManager attributeManager(persistentStore, store, validator);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&attributeManager]() {
+                for (int i = 0; i < 250; i++) {
+                    attributeManager.incrementAttribute("counter", 1ULL);
+                    attributeManager.getSessionAttributes();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        // each increment reads and writes under one lock; none is lost
+        auto json = attributeManager.generateJSONObject();
+        ASSERT_EQ(1000, (*json)["counter"].as_float());
+    }
+
+    TEST_F(SessionAttributesTest, testSnapshotIsNotChangedByLaterWrites) {
+        MockPersistentStore<std::string, BaseValue> persistentStore{"", validator};
+        PersistentStore<std::string, BaseValue> store{storeName, "", &Value::createValue};
+        SessionAttributeManager attributeManager(persistentStore, store, validator);
+
+        attributeManager.addSessionAttribute("counter", 1ULL, true);
+        auto snapshot = attributeManager.getSessionAttributes();
+        attributeManager.incrementAttribute("counter", 1ULL);
+        attributeManager.addSessionAttribute("counter", 5ULL, false);
+
+        // the snapshot's attributes are read outside the lock; writes replace them instead
+        auto counter = snapshot["counter"];
+        ASSERT_TRUE(*counter->getValue() == *Value::createValue(1ULL));
+        ASSERT_TRUE(counter->getPersistent());
+        ASSERT_EQ(5, (*attributeManager.generateJSONObject())["counter"].as_float());
+        ASSERT_FALSE(attributeManager.getSessionAttributes().at("counter")->getPersistent());
+    }
+
     TEST_F(SessionAttributesTest, testAttributeValidation) {
         auto validatorPtr = validator;
         MockPersistentStore<std::string, BaseValue> persistentStore{"", validator};
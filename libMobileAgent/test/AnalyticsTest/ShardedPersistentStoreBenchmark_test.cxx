@@ -0,0 +1,95 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/Stores/ShardedPersistentStore.hpp>
+#include <Analytics/EventManager.hpp>
+#include <Utilities/Value.hpp>
+#include <iostream>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+#include "AnalyticsBenchmarkHelper.hpp"
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+static const char* BENCHMARK_EVENT_STORE = "shardbenchmark_events";
+static const char* BENCHMARK_ATTRIBUTE_STORE = "shardbenchmark_attributes";
+
+class ShardedPersistentStoreBenchmark : public ::testing::Test {
+protected:
+    static const int OPERATIONS_PER_THREAD = 5000;
+
+    virtual void SetUp() {
+        removeFiles();
+    }
+
+    virtual void TearDown() {
+        removeFiles();
+    }
+
+    static void removeFiles() {
+        for (const char* name : {BENCHMARK_EVENT_STORE, BENCHMARK_ATTRIBUTE_STORE}) {
+            std::remove(name);
+            for (unsigned int i = 0; i < ShardedPersistentStore<std::string, BaseValue>::DEFAULT_SHARD_COUNT; i++) {
+                std::remove((std::string(name) + "." + std::to_string(i)).c_str());
+            }
+        }
+    }
+
+    // Each thread records events and attributes under its own keys, the way EventManager and
+    // SessionAttributeManager feed their dup stores. Returns operations per second.
+    static double run(PersistentStore<std::string, AnalyticEvent>& events,
+                      PersistentStore<std::string, BaseValue>& attributes,
+                      int threads) {
+        std::vector<std::vector<std::pair<std::string, std::shared_ptr<AnalyticEvent>>>> prepared(threads);
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < OPERATIONS_PER_THREAD / 2; i++) {
+                auto event = EventManager::newCustomEvent("Benchmark", 1000 + i, t, AnalyticsBenchmarkHelper::validator());
+                event->addAttribute("thread", t);
+                event->addAttribute("index", i);
+                prepared[t].emplace_back(EventManager::createKey(event), event);
+            }
+        }
+
+        auto elapsed = BenchmarkHelper::secondsOnThreads(threads, [&](int t) {
+            for (int i = 0; i < OPERATIONS_PER_THREAD / 2; i++) {
+                events.store(prepared[t][i].first, prepared[t][i].second);
+                attributes.store("attribute" + std::to_string(t) + "_" + std::to_string(i % 64), Value::createValue(i));
+            }
+        });
+
+        events.synchronize();
+        attributes.synchronize();
+        return (double)threads * OPERATIONS_PER_THREAD / elapsed;
+    }
+};
+
+TEST_F(ShardedPersistentStoreBenchmark, DISABLED_testConcurrentWriters) {
+    StoreOptions options;
+    options.writeMode = StoreOptions::WriteMode::Journal;
+    options.format = StoreOptions::Format::Binary;
+
+    for (int threads : {1, 2, 4, 8}) {
+        double single;
+        {
+            PersistentStore<std::string, AnalyticEvent> events{BENCHMARK_EVENT_STORE, "", &EventManager::newEvent, options};
+            PersistentStore<std::string, BaseValue> attributes{BENCHMARK_ATTRIBUTE_STORE, "", &Value::createValue, options};
+            single = run(events, attributes, threads);
+            ASSERT_EQ(threads * OPERATIONS_PER_THREAD / 2, events.getCache()->size());
+        }
+        removeFiles();
+
+        double sharded;
+        {
+            ShardedPersistentStore<std::string, AnalyticEvent> events{BENCHMARK_EVENT_STORE, "", &EventManager::newEvent, options};
+            ShardedPersistentStore<std::string, BaseValue> attributes{BENCHMARK_ATTRIBUTE_STORE, "", &Value::createValue, options};
+            sharded = run(events, attributes, threads);
+            ASSERT_EQ(threads * OPERATIONS_PER_THREAD / 2, events.getCache()->size());
+        }
+        removeFiles();
+
+        std::cout << threads << " threads: single store " << (long long)single << " ops/s"
+                  << ", sharded " << (long long)sharded << " ops/s" << std::endl;
+    }
+}
+} // namespace NewRelic
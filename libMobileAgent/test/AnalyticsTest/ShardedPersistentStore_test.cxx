@@ -0,0 +1,144 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/Stores/ShardedPersistentStore.hpp>
+#include <Utilities/Value.hpp>
+#include "PersistentStoreHelper.hpp"
+#include <sys/stat.h>
+#include <gmock/gmock.h>
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+static const char* SHARDED_STORE_NAME = "shardedStore";
+static const char* SHARDED_LEGACY_NAME = "shardedStore.txt";
+static const unsigned int SHARD_COUNT = 4;
+
+class ShardedPersistentStoreTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        removeFiles();
+    }
+
+    virtual void TearDown() {
+        removeFiles();
+    }
+
+    static void removeFiles() {
+        std::remove(SHARDED_STORE_NAME);
+        std::remove(SHARDED_LEGACY_NAME);
+        for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+            const std::string shard = std::string(SHARDED_STORE_NAME) + "." + std::to_string(i);
+            std::remove(shard.c_str());
+            std::remove((shard + ".bak").c_str());
+        }
+    }
+};
+
+TEST_F(ShardedPersistentStoreTest, testStoreAndReload) {
+    {
+        ShardedPersistentStore<std::string, BaseValue> store{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+        for (int i = 0; i < 100; i++) {
+            store.store("key" + std::to_string(i), Value::createValue(i));
+        }
+        store.remove("key7");
+        ASSERT_EQ(99, store.getCache()->size());
+        ASSERT_TRUE(*Value::createValue(42) == *store.get("key42"));
+        ASSERT_EQ(nullptr, store.get("key7"));
+        store.synchronize();
+    }
+
+    // keys are spread over the shard files
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        const std::string shard = std::string(SHARDED_STORE_NAME) + "." + std::to_string(i);
+        ASSERT_FALSE(PersistentStoreHelper::storeIsEmpty(shard.c_str()));
+    }
+
+    ShardedPersistentStore<std::string, BaseValue> reloaded{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+    auto map = reloaded.load();
+    ASSERT_EQ(99, map.size());
+    ASSERT_TRUE(*Value::createValue(99) == *map["key99"]);
+
+    auto swapped = reloaded.swap();
+    ASSERT_EQ(99, swapped.size());
+    ASSERT_TRUE(reloaded.getCache()->empty());
+}
+
+TEST_F(ShardedPersistentStoreTest, testShardOfKeyIsStable) {
+    {
+        ShardedPersistentStore<std::string, BaseValue> store{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+        store.store("huckle", Value::createValue("berry"));
+        store.synchronize();
+    }
+
+    // the key's CRC-32 picks the shard, in every build; a reopened store looks for it there
+    const unsigned int expected = Util::Checksum::crc32("huckle", 6) % SHARD_COUNT;
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        const std::string shard = std::string(SHARDED_STORE_NAME) + "." + std::to_string(i);
+        struct stat info;
+        const bool written = ::stat(shard.c_str(), &info) == 0 && info.st_size > 0;
+        ASSERT_EQ(i == expected, written);
+    }
+}
+
+TEST_F(ShardedPersistentStoreTest, testThroughBaseInterface) {
+    ShardedPersistentStore<std::string, BaseValue> sharded{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+    PersistentStore<std::string, BaseValue>& store = sharded;
+    store.store("huckle", Value::createValue("berry"));
+    store.synchronize();
+    ASSERT_EQ(1, store.load().size());
+    ASSERT_EQ(std::string(SHARDED_STORE_NAME), store.getFullStorePath());
+    store.clear();
+    store.synchronize();
+    ASSERT_TRUE(store.load().empty());
+}
+
+TEST_F(ShardedPersistentStoreTest, testMigratesUnshardedFile) {
+    {
+        PersistentStore<std::string, BaseValue> unsharded{SHARDED_STORE_NAME, "", &Value::createValue};
+        unsharded.store("huckle", Value::createValue("berry"));
+        unsharded.store("straw", Value::createValue("berry"));
+        unsharded.synchronize();
+    }
+
+    ShardedPersistentStore<std::string, BaseValue> store{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+    ASSERT_FALSE(PersistentStoreHelper::storeExists(SHARDED_STORE_NAME));
+    ASSERT_EQ(2, store.getCache()->size());
+
+    ShardedPersistentStore<std::string, BaseValue> reloaded{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+    ASSERT_EQ(2, reloaded.load().size());
+}
+
+TEST_F(ShardedPersistentStoreTest, testUnreadableUnshardedFileIsKept) {
+    // a directory can't be read as a store file; it stands in for a file there's no memory or descriptor left for
+    ASSERT_EQ(0, mkdir(SHARDED_STORE_NAME, 0700));
+    {
+        ShardedPersistentStore<std::string, BaseValue> store{SHARDED_STORE_NAME, "", &Value::createValue, SHARD_COUNT};
+        ASSERT_EQ(0, store.load().size());
+    }
+    struct stat st;
+    ASSERT_EQ(0, stat(SHARDED_STORE_NAME, &st));
+    ASSERT_TRUE(S_ISDIR(st.st_mode));
+}
+
+TEST_F(ShardedPersistentStoreTest, testMigratesLegacyFileOnce) {
+    {
+        PersistentStore<std::string, BaseValue> legacy{SHARDED_LEGACY_NAME, "", &Value::createValue};
+        legacy.store("huckle", Value::createValue("berry"));
+        legacy.store("straw", Value::createValue("berry"));
+        legacy.synchronize();
+    }
+
+    StoreOptions options;
+    options.format = StoreOptions::Format::Binary;
+    options.legacyFilename = SHARDED_LEGACY_NAME;
+    ShardedPersistentStore<std::string, BaseValue> store{SHARDED_STORE_NAME, "", &Value::createValue, options, SHARD_COUNT};
+    ASSERT_FALSE(PersistentStoreHelper::storeExists(SHARDED_LEGACY_NAME));
+    ASSERT_EQ(2, store.load().size());
+
+    // each entry landed in its own shard, not in whichever shard found the legacy file
+    store.remove("huckle");
+    store.remove("straw");
+    ASSERT_EQ(0, store.load().size());
+}
+} // namespace NewRelic
@@ -0,0 +1,77 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/Stores/StoreCodec.hpp>
+#include <Analytics/EventManager.hpp>
+#include <Analytics/EventDeserializer.hpp>
+#include <Utilities/Value.hpp>
+#include <gmock/gmock.h>
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+class StoreCodecTest : public ::testing::Test {
+protected:
+    template<typename T>
+    static std::shared_ptr<T> roundTrip(const T& value) {
+        StoreCodec<T> codec{nullptr};
+        std::string bytes;
+        codec.encode(value, bytes);
+        return codec.decode(bytes.data(), bytes.size());
+    }
+};
+
+TEST_F(StoreCodecTest, testValueRoundTrip) {
+    // the text form only keeps 15 significant digits
+    const double precise = 0.1 + 0.2;
+    auto number = roundTrip<BaseValue>(*Value::createValue(precise));
+    ASSERT_EQ(precise, std::static_pointer_cast<Number>(number)->doubleValue());
+
+    auto string = Value::createValue("tab\tand\nnewline");
+    ASSERT_TRUE(*string == *roundTrip<BaseValue>(*string));
+
+    auto large = Value::createValue(0xFFFFFFFFFFFFFFFFull);
+    ASSERT_TRUE(*large == *roundTrip<BaseValue>(*large));
+
+    auto negative = Value::createValue(-42ll);
+    ASSERT_TRUE(*negative == *roundTrip<BaseValue>(*negative));
+
+    auto boolean = Value::createValue(true);
+    ASSERT_TRUE(*boolean == *roundTrip<BaseValue>(*boolean));
+}
+
+TEST_F(StoreCodecTest, testValueRejectsDamagedBytes) {
+    StoreCodec<BaseValue> codec{nullptr};
+    std::string bytes;
+    codec.encode(*Value::createValue("berry"), bytes);
+
+    ASSERT_THROW(codec.decode(bytes.data(), bytes.size() - 1), std::runtime_error);
+    bytes.push_back('x');
+    ASSERT_THROW(codec.decode(bytes.data(), bytes.size()), std::runtime_error);
+    bytes[0] = '?';
+    ASSERT_THROW(codec.decode(bytes.data(), bytes.size()), std::runtime_error);
+}
+
+TEST_F(StoreCodecTest, testEventRoundTrip) {
+    auto validator = AttributeValidator([](const char*) { return true; },
+                                        [](const char*) { return true; },
+                                        [](const char*) { return true; });
+    auto event = EventManager::newCustomEvent("Fruit", 1234567890123, 0.1 + 0.2, validator);
+    event->addAttribute("name", "huckle\tberry");
+    event->addAttribute("weight", 12.000000000000002);
+    event->addAttribute("count", 3ull);
+    event->addAttribute("ripe", true);
+
+    auto decoded = roundTrip<AnalyticEvent>(*event);
+    ASSERT_TRUE(*event == *decoded);
+    std::stringstream original, restored;
+    original << *event;
+    restored << *decoded;
+    ASSERT_EQ(original.str(), restored.str());
+    ASSERT_EQ(event->getEventType(), decoded->getEventType());
+
+    auto interaction = EventManager::newInteractionAnalyticEvent("Display MainView", 1, 2.5, validator);
+    auto decodedInteraction = roundTrip<AnalyticEvent>(*interaction);
+    ASSERT_TRUE(*interaction == *decodedInteraction);
+}
+} // namespace NewRelic
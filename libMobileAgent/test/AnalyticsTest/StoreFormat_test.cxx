@@ -0,0 +1,64 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Analytics/Stores/StoreFormat.hpp>
+#include <Analytics/Stores/RecordFormat.hpp>
+#include <gmock/gmock.h>
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+TEST(StoreFormatTest, testJournalStopsAtTornRecord) {
+    const std::string journal = std::string(StoreFormat::JOURNAL_HEADER) + "\n+huckle\nberry\n-straw\n+rasp";
+    const std::size_t offset = StoreFormat::journalStart(journal.data(), journal.size());
+    ASSERT_EQ(std::string(StoreFormat::JOURNAL_HEADER).size() + 1, offset);
+
+    std::vector<std::string> records;
+    bool complete = StoreFormat::readJournal(journal.data(), journal.size(), offset, [&](char type,
+                                                                                         const char* key,
+                                                                                         std::size_t keyLength,
+                                                                                         const char* value,
+                                                                                         std::size_t valueLength) {
+        records.push_back(type + std::string(key, keyLength) + "=" + std::string(value, valueLength));
+    });
+
+    // the put of "rasp" lost its value line; what came before it stands
+    ASSERT_FALSE(complete);
+    ASSERT_EQ((std::vector<std::string>{"+huckle=berry", "-straw="}), records);
+}
+
+TEST(StoreFormatTest, testReadPairs) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    const std::string bytes = "huckle\nberry\nstraw";
+    StoreFormat::readPairs(bytes.data(), bytes.size(), [&](const char* key,
+                                                           std::size_t keyLength,
+                                                           const char* value,
+                                                           std::size_t valueLength) {
+        pairs.emplace_back(std::string(key, keyLength), std::string(value, valueLength));
+    });
+
+    ASSERT_EQ(2, pairs.size());
+    ASSERT_EQ(std::make_pair(std::string("huckle"), std::string("berry")), pairs[0]);
+    ASSERT_EQ(std::make_pair(std::string("straw"), std::string()), pairs[1]);
+}
+
+TEST(StoreFormatTest, testJournalStartNeedsHeaderLine) {
+    const std::string legacy = "huckle\nberry\n";
+    ASSERT_EQ(0, StoreFormat::journalStart(legacy.data(), legacy.size()));
+    ASSERT_EQ(0, StoreFormat::journalStart(nullptr, 0));
+}
+
+TEST(StoreFormatTest, testDropsOldestUntilWithinBudget) {
+    // a 2 byte header, then records of 3, 4 and 5 bytes
+    std::string bytes = "HHaaabbbbccccc";
+    const std::vector<std::size_t> sizes{3, 4, 5};
+
+    std::vector<bool> dropped;
+    // record 1 is the oldest, then record 2
+    ASSERT_EQ(2, StoreFormat::chooseDropped(bytes.size(), sizes, {1, 2, 0}, 5, dropped));
+    ASSERT_EQ((std::vector<bool>{false, true, true}), dropped);
+
+    StoreFormat::removeRecords(bytes, sizes, dropped);
+    ASSERT_EQ("HHaaa", bytes);
+}
+} // namespace NewRelic
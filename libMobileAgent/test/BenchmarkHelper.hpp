@@ -0,0 +1,59 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#ifndef PROJECT_BENCHMARKHELPER_HPP
+#define PROJECT_BENCHMARKHELPER_HPP
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Shared by the *Benchmark_test fixtures. The benchmarks only time things and print what they
+// measured, so they are registered DISABLED_ and stay out of the normal run; run them with
+//   nrtests --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+class BenchmarkHelper {
+
+public:
+    // wall time of one call, in seconds
+    template<typename F>
+    static double seconds(F f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // best of a few calls, in microseconds
+    template<typename F>
+    static long long bestMicros(F f,
+                                int runs = 5) {
+        long long best = -1;
+        for (int run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        return best;
+    }
+
+    // runs f(0) .. f(threads - 1) on threads of their own and returns the seconds until all finish
+    template<typename F>
+    static double secondsOnThreads(int threads,
+                                   F f) {
+        return seconds([&] {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&f, t] { f(t); });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        });
+    }
+
+private:
+    BenchmarkHelper() {}
+};
+
+#endif //PROJECT_BENCHMARKHELPER_HPP
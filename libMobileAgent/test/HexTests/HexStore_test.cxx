@@ -177,6 +177,29 @@ TEST_F(HexStoreTest, testBacklogCapEvictsOldest) {
     rmdir(dir.c_str());
 }
 
+// The sweep clear() queues still runs when the store is destroyed right after, which doesn't wait for it.
+TEST_F(HexStoreTest, testClearCompletesAfterDestruction) {
+    const std::string dir = "./hexbkup_cleared";
+    const std::string ext = ".fbad";
+    mkpath_np(dir.c_str(), 0755);
+    removeAllWithExtension(dir, ext);
+    for (int i = 0; i < 10; ++i) {
+        std::ofstream f(dir + "/NRExceptionReport" + std::to_string(i) + ext, std::ios::binary);
+        f << "x";
+    }
+
+    {
+        NewRelic::Hex::HexStore cleared(dir.c_str());
+        cleared.clear();
+    }
+    for (int i = 0; i < 200 && countFilesWithExtension(dir, ext) > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(countFilesWithExtension(dir, ext), 0u);
+
+    rmdir(dir.c_str());
+}
+
 // Corrupt / zero-byte .fbad files must be skipped, not crash. Previously
 // HexStore::readAll fell through to `new uint8_t[size]` with size == -1
 // when tellg() returned -1 on a corrupt file, allocating ~SIZE_MAX bytes.
@@ -0,0 +1,44 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Utilities/LatencyHistogram.hpp>
+#include <gmock/gmock.h>
+
+namespace NewRelic {
+
+    TEST(LatencyHistogram, testBucketsCoverEveryValue) {
+        // every value falls in a bucket whose upper bound is at least the value and within the bucket precision
+        for (uint64_t value : {0ull, 1ull, 7ull, 8ull, 15ull, 16ull, 17ull, 1000ull, 123456ull, 4294967295ull}) {
+            const uint64_t high = LatencyHistogram::highestValueIn(LatencyHistogram::bucketOf(value));
+            ASSERT_GE(high, value);
+            ASSERT_LE(high - value, value / LatencyHistogram::SUB_BUCKETS);
+        }
+        ASSERT_EQ(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::bucketOf(1ull << 40));
+
+        for (std::size_t bucket = 1; bucket < LatencyHistogram::BUCKET_COUNT; bucket++) {
+            ASSERT_EQ(bucket, LatencyHistogram::bucketOf(LatencyHistogram::highestValueIn(bucket - 1) + 1));
+        }
+    }
+
+    TEST(LatencyHistogram, testPercentiles) {
+        LatencyHistogram histogram;
+        for (uint64_t i = 1; i <= 1000; i++) {
+            histogram.record(i);
+        }
+        histogram.record(std::chrono::milliseconds(50));
+
+        auto snapshot = histogram.snapshot();
+        ASSERT_EQ(1001, snapshot.count);
+        ASSERT_EQ(50000, snapshot.max);
+        ASSERT_NEAR(500, snapshot.percentile(50), 500 / LatencyHistogram::SUB_BUCKETS);
+        ASSERT_NEAR(990, snapshot.percentile(99), 990 / LatencyHistogram::SUB_BUCKETS);
+        ASSERT_EQ(50000, snapshot.percentile(100));
+        ASSERT_NEAR((500500.0 + 50000.0) / 1001.0, snapshot.mean(), 0.001);
+
+        auto merged = snapshot;
+        merged.merge(snapshot);
+        ASSERT_EQ(2002, merged.count);
+        ASSERT_EQ(snapshot.percentile(50), merged.percentile(50));
+
+        ASSERT_EQ(0, LatencyHistogram().snapshot().percentile(99));
+    }
+}
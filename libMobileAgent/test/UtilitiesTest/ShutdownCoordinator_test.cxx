@@ -0,0 +1,114 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Utilities/ShutdownCoordinator.hpp>
+#include <Utilities/WorkQueue.hpp>
+#include <atomic>
+#include <thread>
+#include <gmock/gmock.h>
+
+namespace NewRelic {
+
+    // Drains a queue whose items take a fixed time each.
+    class QueueParticipant : public ShutdownCoordinator::Participant {
+    public:
+        WorkQueue queue;
+        std::atomic<bool> begun{false};
+
+        void beginDrain() override {
+            begun = true;
+        }
+
+        bool awaitDrained(ShutdownCoordinator::CLOCK::time_point deadline) override {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ShutdownCoordinator::CLOCK::now());
+            return queue.synchronize((unsigned int)std::max<long long>(remaining.count(), 0));
+        }
+
+        void addWork(int items,
+                     std::chrono::milliseconds each) {
+            for (int i = 0; i < items; i++) {
+                queue.enqueue([each] { std::this_thread::sleep_for(each); });
+            }
+        }
+    };
+
+    TEST(ShutdownCoordinator, testDrainsEveryParticipant) {
+        ShutdownCoordinator coordinator;
+        QueueParticipant first;
+        QueueParticipant second;
+        coordinator.enroll(&first);
+        coordinator.enroll(&second);
+        first.addWork(5, std::chrono::milliseconds(10));
+        second.addWork(5, std::chrono::milliseconds(10));
+
+        auto result = coordinator.drain(std::chrono::milliseconds(2000));
+        ASSERT_TRUE(first.begun);
+        ASSERT_TRUE(second.begun);
+        ASSERT_EQ(2u, result.participants);
+        ASSERT_EQ(2u, result.drained);
+        ASSERT_EQ(0u, result.timedOut);
+        ASSERT_TRUE(first.queue.isEmpty());
+        ASSERT_TRUE(second.queue.isEmpty());
+
+        coordinator.withdraw(&first);
+        coordinator.withdraw(&second);
+    }
+
+    TEST(ShutdownCoordinator, testOneDeadlineForAll) {
+        ShutdownCoordinator coordinator;
+        QueueParticipant slow;
+        QueueParticipant slower;
+        coordinator.enroll(&slow);
+        coordinator.enroll(&slower);
+        slow.addWork(20, std::chrono::milliseconds(20));
+        slower.addWork(20, std::chrono::milliseconds(20));
+
+        // each would take 400 ms on its own; together they get 100
+        auto result = coordinator.drain(std::chrono::milliseconds(100));
+        ASSERT_EQ(2u, result.timedOut);
+        ASSERT_LT(result.elapsed.count(), 300000);
+
+        coordinator.withdraw(&slow);
+        coordinator.withdraw(&slower);
+        slow.queue.clearQueue();
+        slower.queue.clearQueue();
+    }
+
+    TEST(ShutdownCoordinator, testWithdrawnParticipantIsSkipped) {
+        ShutdownCoordinator coordinator;
+        QueueParticipant participant;
+        coordinator.enroll(&participant);
+        coordinator.withdraw(&participant);
+
+        auto result = coordinator.drain(std::chrono::milliseconds(100));
+        ASSERT_EQ(0u, result.participants);
+        ASSERT_FALSE(participant.begun);
+    }
+
+    TEST(ShutdownCoordinator, testDrainDoesNotBlockOtherParticipants) {
+        ShutdownCoordinator coordinator;
+        QueueParticipant busy;
+        QueueParticipant idle;
+        coordinator.enroll(&idle);
+        coordinator.enroll(&busy);
+        busy.addWork(1, std::chrono::milliseconds(300));
+
+        std::thread drainer([&coordinator] { coordinator.drain(std::chrono::milliseconds(2000)); });
+        while (!busy.begun) {
+            std::this_thread::yield();
+        }
+
+        // idle is done long before busy; neither it nor a newcomer waits out busy's drain
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        auto start = ShutdownCoordinator::CLOCK::now();
+        QueueParticipant late;
+        coordinator.enroll(&late);
+        coordinator.withdraw(&late);
+        coordinator.withdraw(&idle);
+        ASSERT_LT(ShutdownCoordinator::CLOCK::now() - start, std::chrono::milliseconds(150));
+
+        // withdrawing busy waits for the drain to be done with it
+        coordinator.withdraw(&busy);
+        ASSERT_TRUE(busy.queue.isEmpty());
+        drainer.join();
+    }
+} // namespace NewRelic
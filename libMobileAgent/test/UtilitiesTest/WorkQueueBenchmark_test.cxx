@@ -0,0 +1,63 @@
+//  Copyright © 2023 New Relic. All rights reserved.
+
+#include <Utilities/WorkQueue.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <gmock/gmock.h>
+#include "../BenchmarkHelper.hpp"
+
+using ::testing::Test;
+
+namespace NewRelic {
+
+class WorkQueueBenchmark : public ::testing::Test {
+protected:
+    static const int ITEMS = 64000;
+
+    struct Result {
+        double itemsPerSecond;
+        long long p50Micros;
+        long long p99Micros;
+    };
+
+    // Producers split ITEMS between them; each item records how long it waited from enqueue() to running.
+    static Result run(int producers,
+                      std::size_t drainBatchSize) {
+        WorkQueue queue(WorkQueue::DEFAULT_CAPACITY, WorkQueue::OverflowPolicy::Spill, nullptr, drainBatchSize);
+        std::vector<long long> latencies;
+        latencies.reserve(ITEMS);
+
+        auto elapsed = BenchmarkHelper::seconds([&] {
+            BenchmarkHelper::secondsOnThreads(producers, [&](int) {
+                for (int i = 0; i < ITEMS / producers; i++) {
+                    auto enqueued = std::chrono::steady_clock::now();
+                    queue.enqueue([&latencies, enqueued] {
+                        // only the worker touches latencies
+                        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - enqueued).count());
+                    });
+                }
+            });
+            queue.synchronize();
+        });
+
+        std::sort(latencies.begin(), latencies.end());
+        return Result{(double)latencies.size() / elapsed,
+                      latencies[latencies.size() / 2],
+                      latencies[latencies.size() * 99 / 100]};
+    }
+};
+
+TEST_F(WorkQueueBenchmark, DISABLED_testEnqueueToCompletion) {
+    for (int producers : {1, 4, 16}) {
+        Result single = run(producers, 1);
+        Result batched = run(producers, WorkQueue::DEFAULT_DRAIN_BATCH_SIZE);
+        std::cout << producers << " producers: "
+                  << "item by item " << (long long)single.itemsPerSecond << " items/s"
+                  << " (p50 " << single.p50Micros << " us, p99 " << single.p99Micros << " us)"
+                  << ", batched " << (long long)batched.itemsPerSecond << " items/s"
+                  << " (p50 " << batched.p50Micros << " us, p99 " << batched.p99Micros << " us)" << std::endl;
+    }
+}
+} // namespace NewRelic
@@ -3,7 +3,14 @@
 //
 
 #include <iostream>
+#include <array>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gmock/gmock.h>
 
 using ::testing::Eq;
@@ -68,4 +75,458 @@ namespace NewRelic {
         queue.clearQueue();
         ASSERT_TRUE(queue.isEmpty());
     }
+
+    TEST(WorkQueue, testMoveOnlyItems) {
+        WorkQueue queue;
+        auto result = std::make_shared<int>(0);
+        std::unique_ptr<int> value(new int(7));
+        queue.enqueue([result, value = std::move(value)] {
+            *result = *value;
+        });
+
+        // larger than the inline buffer
+        std::array<int, 64> large{};
+        large[63] = 5;
+        queue.enqueue([result, large] {
+            *result += large[63];
+        });
+
+        queue.synchronize();
+        ASSERT_EQ(12, *result);
+    }
+
+    TEST(WorkQueue, testSpillKeepsOrder) {
+        WorkQueue queue(4, WorkQueue::OverflowPolicy::Spill);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        queue.enqueue([opened] { opened.wait(); });
+
+        std::vector<int> order;
+        for (int i = 0; i < 100; i++) {
+            ASSERT_TRUE(queue.enqueue([&order, i] { order.push_back(i); }));
+        }
+        gate.set_value();
+        queue.synchronize();
+
+        ASSERT_EQ(100, order.size());
+        for (int i = 0; i < 100; i++) {
+            ASSERT_EQ(i, order[i]);
+        }
+    }
+
+    TEST(WorkQueue, testRejectWhenFull) {
+        WorkQueue queue(4, WorkQueue::OverflowPolicy::Reject);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        queue.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+
+        std::atomic<int> ran(0);
+        int accepted = 0;
+        for (int i = 0; i < 10; i++) {
+            if (queue.enqueue([&ran] { ran++; })) {
+                accepted++;
+            }
+        }
+        ASSERT_EQ(4, accepted);
+
+        gate.set_value();
+        queue.synchronize();
+        ASSERT_EQ(4, ran.load());
+        ASSERT_TRUE(queue.isEmpty());
+    }
+
+    TEST(WorkQueue, testConcurrentProducers) {
+        // far more items than the ring holds; the rest spill, and each producer's stay in order
+        WorkQueue queue(8, WorkQueue::OverflowPolicy::Spill);
+        std::vector<int> lastSeen(4, -1);
+        bool ordered = true;
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; t++) {
+            producers.emplace_back([&, t] {
+                for (int i = 0; i < 2000; i++) {
+                    queue.enqueue([&, t, i] {
+                        ordered = ordered && lastSeen[t] == i - 1;
+                        lastSeen[t] = i;
+                    });
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        queue.synchronize();
+
+        ASSERT_TRUE(ordered);
+        for (int t = 0; t < 4; t++) {
+            ASSERT_EQ(1999, lastSeen[t]);
+        }
+    }
+
+    TEST(WorkQueue, testStrandsShareThePool) {
+        IOThreadPool pool(2);
+        std::mutex idsMutex;
+        std::set<std::thread::id> threadIds;
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::vector<int>> orders(8);
+        for (int q = 0; q < 8; q++) {
+            queues.emplace_back(new WorkQueue(16, WorkQueue::OverflowPolicy::Spill, &pool));
+        }
+
+        for (int i = 0; i < 500; i++) {
+            for (int q = 0; q < 8; q++) {
+                queues[q]->enqueue([&, q, i] {
+                    orders[q].push_back(i);
+                    std::lock_guard<std::mutex> lk(idsMutex);
+                    threadIds.insert(std::this_thread::get_id());
+                });
+            }
+        }
+        for (auto& queue : queues) {
+            queue->synchronize();
+        }
+
+        ASSERT_LE(threadIds.size(), 2);
+        for (int q = 0; q < 8; q++) {
+            ASSERT_EQ(500, orders[q].size());
+            for (int i = 0; i < 500; i++) {
+                ASSERT_EQ(i, orders[q][i]);
+            }
+        }
+    }
+
+    TEST(WorkQueue, testTerminatePooledQueue) {
+        IOThreadPool pool(1);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        WorkQueue blocker(16, WorkQueue::OverflowPolicy::Spill, &pool);
+        blocker.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+
+        // waiting behind the blocker for the only pool thread; terminating takes it off the pool's list
+        std::atomic<bool> ran(false);
+        {
+            WorkQueue waiting(16, WorkQueue::OverflowPolicy::Spill, &pool);
+            waiting.enqueue([&ran] { ran = true; });
+            ASSERT_TRUE(waiting.terminate(100));
+            ASSERT_FALSE(waiting.enqueue([] {}));
+        }
+
+        ASSERT_FALSE(blocker.terminate(10));
+        gate.set_value();
+        ASSERT_TRUE(blocker.terminate(1000));
+        ASSERT_FALSE(ran.load());
+    }
+
+    TEST(WorkQueue, testSynchronizeAfterTerminate) {
+        IOThreadPool pool(1);
+        std::unique_ptr<WorkQueue> dedicated(new WorkQueue(16));
+        std::unique_ptr<WorkQueue> pooled(new WorkQueue(16, WorkQueue::OverflowPolicy::Spill, &pool));
+        for (WorkQueue* queue : {dedicated.get(), pooled.get()}) {
+            std::promise<void> gate;
+            std::shared_future<void> opened = gate.get_future().share();
+            std::promise<void> started;
+            queue->enqueue([opened, &started] {
+                started.set_value();
+                opened.wait();
+            });
+            started.get_future().wait();
+            std::atomic<int> ran(0);
+            for (int i = 0; i < 5; i++) {
+                queue->enqueue([&ran] { ran++; });
+            }
+
+            // the queued items are dropped, and nothing waits for them any more
+            ASSERT_FALSE(queue->terminate(10));
+            gate.set_value();
+            ASSERT_TRUE(queue->synchronize(1000));
+            queue->synchronize();
+            ASSERT_TRUE(queue->isEmpty());
+            ASSERT_EQ(0, ran.load());
+        }
+    }
+
+    TEST(WorkQueue, testTerminateWhileProducing) {
+        IOThreadPool pool(2);
+        for (int round = 0; round < 40; round++) {
+            std::unique_ptr<WorkQueue> queue(round % 2 == 0 ? new WorkQueue(16)
+                                                            : new WorkQueue(16, WorkQueue::OverflowPolicy::Spill, &pool));
+            std::atomic<bool> go(false);
+            std::vector<std::thread> producers;
+            for (int t = 0; t < 4; t++) {
+                producers.emplace_back([&] {
+                    while (!go.load()) {
+                        std::this_thread::yield();
+                    }
+                    while (queue->enqueue([] {})) {
+                    }
+                });
+            }
+            go = true;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            ASSERT_TRUE(queue->terminate(1000));
+            for (auto& producer : producers) {
+                producer.join();
+            }
+
+            // an item pushed while terminate() ran was either rejected or dropped with the rest
+            ASSERT_TRUE(queue->synchronize(1000));
+            ASSERT_TRUE(queue->isEmpty());
+        }
+    }
+
+    TEST(WorkQueue, testSynchronizeFromEveryPoolThread) {
+        // every thread of the pool waits for another queue on the same pool; nothing is left to run
+        // those queues but the waiting threads themselves
+        IOThreadPool pool(2);
+        std::vector<std::unique_ptr<WorkQueue>> waiting;
+        std::vector<std::unique_ptr<WorkQueue>> waitedFor;
+        for (int i = 0; i < 2; i++) {
+            waiting.emplace_back(new WorkQueue(16, WorkQueue::OverflowPolicy::Spill, &pool));
+            waitedFor.emplace_back(new WorkQueue(16, WorkQueue::OverflowPolicy::Spill, &pool));
+        }
+        std::atomic<int> arrived(0);
+        std::atomic<int> checked(0);
+        std::atomic<int> ran(0);
+        std::atomic<int> pendingOnPool(0);
+        std::atomic<int> selfSynchronized(0);
+        std::vector<WorkCompletion> waits;
+        for (int i = 0; i < 2; i++) {
+            WorkQueue* own = waiting[i].get();
+            WorkQueue* other = waitedFor[i].get();
+            waits.push_back(own->enqueueTracked([&, own, other] {
+                arrived++;
+                while (arrived.load() < 2) {
+                    std::this_thread::yield();
+                }
+                for (int n = 0; n < 10; n++) {
+                    other->enqueue([&ran] { ran++; });
+                }
+                // a completion isn't waited for on the pool
+                WorkCompletion last = other->enqueueTracked([&ran] { ran++; });
+                pendingOnPool += last.wait() == WorkCompletion::Status::Pending;
+                checked++;
+                while (checked.load() < 2) {
+                    std::this_thread::yield();
+                }
+                other->synchronize();
+                // nor is the queue the caller is in
+                selfSynchronized += own->synchronize(1000);
+            }));
+        }
+
+        for (auto& wait : waits) {
+            ASSERT_EQ(WorkCompletion::Status::Completed, wait.wait(2000));
+        }
+        ASSERT_EQ(22, ran.load());
+        ASSERT_EQ(2, pendingOnPool.load());
+        ASSERT_EQ(0, selfSynchronized.load());
+    }
+
+    TEST(WorkQueue, testPoolTimers) {
+        IOThreadPool pool(1);
+        int owner = 0;
+        int cancelled = 0;
+        std::mutex firedMutex;
+        std::vector<int> fired;
+        std::promise<void> done;
+        auto now = IOThreadPool::CLOCK::now();
+        pool.scheduleAt(&owner, now + std::chrono::milliseconds(60), [&] {
+            std::lock_guard<std::mutex> lk(firedMutex);
+            fired.push_back(2);
+            done.set_value();
+        });
+        pool.scheduleAt(&owner, now + std::chrono::milliseconds(20), [&] {
+            std::lock_guard<std::mutex> lk(firedMutex);
+            fired.push_back(1);
+        });
+        pool.scheduleAt(&cancelled, now + std::chrono::milliseconds(40), [&] {
+            std::lock_guard<std::mutex> lk(firedMutex);
+            fired.push_back(0);
+        });
+        pool.cancelTimers(&cancelled);
+
+        // the pool thread is free for queued work while the timers wait
+        WorkQueue queue(16, WorkQueue::OverflowPolicy::Spill, &pool);
+        std::atomic<bool> ran(false);
+        queue.enqueue([&ran] { ran = true; });
+        queue.synchronize();
+        ASSERT_TRUE(ran.load());
+
+        ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(2)));
+        std::lock_guard<std::mutex> lk(firedMutex);
+        ASSERT_EQ((std::vector<int>{1, 2}), fired);
+    }
+
+    TEST(WorkQueue, testClearDropsTakenBatch) {
+        WorkQueue queue(16, WorkQueue::OverflowPolicy::Spill, nullptr, 8);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        std::atomic<int> ran(0);
+
+        // held up, the worker takes the first item with the seven behind it as one batch
+        queue.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        for (int i = 0; i < 7; i++) {
+            queue.enqueue([&ran] { ran++; });
+        }
+        started.get_future().wait();
+
+        queue.clearQueue();
+        gate.set_value();
+        queue.synchronize();
+        ASSERT_EQ(0, ran.load());
+
+        queue.enqueue([&ran] { ran++; });
+        queue.synchronize();
+        ASSERT_EQ(1, ran.load());
+    }
+
+    TEST(WorkQueue, testPriorityLanes) {
+        WorkQueue queue;
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        queue.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+
+        std::vector<std::string> order;
+        queue.enqueue([&order] { order.push_back("compact"); }, WorkQueue::Priority::Background);
+        for (int i = 0; i < 3; i++) {
+            queue.enqueue([&order] { order.push_back("flush"); });
+        }
+        queue.enqueue([&order] { order.push_back("clear"); }, WorkQueue::Priority::Control);
+        gate.set_value();
+        queue.synchronize();
+
+        ASSERT_EQ((std::vector<std::string>{"clear", "flush", "flush", "flush", "compact"}), order);
+    }
+
+    TEST(WorkQueue, testDeadlineJumpsAhead) {
+        WorkQueue queue;
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        queue.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+
+        std::vector<std::string> order;
+        queue.enqueue([&order] { order.push_back("overdue"); }, WorkQueue::Priority::Background, std::chrono::milliseconds(0));
+        queue.enqueue([&order] { order.push_back("later"); }, WorkQueue::Priority::Background, std::chrono::hours(1));
+        queue.enqueue([&order] { order.push_back("flush"); });
+        queue.enqueue([&order] { order.push_back("clear"); }, WorkQueue::Priority::Control);
+        gate.set_value();
+        queue.synchronize();
+
+        ASSERT_EQ((std::vector<std::string>{"overdue", "clear", "flush", "later"}), order);
+    }
+
+    TEST(WorkQueue, testStatistics) {
+        auto before = WorkQueue::getTerminationStatistics();
+        {
+            WorkQueue queue(4, WorkQueue::OverflowPolicy::Reject);
+            std::promise<void> gate;
+            std::shared_future<void> opened = gate.get_future().share();
+            std::promise<void> started;
+            queue.enqueue([opened, &started] {
+                started.set_value();
+                opened.wait();
+            });
+            started.get_future().wait();
+            for (int i = 0; i < 6; i++) {
+                queue.enqueue([] {});
+            }
+            ASSERT_EQ(4, queue.getStatistics().depth);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            gate.set_value();
+            queue.synchronize();
+            queue.enqueue([] { throw 8; });
+            queue.synchronize();
+
+            auto statistics = queue.getStatistics();
+            ASSERT_EQ(6, statistics.enqueued);
+            ASSERT_EQ(6, statistics.executed);
+            ASSERT_EQ(1, statistics.failed);
+            ASSERT_EQ(2, statistics.rejected);
+            ASSERT_EQ(0, statistics.depth);
+            ASSERT_EQ(4, statistics.maxDepth);
+            ASSERT_EQ(6, statistics.queueWait.count);
+            ASSERT_GE(statistics.queueWait.max, 5000);
+            ASSERT_GE(statistics.runTime.max, 5000);
+            ASSERT_EQ(2, statistics.synchronizeWait.count);
+
+            queue.terminate(1000);
+            ASSERT_FALSE(queue.enqueue([] {}));
+            ASSERT_EQ(3, queue.getStatistics().rejected);
+        }
+
+        auto after = WorkQueue::getTerminationStatistics();
+        ASSERT_EQ(before.terminations + 1, after.terminations);
+        ASSERT_EQ(before.timedOut, after.timedOut);
+        ASSERT_EQ(before.wait.count + 1, after.wait.count);
+    }
+
+    TEST(WorkQueue, testCompletionTokens) {
+        WorkQueue queue(4, WorkQueue::OverflowPolicy::Reject);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        std::promise<void> started;
+        queue.enqueue([opened, &started] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+
+        std::atomic<bool> written(false);
+        auto write = queue.enqueueTracked([&written] { written = true; }, WorkQueue::Priority::Control);
+        auto failing = queue.enqueueTracked([] { throw 8; });
+        auto later = queue.enqueueTracked([] {});
+        ASSERT_EQ(WorkCompletion::Status::Pending, write.status());
+        ASSERT_EQ(WorkCompletion::Status::Pending, write.wait(10));
+
+        // items behind the awaited one are still queued when it completes
+        std::thread waiter([&] {
+            ASSERT_EQ(WorkCompletion::Status::Completed, write.wait());
+            ASSERT_TRUE(written.load());
+        });
+        // fills the normal lane
+        for (int i = 0; i < 2; i++) {
+            ASSERT_TRUE(queue.enqueue([opened] { opened.wait(); }));
+        }
+        auto rejected = queue.enqueueTracked([] {});
+        ASSERT_EQ(WorkCompletion::Status::Dropped, rejected.status());
+
+        gate.set_value();
+        waiter.join();
+        ASSERT_EQ(WorkCompletion::Status::Failed, failing.wait());
+        queue.synchronize();
+        ASSERT_EQ(WorkCompletion::Status::Completed, later.status());
+
+        std::promise<void> blocked;
+        std::shared_future<void> unblocked = blocked.get_future().share();
+        queue.enqueue([unblocked] { unblocked.wait(); });
+        auto dropped = queue.enqueueTracked([] {});
+        queue.clearQueue();
+        blocked.set_value();
+        ASSERT_EQ(WorkCompletion::Status::Dropped, dropped.wait());
+        ASSERT_EQ(WorkCompletion::Status::Dropped, WorkCompletion().wait());
+    }
 }